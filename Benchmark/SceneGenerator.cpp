@@ -0,0 +1,50 @@
+#include "SceneGenerator.h"
+#include <cmath>
+
+void GenerateScene(Scene* scene, size_t count, unsigned long long seed, unsigned int type_mask)
+{
+	ShapeType types[SHAPE_TYPE_COUNT];
+	int type_count = 0;
+	for (int i = 0; i < SHAPE_TYPE_COUNT; i++)
+		if (type_mask & (1 << i))
+			types[type_count++] = (ShapeType)i;
+	if (type_count == 0) return;
+
+	Random random(seed);
+	float side = 20 * sqrtf((float)count);
+	Vector2 stroke[GENERATE_STROKE_POINTS];
+	for (size_t i = 0; i < count; i++)
+	{
+		ShapeData shape;
+		shape.type = types[random.Next() % type_count];
+		shape.flags = random.Next() & 1 ? SHAPE_FILLED : 0;
+		shape.color = Color(random.Uniform(), random.Uniform(), random.Uniform());
+		shape.radius = 0;
+		Vector2 center = { random.Uniform(0, side), random.Uniform(0, side) };
+		// shapes are a few to a few tens of units across, lines a little longer
+		float size = random.Uniform(2, shape.type == SHAPE_LINE ? 60.0f : 30.0f);
+		for (int j = 0; j < 4; j++)
+		{
+			shape.vertices[j].x = center.x + random.Uniform(-size, size);
+			shape.vertices[j].y = center.y + random.Uniform(-size, size);
+		}
+		if (shape.type == SHAPE_POINT || shape.type == SHAPE_CIRCLE)
+			shape.vertices[0] = center;
+		if (shape.type == SHAPE_CIRCLE)
+			shape.radius = size / 2;
+		if (shape.type == SHAPE_STROKE)
+		{
+			// a random walk from the center, like a short scribble
+			stroke[0] = center;
+			for (int j = 1; j < GENERATE_STROKE_POINTS; j++)
+			{
+				stroke[j].x = stroke[j - 1].x + random.Uniform(-size, size) / 4;
+				stroke[j].y = stroke[j - 1].y + random.Uniform(-size, size) / 4;
+			}
+			shape.flags = 0;
+		}
+		shape.points = stroke;
+		shape.point_count = GENERATE_STROKE_POINTS;
+		scene->Add(shape);
+	}
+}
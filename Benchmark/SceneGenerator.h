@@ -0,0 +1,34 @@
+#ifndef SCENE_GENERATOR_H
+#define SCENE_GENERATOR_H
+
+#include "../OpenGL/Scene.h"
+
+// small fast generator with a fixed sequence per seed on every platform, unlike rand()
+class Random
+{
+public:
+	explicit Random(unsigned long long seed) { state_ = seed; }
+	unsigned long long Next()
+	{
+		// splitmix64
+		unsigned long long z = (state_ += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+	float Uniform() { return (Next() >> 40) / 16777216.0f; } // [0, 1)
+	float Uniform(float low, float high) { return low + (high - low) * Uniform(); }
+private:
+	unsigned long long state_;
+};
+
+// bit of every shape type, for scenes of some types only
+const unsigned int GENERATE_ALL_TYPES = (1 << SHAPE_TYPE_COUNT) - 1;
+const int GENERATE_STROKE_POINTS = 16;
+
+// Add count shapes of the types in type_mask, filled or outline in random colors, spread so
+// the density stays the same whatever the count: about one shape per 20 x 20 world units.
+// The same seed always gives the same scene.
+void GenerateScene(Scene* scene, size_t count, unsigned long long seed, unsigned int type_mask = GENERATE_ALL_TYPES);
+
+#endif
@@ -0,0 +1,358 @@
+// Rendering benchmark: draws generated scenes of growing size and prints the timings as JSON.
+// usage: Benchmark [-sizes n,n,...] [-frames n] [-size WxH] [-seed n] [-threads n] [-kernel name] [-storage name] [-out file]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include "../OpenGL/Scene.h"
+#include "../OpenGL/View.h"
+#include "../OpenGL/Raster.h"
+#include "../OpenGL/Renderer.h"
+#include "../OpenGL/MappedFile.h"
+#include "SceneGenerator.h"
+
+using namespace std;
+
+struct BenchmarkOptions
+{
+	vector<size_t> sizes;
+	int frames;
+	int w;
+	int h;
+	unsigned long long seed;
+	int threads;
+	RasterKernel kernel;
+	bool compact;
+	string out;
+};
+
+// per shape type scenes are capped, their cost per shape hardly changes past this
+const size_t TYPE_SCENE_MAX = 100000;
+const int TYPE_FRAMES = 5;
+// window sizes of the resize runs
+const int RESIZES[][2] = { { 640, 480 }, { 800, 600 }, { 1024, 768 }, { 1280, 720 }, { 1600, 900 }, { 1920, 1080 } };
+const int RESIZE_COUNT = sizeof(RESIZES) / sizeof(RESIZES[0]);
+const char* TYPE_NAMES[SHAPE_TYPE_COUNT] = { "point", "line", "triangle", "quad", "circle", "stroke" };
+
+static void Usage()
+{
+	fprintf(stderr,
+		"usage: Benchmark [-sizes n,n,...] [-frames n] [-size WxH] [-seed n] [-threads n] [-kernel name] [-storage name] [-out file]\n"
+		"  -sizes    shape counts of the scenes, 1000,10000,100000,1000000 by default\n"
+		"  -frames   frames drawn per scene through random views, 60 by default\n"
+		"  -size     window size in pixels, 1280x720 by default\n"
+		"  -seed     seed of the scene generator, 1 by default\n"
+		"  -threads  threads of the software renderer, one per core by default\n"
+		"  -kernel   scalar, sse2 or avx2 pixel kernel, the best supported by default\n"
+		"  -storage  float or compact vertex storage of the scenes, float by default\n"
+		"  -out      file of the JSON results, standard output by default\n");
+}
+
+static bool ParseOptions(int argc, char** argv, BenchmarkOptions* options)
+{
+	options->frames = 60;
+	options->w = 1280;
+	options->h = 720;
+	options->seed = 1;
+	options->threads = 0;
+	options->kernel = CurrentRasterKernel();
+	options->compact = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc) return false;
+		const char* value = argv[++i];
+		char* end;
+		if (strcmp(argv[i - 1], "-sizes") == 0)
+		{
+			while (*value != '\0')
+			{
+				unsigned long long n = strtoull(value, &end, 10);
+				if (end == value || n == 0 || (*end != ',' && *end != '\0')) return false;
+				options->sizes.push_back((size_t)n);
+				value = *end == ',' ? end + 1 : end;
+			}
+		}
+		else if (strcmp(argv[i - 1], "-frames") == 0)
+		{
+			options->frames = atoi(value);
+			if (options->frames < 1) return false;
+		}
+		else if (strcmp(argv[i - 1], "-size") == 0)
+		{
+			options->w = (int)strtol(value, &end, 10);
+			if (*end != 'x') return false;
+			options->h = (int)strtol(end + 1, &end, 10);
+			if (*end != '\0' || options->w < 1 || options->h < 1) return false;
+		}
+		else if (strcmp(argv[i - 1], "-seed") == 0)
+		{
+			options->seed = strtoull(value, &end, 10);
+			if (end == value || *end != '\0') return false;
+		}
+		else if (strcmp(argv[i - 1], "-threads") == 0)
+		{
+			options->threads = atoi(value);
+			if (options->threads < 1) return false;
+		}
+		else if (strcmp(argv[i - 1], "-kernel") == 0)
+		{
+			int k = 0;
+			while (k < RASTER_KERNEL_COUNT && strcmp(value, RasterKernelName((RasterKernel)k)) != 0) k++;
+			if (k == RASTER_KERNEL_COUNT) return false;
+			options->kernel = (RasterKernel)k;
+		}
+		else if (strcmp(argv[i - 1], "-storage") == 0)
+		{
+			if (strcmp(value, "compact") != 0 && strcmp(value, "float") != 0) return false;
+			options->compact = strcmp(value, "compact") == 0;
+		}
+		else if (strcmp(argv[i - 1], "-out") == 0)
+		{
+			options->out = value;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	if (options->sizes.empty())
+	{
+		for (size_t n = 1000; n <= 1000000; n *= 10)
+			options->sizes.push_back(n);
+	}
+	return true;
+}
+
+class Stopwatch
+{
+public:
+	Stopwatch() { start_ = chrono::steady_clock::now(); }
+	double Milliseconds() const { return chrono::duration<double, milli>(chrono::steady_clock::now() - start_).count(); }
+private:
+	chrono::steady_clock::time_point start_;
+};
+
+struct Stats
+{
+	double mean;
+	double p50;
+	double p90;
+	double p99;
+	double max;
+};
+
+// nearest rank percentiles
+static Stats Summarize(vector<double> samples)
+{
+	Stats stats = { 0, 0, 0, 0, 0 };
+	if (samples.empty()) return stats;
+	sort(samples.begin(), samples.end());
+	for (size_t i = 0; i < samples.size(); i++)
+		stats.mean += samples[i] / samples.size();
+	size_t n = samples.size();
+	stats.p50 = samples[(n * 50 + 99) / 100 - 1];
+	stats.p90 = samples[(n * 90 + 99) / 100 - 1];
+	stats.p99 = samples[(n * 99 + 99) / 100 - 1];
+	stats.max = samples[n - 1];
+	return stats;
+}
+
+static double Median(vector<double> samples)
+{
+	return Summarize(samples).p50;
+}
+
+// what the window packs for the GL path: the visible rect and half a window around it
+static void BuildBatch(ShapeBatch* batch, const Scene& scene, const View& view, int w, int h)
+{
+	Rect visible = view.VisibleRect(w, h);
+	float margin_x = (visible.right - visible.left) / 2;
+	float margin_y = (visible.bottom - visible.top) / 2;
+	Rect region = { visible.left - margin_x, visible.top - margin_y, visible.right + margin_x, visible.bottom + margin_y };
+	batch->Clear();
+	batch->Build(scene, view.LodScale(), region);
+}
+
+struct SizeResult
+{
+	size_t shapes;
+	double generate_ms;
+	size_t memory;
+	Stats frame; // software frames through random views
+	Stats batch; // GL vertex packing of the same views
+	Stats fit; // fit the scene to a resized window and draw it
+	double type_draw_ns[SHAPE_TYPE_COUNT]; // per shape, scenes of one type seen whole
+	double type_batch_ns[SHAPE_TYPE_COUNT];
+};
+
+static void RunSize(const BenchmarkOptions& options, size_t count, SoftwareRenderer& renderer, SizeResult* result)
+{
+	result->shapes = count;
+	Framebuffer image;
+	ShapeBatch batch;
+	View view;
+	{
+		Scene scene;
+		scene.SetCompact(options.compact);
+		Stopwatch generate;
+		GenerateScene(&scene, count, options.seed);
+		result->generate_ms = generate.Milliseconds();
+		result->memory = scene.MemoryUsage();
+
+		// views zoomed 1 to 64 times into the fitted scene around random centers, the same for every build
+		Random random(options.seed + 1);
+		view.Fit(scene.Bounds(), options.w, options.h);
+		double fit_scale = view.Scale();
+		Rect bounds = scene.Bounds();
+		image.Resize(options.w, options.h);
+		vector<double> frame_ms, batch_ms;
+		for (int f = 0; f < options.frames; f++)
+		{
+			double scale = fit_scale * pow(2.0, random.Uniform(0, 6));
+			double center_x = random.Uniform(bounds.left, bounds.right);
+			double center_y = random.Uniform(bounds.top, bounds.bottom);
+			view.Set(center_x - options.w / (2 * scale), center_y - options.h / (2 * scale), scale);
+			Stopwatch frame;
+			renderer.Draw(scene, view, &image);
+			frame_ms.push_back(frame.Milliseconds());
+			Stopwatch pack;
+			BuildBatch(&batch, scene, view, options.w, options.h);
+			batch_ms.push_back(pack.Milliseconds());
+		}
+		result->frame = Summarize(frame_ms);
+		result->batch = Summarize(batch_ms);
+
+		vector<double> fit_ms;
+		for (int i = 0; i < RESIZE_COUNT; i++)
+		{
+			Stopwatch fit;
+			image.Resize(RESIZES[i][0], RESIZES[i][1]);
+			view.Fit(scene.Bounds(), RESIZES[i][0], RESIZES[i][1]);
+			renderer.Draw(scene, view, &image);
+			fit_ms.push_back(fit.Milliseconds());
+		}
+		result->fit = Summarize(fit_ms);
+	}
+
+	// the cost of clearing the frame is left out of the cost per shape
+	size_t type_count = min(count, TYPE_SCENE_MAX);
+	image.Resize(options.w, options.h);
+	vector<double> empty_ms;
+	{
+		Scene empty;
+		for (int f = 0; f < TYPE_FRAMES; f++)
+		{
+			Stopwatch frame;
+			renderer.Draw(empty, view, &image);
+			empty_ms.push_back(frame.Milliseconds());
+		}
+	}
+	double empty_frame_ms = Median(empty_ms);
+	for (int t = 0; t < SHAPE_TYPE_COUNT; t++)
+	{
+		Scene scene;
+		scene.SetCompact(options.compact);
+		GenerateScene(&scene, type_count, options.seed, 1 << t);
+		view.Fit(scene.Bounds(), options.w, options.h);
+		vector<double> draw_ms, batch_ms;
+		for (int f = 0; f < TYPE_FRAMES; f++)
+		{
+			Stopwatch frame;
+			renderer.Draw(scene, view, &image);
+			draw_ms.push_back(frame.Milliseconds());
+			Stopwatch pack;
+			BuildBatch(&batch, scene, view, options.w, options.h);
+			batch_ms.push_back(pack.Milliseconds());
+		}
+		result->type_draw_ns[t] = max(Median(draw_ms) - empty_frame_ms, 0.0) * 1e6 / type_count;
+		result->type_batch_ns[t] = Median(batch_ms) * 1e6 / type_count;
+	}
+}
+
+static void WriteStats(FILE* file, const char* name, const Stats& stats)
+{
+	fprintf(file, "      \"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+		name, stats.mean, stats.p50, stats.p90, stats.p99, stats.max);
+}
+
+static void WriteResults(FILE* file, const BenchmarkOptions& options, int threads, const vector<SizeResult>& results)
+{
+	fprintf(file, "{\n");
+	fprintf(file, "  \"benchmark\": \"SimplePainter rendering\",\n");
+	fprintf(file, "  \"seed\": %llu,\n", options.seed);
+	fprintf(file, "  \"width\": %d,\n  \"height\": %d,\n", options.w, options.h);
+	fprintf(file, "  \"frames\": %d,\n", options.frames);
+	fprintf(file, "  \"kernel\": \"%s\",\n", RasterKernelName(CurrentRasterKernel()));
+	fprintf(file, "  \"threads\": %d,\n", threads);
+	fprintf(file, "  \"storage\": \"%s\",\n", options.compact ? "compact" : "float");
+	fprintf(file, "  \"time_unit\": \"ms\",\n");
+	fprintf(file, "  \"sizes\": [\n");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const SizeResult& r = results[i];
+		fprintf(file, "    {\n");
+		fprintf(file, "      \"shapes\": %zu,\n", r.shapes);
+		fprintf(file, "      \"generate_ms\": %.3f,\n", r.generate_ms);
+		fprintf(file, "      \"memory_bytes\": %zu,\n", r.memory);
+		fprintf(file, "      \"bytes_per_shape\": %.2f,\n", (double)r.memory / r.shapes);
+		WriteStats(file, "frame_ms", r.frame);
+		WriteStats(file, "batch_ms", r.batch);
+		WriteStats(file, "fit_ms", r.fit);
+		fprintf(file, "      \"types\": {\n");
+		for (int t = 0; t < SHAPE_TYPE_COUNT; t++)
+		{
+			fprintf(file, "        \"%s\": { \"draw_ns_per_shape\": %.2f, \"batch_ns_per_shape\": %.2f }%s\n",
+				TYPE_NAMES[t], r.type_draw_ns[t], r.type_batch_ns[t], t + 1 < SHAPE_TYPE_COUNT ? "," : "");
+		}
+		fprintf(file, "      }\n");
+		fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		Usage();
+		return 2;
+	}
+	if (!SetRasterKernel(options.kernel))
+	{
+		fprintf(stderr, "the %s kernel is not supported by this cpu\n", RasterKernelName(options.kernel));
+		return 1;
+	}
+	SoftwareRenderer renderer;
+	int threads = options.threads > 0 ? options.threads : (int)max(thread::hardware_concurrency(), 1u);
+	renderer.SetThreads(threads);
+
+	vector<SizeResult> results;
+	for (size_t i = 0; i < options.sizes.size(); i++)
+	{
+		// progress goes to stderr, stdout may be the results
+		fprintf(stderr, "%zu shapes...\n", options.sizes[i]);
+		SizeResult result;
+		RunSize(options, options.sizes[i], renderer, &result);
+		results.push_back(result);
+	}
+
+	FILE* file = stdout;
+	if (!options.out.empty())
+	{
+		file = OpenFile(options.out.c_str(), "w");
+		if (file == NULL)
+		{
+			fprintf(stderr, "%s: can not write\n", options.out.c_str());
+			return 1;
+		}
+	}
+	WriteResults(file, options, threads, results);
+	if (file != stdout && fclose(file) != 0) return 1;
+	return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+
+// Growable array of plain data stored in fixed size chunks.
+// Growing allocates a new chunk and never moves elements, Clear keeps the chunks
+// for reuse so it costs O(1), Release gives all chunks back to the heap.
+// The first chunks may be borrowed from memory owned elsewhere, e.g. a mapped file.
+template <class T, int CHUNK_SHIFT = 12>
+class ChunkArray
+{
+public:
+	static const size_t CHUNK_SIZE = (size_t)1 << CHUNK_SHIFT;
+	static const size_t CHUNK_MASK = CHUNK_SIZE - 1;
+
+	ChunkArray() { count_ = 0; borrowed_ = 0; }
+	~ChunkArray() { Release(); }
+
+	size_t Count() const { return count_; }
+	bool Empty() const { return count_ == 0; }
+	T& operator[](size_t i) { return chunks_[i >> CHUNK_SHIFT][i & CHUNK_MASK]; }
+	const T& operator[](size_t i) const { return chunks_[i >> CHUNK_SHIFT][i & CHUNK_MASK]; }
+	T& Back() { return (*this)[count_ - 1]; }
+	const T& Back() const { return (*this)[count_ - 1]; }
+
+	// false when a new chunk was needed and the heap is out of memory, the array is unchanged then
+	bool PushBack(const T& value)
+	{
+		if ((count_ >> CHUNK_SHIFT) == chunks_.size() && !Reserve(count_ + 1))
+			return false;
+		chunks_[count_ >> CHUNK_SHIFT][count_ & CHUNK_MASK] = value;
+		count_++;
+		return true;
+	}
+	// allocate chunks until count elements fit, pushing that many cannot fail after. false when
+	// out of memory, the chunks allocated so far are kept for the next elements
+	bool Reserve(size_t count)
+	{
+		while (chunks_.size() << CHUNK_SHIFT < count)
+		{
+			// room for the pointer first, so a chunk is never allocated that can not be kept
+			if (chunks_.size() == chunks_.capacity())
+			{
+				try
+				{
+					chunks_.reserve(chunks_.size() * 2 + 1);
+				}
+				catch (const std::bad_alloc&)
+				{
+					return false;
+				}
+			}
+			T* chunk = (T*)malloc(CHUNK_SIZE * sizeof(T));
+			if (chunk == NULL) return false;
+			chunks_.push_back(chunk);
+		}
+		return true;
+	}
+	void PopBack(size_t n = 1) { count_ -= n; }
+	void Clear() { count_ = 0; }
+	void Release()
+	{
+		for (size_t i = borrowed_; i < chunks_.size(); i++)
+			free(chunks_[i]);
+		chunks_.clear();
+		count_ = 0;
+		borrowed_ = 0;
+	}
+	// use count elements at data as the array without copying them, data must hold whole chunks
+	// and outlive the array. Elements are written in place, growing past them allocates as usual
+	void Borrow(T* data, size_t count)
+	{
+		Release();
+		size_t chunks = (count + CHUNK_MASK) >> CHUNK_SHIFT;
+		for (size_t i = 0; i < chunks; i++)
+			chunks_.push_back(data + (i << CHUNK_SHIFT));
+		count_ = count;
+		borrowed_ = chunks;
+	}
+	// exchange contents in O(1), no element is copied
+	void Swap(ChunkArray& other)
+	{
+		chunks_.swap(other.chunks_);
+		size_t count = count_;
+		count_ = other.count_;
+		other.count_ = count;
+		size_t borrowed = borrowed_;
+		borrowed_ = other.borrowed_;
+		other.borrowed_ = borrowed;
+	}
+	// heap memory only, borrowed chunks are not counted
+	size_t MemoryUsage() const { return (chunks_.size() - borrowed_) * CHUNK_SIZE * sizeof(T) + chunks_.capacity() * sizeof(T*); }
+private:
+	ChunkArray(const ChunkArray&);
+	ChunkArray& operator=(const ChunkArray&);
+
+	std::vector<T*> chunks_;
+	size_t count_;
+	size_t borrowed_; // chunks_[0, borrowed_) are not ours to free
+};
+
+#endif
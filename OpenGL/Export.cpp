@@ -0,0 +1,440 @@
+#include "Export.h"
+#include "MappedFile.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+// file output through a fixed buffer, numbers are formatted in place
+class ExportBuffer
+{
+public:
+	ExportBuffer(FILE* file) { file_ = file; used_ = 0; ok_ = true; }
+	void Put(char c)
+	{
+		if (used_ == EXPORT_BUFFER_SIZE)
+			Flush();
+		buffer_[used_++] = c;
+	}
+	void Put(const char* text)
+	{
+		while (*text)
+			Put(*text++);
+	}
+	// at most two decimals and no trailing zeros, world units are finer than needed anyway
+	void Number(float value)
+	{
+		if (!(fabsf(value) < 1e15f))
+		{
+			char text[64];
+			snprintf(text, sizeof(text), "%g", value);
+			Put(text);
+			return;
+		}
+		long long hundredths = llround((double)value * 100);
+		if (hundredths < 0)
+		{
+			Put('-');
+			hundredths = -hundredths;
+		}
+		Integer(hundredths / 100);
+		int fraction = (int)(hundredths % 100);
+		if (fraction != 0)
+		{
+			Put('.');
+			Put((char)('0' + fraction / 10));
+			if (fraction % 10 != 0)
+				Put((char)('0' + fraction % 10));
+		}
+	}
+	void Integer(long long value)
+	{
+		char digits[24];
+		int n = 0;
+		if (value < 0)
+		{
+			Put('-');
+			value = -value;
+		}
+		do
+		{
+			digits[n++] = (char)('0' + value % 10);
+			value /= 10;
+		} while (value > 0);
+		while (n > 0)
+			Put(digits[--n]);
+	}
+	void Point(float x, float y)
+	{
+		Number(x);
+		Put(' ');
+		Number(y);
+	}
+	void Flush()
+	{
+		if (used_ > 0 && fwrite(buffer_, 1, used_, file_) != (size_t)used_)
+			ok_ = false;
+		used_ = 0;
+	}
+	bool Ok() const { return ok_; }
+private:
+	FILE* file_;
+	char buffer_[EXPORT_BUFFER_SIZE];
+	int used_;
+	bool ok_;
+};
+
+// color and paint of a merged path
+struct ExportStyle
+{
+	Color color;
+	bool filled;
+
+	bool operator!=(const ExportStyle& other) const
+	{
+		return filled != other.filled || color.r != other.color.r || color.g != other.color.g || color.b != other.color.b;
+	}
+};
+
+// path syntax of one file format
+class PathWriter
+{
+public:
+	PathWriter(ExportBuffer& out) : out_(out) {}
+	virtual ~PathWriter() {}
+	virtual void Begin(const Rect& bounds) = 0;
+	virtual void End() = 0;
+	virtual void BeginPath(const ExportStyle& style) = 0;
+	virtual void EndPath(const ExportStyle& style) = 0;
+	virtual void MoveTo(const Vector2& v) = 0;
+	virtual void LineTo(const Vector2& v) = 0;
+	virtual void Close() = 0;
+	virtual void Circle(const Vector2& center, float radius) = 0;
+protected:
+	ExportBuffer& out_;
+};
+
+class SvgWriter : public PathWriter
+{
+public:
+	SvgWriter(ExportBuffer& out) : PathWriter(out) {}
+	void Begin(const Rect& bounds)
+	{
+		float w = bounds.right - bounds.left;
+		float h = bounds.bottom - bounds.top;
+		out_.Put("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"");
+		out_.Number(w);
+		out_.Put("\" height=\"");
+		out_.Number(h);
+		out_.Put("\" viewBox=\"");
+		out_.Point(bounds.left, bounds.top);
+		out_.Put(' ');
+		out_.Point(w, h);
+		out_.Put("\">\n<rect x=\"");
+		out_.Number(bounds.left);
+		out_.Put("\" y=\"");
+		out_.Number(bounds.top);
+		out_.Put("\" width=\"");
+		out_.Number(w);
+		out_.Put("\" height=\"");
+		out_.Number(h);
+		out_.Put("\" fill=\"#000\"/>\n<g stroke-width=\"1\" stroke-linejoin=\"round\">\n");
+	}
+	void End() { out_.Put("</g>\n</svg>\n"); }
+	void BeginPath(const ExportStyle& style)
+	{
+		out_.Put(style.filled ? "<path fill=\"" : "<path fill=\"none\" stroke=\"");
+		Hex(style.color);
+		out_.Put("\" d=\"");
+	}
+	void EndPath(const ExportStyle&) { out_.Put("\"/>\n"); }
+	void MoveTo(const Vector2& v)
+	{
+		out_.Put('M');
+		out_.Point(v.x, v.y);
+	}
+	void LineTo(const Vector2& v)
+	{
+		out_.Put('L');
+		out_.Point(v.x, v.y);
+	}
+	void Close() { out_.Put('Z'); }
+	void Circle(const Vector2& center, float radius)
+	{
+		// two clockwise half arcs, like the polygons
+		Vector2 start = { center.x - radius, center.y };
+		MoveTo(start);
+		for (int i = 0; i < 2; i++)
+		{
+			out_.Put('A');
+			out_.Point(radius, radius);
+			out_.Put(" 0 0 1 ");
+			out_.Point(center.x + (i == 0 ? radius : -radius), center.y);
+		}
+		Close();
+	}
+private:
+	void Hex(const Color& color)
+	{
+		static const char digits[] = "0123456789abcdef";
+		float channels[3] = { color.r, color.g, color.b };
+		out_.Put('#');
+		for (int i = 0; i < 3; i++)
+		{
+			float c = channels[i] < 0 ? 0 : channels[i] > 1 ? 1 : channels[i];
+			int value = (int)(c * 255 + 0.5f);
+			out_.Put(digits[value >> 4]);
+			out_.Put(digits[value & 15]);
+		}
+	}
+};
+
+class PostScriptWriter : public PathWriter
+{
+public:
+	PostScriptWriter(ExportBuffer& out) : PathWriter(out) {}
+	void Begin(const Rect& bounds)
+	{
+		float w = bounds.right - bounds.left;
+		float h = bounds.bottom - bounds.top;
+		out_.Put("%!PS-Adobe-3.0\n%%BoundingBox: 0 0 ");
+		out_.Integer((long long)ceil(w));
+		out_.Put(' ');
+		out_.Integer((long long)ceil(h));
+		out_.Put("\n%%Pages: 1\n%%EndComments\n"
+			"/m {moveto} bind def /l {lineto} bind def /h {closepath} bind def\n"
+			"/c {0 360 arc closepath} bind def /s {stroke} bind def /f {fill} bind def /k {setrgbcolor} bind def\n"
+			"%%Page: 1 1\n");
+		// world y grows downward, the page y upward
+		out_.Put("0 ");
+		out_.Number(h);
+		out_.Put(" translate 1 -1 scale ");
+		out_.Point(-bounds.left, -bounds.top);
+		out_.Put(" translate 1 setlinewidth 1 setlinejoin\n0 0 0 k ");
+		out_.Point(bounds.left, bounds.top);
+		out_.Put(' ');
+		out_.Point(w, h);
+		out_.Put(" rectfill\n");
+	}
+	void End() { out_.Put("showpage\n%%EOF\n"); }
+	void BeginPath(const ExportStyle& style)
+	{
+		out_.Number(style.color.r);
+		out_.Put(' ');
+		out_.Number(style.color.g);
+		out_.Put(' ');
+		out_.Number(style.color.b);
+		out_.Put(" k newpath\n");
+	}
+	void EndPath(const ExportStyle& style) { out_.Put(style.filled ? "f\n" : "s\n"); }
+	void MoveTo(const Vector2& v)
+	{
+		out_.Point(v.x, v.y);
+		out_.Put(" m ");
+	}
+	void LineTo(const Vector2& v)
+	{
+		out_.Point(v.x, v.y);
+		out_.Put(" l ");
+	}
+	void Close() { out_.Put("h\n"); }
+	void Circle(const Vector2& center, float radius)
+	{
+		// arc turns from +x to +y, clockwise on the flipped page like the polygons
+		Vector2 start = { center.x + radius, center.y };
+		MoveTo(start);
+		out_.Point(center.x, center.y);
+		out_.Put(' ');
+		out_.Number(radius);
+		out_.Put(" c\n");
+	}
+};
+
+// closed polygon turning clockwise on screen, overlapping fills of one path then add up
+// under the nonzero rule instead of cutting holes in each other
+static void Polygon(PathWriter& writer, const Vector2* vertices, int n)
+{
+	float area = 0;
+	for (int i = 0, j = n - 1; i < n; j = i++)
+		area += vertices[j].x * vertices[i].y - vertices[i].x * vertices[j].y;
+	writer.MoveTo(vertices[0]);
+	for (int i = 1; i < n; i++)
+		writer.LineTo(vertices[area >= 0 ? i : n - i]);
+	writer.Close();
+}
+
+static void WriteShape(PathWriter& writer, const ShapeData& shape, const PointStyle& points)
+{
+	switch (shape.type)
+	{
+	case SHAPE_LINE:
+		writer.MoveTo(shape.vertices[0]);
+		writer.LineTo(shape.vertices[1]);
+		break;
+	case SHAPE_TRIANGLE: Polygon(writer, shape.vertices, 3); break;
+	case SHAPE_QUAD: Polygon(writer, shape.vertices, 4); break;
+	case SHAPE_CIRCLE: writer.Circle(shape.vertices[0], shape.radius); break;
+	case SHAPE_STROKE:
+		writer.MoveTo(shape.points[0]);
+		for (unsigned int i = 1; i < shape.point_count; i++)
+			writer.LineTo(shape.points[i]);
+		break;
+	default:
+	{
+		// a point covers what it covers on screen at scale 1, a one unit square by default
+		const Vector2& p = shape.vertices[0];
+		float half = points.size / 2;
+		if (points.shape == POINT_ROUND && points.size > 1)
+		{
+			writer.Circle(p, half);
+			break;
+		}
+		Vector2 square[4] = { { p.x - half, p.y - half }, { p.x + half, p.y - half }, { p.x + half, p.y + half }, { p.x - half, p.y + half } };
+		Polygon(writer, square, 4);
+		break;
+	}
+	}
+}
+
+// start another path when the style changes or the path is full
+static void NextShape(PathWriter& writer, const ExportStyle& shape_style, ExportStyle* style, int* path_shapes)
+{
+	if (*path_shapes == 0 || shape_style != *style || *path_shapes == EXPORT_MAX_PATH_SHAPES)
+	{
+		if (*path_shapes > 0)
+			writer.EndPath(*style);
+		writer.BeginPath(shape_style);
+		*style = shape_style;
+		*path_shapes = 0;
+	}
+	(*path_shapes)++;
+}
+
+// box of the painted pixels, false when nothing is painted
+static bool PaintBounds(const PaintLayer& paint, Rect* bounds)
+{
+	bool painted = false;
+	for (size_t t = 0; t < paint.TileCount(); t++)
+	{
+		const PaintTile& tile = paint.Tile(t);
+		for (int y = 0; y < PAINT_TILE_SIZE; y++)
+		{
+			const Pixel* row = tile.pixels + (size_t)y * PAINT_TILE_SIZE;
+			int left = 0;
+			while (left < PAINT_TILE_SIZE && (row[left] >> 24) == 0)
+				left++;
+			if (left == PAINT_TILE_SIZE) continue;
+			int right = PAINT_TILE_SIZE;
+			while ((row[right - 1] >> 24) == 0)
+				right--;
+			Rect run = { (float)tile.x * PAINT_TILE_SIZE + left, (float)tile.y * PAINT_TILE_SIZE + y,
+				(float)tile.x * PAINT_TILE_SIZE + right, (float)tile.y * PAINT_TILE_SIZE + y + 1 };
+			if (!painted)
+				*bounds = run;
+			bounds->left = min(bounds->left, run.left);
+			bounds->top = min(bounds->top, run.top);
+			bounds->right = max(bounds->right, run.right);
+			bounds->bottom = max(bounds->bottom, run.bottom);
+			painted = true;
+		}
+	}
+	return painted;
+}
+
+// paint over the shapes, each run of equal pixels of a row as a filled one unit high rectangle
+static void WritePaint(PathWriter& writer, const PaintLayer& paint, ExportStyle* style, int* path_shapes)
+{
+	for (size_t t = 0; t < paint.TileCount(); t++)
+	{
+		const PaintTile& tile = paint.Tile(t);
+		for (int y = 0; y < PAINT_TILE_SIZE; y++)
+		{
+			const Pixel* row = tile.pixels + (size_t)y * PAINT_TILE_SIZE;
+			for (int x = 0; x < PAINT_TILE_SIZE;)
+			{
+				int end = x + 1;
+				while (end < PAINT_TILE_SIZE && row[end] == row[x])
+					end++;
+				if ((row[x] >> 24) != 0)
+				{
+					ExportStyle run_style;
+					run_style.color = UnpackColor(row[x]);
+					run_style.filled = true;
+					NextShape(writer, run_style, style, path_shapes);
+					float left = (float)tile.x * PAINT_TILE_SIZE + x;
+					float right = (float)tile.x * PAINT_TILE_SIZE + end;
+					float top = (float)tile.y * PAINT_TILE_SIZE + y;
+					Vector2 rect[4] = { { left, top }, { right, top }, { right, top + 1 }, { left, top + 1 } };
+					Polygon(writer, rect, 4);
+				}
+				x = end;
+			}
+		}
+	}
+}
+
+static ExportStyle StyleOf(const ShapeData& shape)
+{
+	ExportStyle style;
+	style.color = shape.color;
+	// lines and strokes have no inside, points are drawn filled
+	style.filled = shape.type == SHAPE_POINT
+		|| (shape.type != SHAPE_LINE && shape.type != SHAPE_STROKE && (shape.flags & SHAPE_FILLED) != 0);
+	return style;
+}
+
+bool ExportScene(const Scene& scene, const char* path, ExportFormat format, const PaintLayer* paint)
+{
+	FILE* file = OpenFile(path, "wb");
+	if (file == NULL) return false;
+	ExportBuffer* out = new ExportBuffer(file); // too large for the stack
+	SvgWriter svg(*out);
+	PostScriptWriter postscript(*out);
+	PathWriter& writer = format == EXPORT_SVG ? (PathWriter&)svg : (PathWriter&)postscript;
+
+	Rect bounds = scene.Bounds();
+	if (scene.Count() == 0)
+	{
+		Rect empty = { 0, 0, 1, 1 };
+		bounds = empty;
+	}
+	Rect painted;
+	if (paint != NULL && PaintBounds(*paint, &painted))
+	{
+		if (scene.Count() == 0)
+			bounds = painted;
+		bounds.left = min(bounds.left, painted.left);
+		bounds.top = min(bounds.top, painted.top);
+		bounds.right = max(bounds.right, painted.right);
+		bounds.bottom = max(bounds.bottom, painted.bottom);
+	}
+	// room for the points and strokes on the border
+	float margin = max(scene.GetPointStyle().size / 2, 1.0f);
+	bounds.left = floorf(bounds.left - margin);
+	bounds.top = floorf(bounds.top - margin);
+	bounds.right = ceilf(bounds.right + margin);
+	bounds.bottom = ceilf(bounds.bottom + margin);
+	writer.Begin(bounds);
+
+	ExportStyle style;
+	int path_shapes = 0;
+	for (size_t z = 0; z < scene.Count(); z++)
+	{
+		if (scene.Deleted(z)) continue;
+		ShapeData shape = scene.Get(z);
+		NextShape(writer, StyleOf(shape), &style, &path_shapes);
+		WriteShape(writer, shape, scene.GetPointStyle());
+	}
+	if (paint != NULL)
+		WritePaint(writer, *paint, &style, &path_shapes);
+	if (path_shapes > 0)
+		writer.EndPath(style);
+	writer.End();
+
+	out->Flush();
+	bool ok = out->Ok();
+	delete out;
+	return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,22 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "Scene.h"
+#include "PaintLayer.h"
+
+const int EXPORT_BUFFER_SIZE = 1 << 16; // bytes collected before one write to the file
+const int EXPORT_MAX_PATH_SHAPES = 4096; // a merged path is split after this many shapes, readers choke on huge paths
+
+enum ExportFormat
+{
+	EXPORT_SVG,
+	EXPORT_POSTSCRIPT
+};
+
+// Stream the shapes still on the canvas to an SVG or PostScript file in z-order.
+// Memory use does not depend on the scene size, and a run of consecutive shapes with
+// the same color and fill mode is written as a single path. paint, when given, goes over
+// the shapes as one unit high rectangles, one per run of equal pixels of a row.
+bool ExportScene(const Scene& scene, const char* path, ExportFormat format, const PaintLayer* paint = NULL);
+
+#endif
@@ -0,0 +1,73 @@
+#include "Geometry.h"
+#include <vector>
+
+using namespace std;
+
+int CircleLodLevel(float screen_radius)
+{
+	int level = 0;
+	int sides = CIRCLE_MIN_SIDES;
+	while (level < CIRCLE_LOD_LEVELS - 1 && screen_radius * (1 - cosf(M_PI / sides)) > CIRCLE_MAX_CHORD_ERROR)
+	{
+		sides *= 2;
+		level++;
+	}
+	return level;
+}
+
+const Vector2* UnitCircle(int level, int* sides)
+{
+	static vector<Vector2> vertices[CIRCLE_LOD_LEVELS];
+	*sides = CIRCLE_MIN_SIDES << level;
+	if (vertices[level].empty())
+	{
+		vertices[level].resize(*sides + 1);
+		for (int i = 0; i <= *sides; i++)
+		{
+			vertices[level][i].x = cosf(2 * M_PI * (i % *sides) / *sides);
+			vertices[level][i].y = sinf(2 * M_PI * (i % *sides) / *sides);
+		}
+	}
+	return &vertices[level][0];
+}
+
+float SegmentDistance2(const Vector2& p, const Vector2& a, const Vector2& b)
+{
+	float dx = b.x - a.x;
+	float dy = b.y - a.y;
+	float length2 = dx * dx + dy * dy;
+	float t = 0;
+	if (length2 > 0)
+	{
+		t = ((p.x - a.x) * dx + (p.y - a.y) * dy) / length2;
+		if (t < 0) t = 0;
+		if (t > 1) t = 1;
+	}
+	float ex = a.x + t * dx - p.x;
+	float ey = a.y + t * dy - p.y;
+	return ex * ex + ey * ey;
+}
+
+bool PolygonEdgeHit(const Vector2* polygon, int n, const Vector2& p, float distance)
+{
+	float distance2 = distance * distance;
+	for (int i = 0, j = n - 1; i < n; j = i++)
+	{
+		if (SegmentDistance2(p, polygon[j], polygon[i]) <= distance2)
+			return true;
+	}
+	return false;
+}
+
+bool PolygonContains(const Vector2* polygon, int n, const Vector2& p)
+{
+	bool inside = false;
+	for (int i = 0, j = n - 1; i < n; j = i++)
+	{
+		const Vector2& a = polygon[i];
+		const Vector2& b = polygon[j];
+		if ((a.y > p.y) != (b.y > p.y) && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x)
+			inside = !inside;
+	}
+	return inside;
+}
@@ -0,0 +1,76 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+// constant
+const int CIRCLE_MIN_SIDES = 8; // sides of circle LOD level 0, each level doubles it
+const int CIRCLE_LOD_LEVELS = 8; // 8 to 1024 sides
+const float CIRCLE_MAX_CHORD_ERROR = 0.25f; // max distance in pixels between a circle and its sides
+
+struct Vector2
+{
+	float x;
+	float y;
+};
+struct Color {
+	Color() { r = 0; g = 0; b = 0; }
+	Color(float R, float G, float B)
+	{
+		r = R;
+		g = G;
+		b = B;
+	}
+	float r;
+	float g;
+	float b;
+};
+// axis aligned rectangle, y grows downward like window cordinate
+struct Rect
+{
+	float left;
+	float top;
+	float right;
+	float bottom;
+};
+inline bool RectIntersects(const Rect& a, const Rect& b)
+{
+	return a.left <= b.right && b.left <= a.right && a.top <= b.bottom && b.top <= a.bottom;
+}
+inline bool RectContains(const Rect& outer, const Rect& inner)
+{
+	return outer.left <= inner.left && outer.top <= inner.top && outer.right >= inner.right && outer.bottom >= inner.bottom;
+}
+// color in 4 bytes r, g, b, a in memory, alpha is 255
+inline unsigned int PackColor(const Color& color)
+{
+	float channels[3] = { color.r, color.g, color.b };
+	unsigned char bytes[4] = { 0, 0, 0, 255 };
+	for (int i = 0; i < 3; i++)
+	{
+		float c = channels[i] < 0 ? 0 : channels[i] > 1 ? 1 : channels[i];
+		bytes[i] = (unsigned char)(c * 255 + 0.5f);
+	}
+	return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (unsigned int)bytes[3] << 24;
+}
+inline Color UnpackColor(unsigned int packed)
+{
+	const float scale = 1.0f / 255;
+	return Color((packed & 0xff) * scale, (packed >> 8 & 0xff) * scale, (packed >> 16 & 0xff) * scale);
+}
+const Color white(1, 1, 1);
+const Color red(1, 0, 0);
+
+// Pick the fewest sides whose chord error stays in CIRCLE_MAX_CHORD_ERROR for a radius in screen pixels
+int CircleLodLevel(float screen_radius);
+// unit circle of a LOD level shared by every circle, vertex sides repeats vertex 0
+const Vector2* UnitCircle(int level, int* sides);
+// squared distance from p to the segment ab
+float SegmentDistance2(const Vector2& p, const Vector2& a, const Vector2& b);
+// true when p is within distance of an edge of the closed polygon
+bool PolygonEdgeHit(const Vector2* polygon, int n, const Vector2& p, float distance);
+// even-odd inside test, also right for concave quadrilaterals
+bool PolygonContains(const Vector2* polygon, int n, const Vector2& p);
+
+#endif
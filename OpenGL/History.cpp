@@ -0,0 +1,290 @@
+#include "History.h"
+#include "Journal.h"
+
+using namespace std;
+
+History::History(Scene& scene, size_t budget)
+	: scene_(scene)
+{
+	budget_ = budget;
+	journal_ = NULL;
+	paint_ = NULL;
+	memory_ = 0;
+	collapsed_ = 0;
+}
+
+History::~History()
+{
+	Reset();
+}
+
+void History::Added()
+{
+	Command command = Command();
+	command.kind = COMMAND_ADD;
+	command.z = scene_.Count() - 1;
+	command.shape = scene_.Get(command.z);
+	if (journal_ != NULL)
+		journal_->Added(command.shape);
+	command.points.assign(command.shape.points, command.shape.points + command.shape.point_count);
+	command.shape.points = NULL;
+	Push(command);
+}
+
+void History::Delete(size_t z)
+{
+	Command command = Command();
+	command.kind = COMMAND_DELETE;
+	command.z = z;
+	scene_.Delete(z);
+	if (journal_ != NULL)
+		journal_->Deleted(z);
+	Push(command);
+}
+
+bool History::Move(size_t z, float dx, float dy)
+{
+	Command command = Command();
+	command.kind = COMMAND_MOVE;
+	command.z = z;
+	command.offset.x = dx;
+	command.offset.y = dy;
+	if (!scene_.Move(z, dx, dy)) return false;
+	if (journal_ != NULL)
+		journal_->Moved(z, dx, dy);
+	Push(command);
+	return true;
+}
+
+void History::Recolor(size_t z, const Color& color)
+{
+	Command command = Command();
+	command.kind = COMMAND_RECOLOR;
+	command.z = z;
+	command.color = scene_.Get(z).color;
+	scene_.SetColor(z, color);
+	if (journal_ != NULL)
+		journal_->Recolored(z, color);
+	Push(command);
+}
+
+void History::Clear()
+{
+	Command command = Command();
+	command.kind = COMMAND_CLEAR;
+	command.cleared = new Scene();
+	command.cleared->SetCompact(scene_.Compact()); // the canvas keeps its storage mode
+	scene_.Swap(*command.cleared);
+	if (paint_ != NULL)
+	{
+		command.cleared_paint = new PaintLayer();
+		paint_->Swap(*command.cleared_paint);
+	}
+	if (journal_ != NULL)
+		journal_->Cleared();
+	Push(command);
+}
+
+void History::Painted()
+{
+	Command command = Command();
+	command.kind = COMMAND_PAINT;
+	paint_->EndEdit(&command.tiles);
+	if (command.tiles.empty()) return;
+	if (journal_ != NULL)
+		journal_->Painted(*paint_, command.tiles);
+	Push(command);
+}
+
+bool History::Undo()
+{
+	if (undo_.empty()) return false;
+	Command& command = undo_.back();
+	size_t memory = CommandMemory(command);
+	if (!Apply(command, true)) return false;
+	memory_ -= memory;
+	memory_ += CommandMemory(command);
+	redo_.push_back(command);
+	undo_.pop_back();
+	return true;
+}
+
+bool History::Redo()
+{
+	if (redo_.empty()) return false;
+	Command& command = redo_.back();
+	size_t memory = CommandMemory(command);
+	// the step stays to be redone when its shape does not fit in memory
+	if (!Apply(command, false)) return false;
+	memory_ -= memory;
+	memory_ += CommandMemory(command);
+	undo_.push_back(command);
+	redo_.pop_back();
+	Collapse();
+	return true;
+}
+
+void History::Reset()
+{
+	for (size_t i = 0; i < undo_.size(); i++)
+	{
+		Forget(undo_[i]);
+		Free(undo_[i]);
+	}
+	for (size_t i = 0; i < redo_.size(); i++)
+		Free(redo_[i]);
+	undo_.clear();
+	redo_.clear();
+	memory_ = 0;
+}
+
+void History::SetBudget(size_t bytes)
+{
+	budget_ = bytes;
+	Collapse();
+}
+
+// a new step makes the undone steps unreachable
+void History::Push(const Command& command)
+{
+	for (size_t i = 0; i < redo_.size(); i++)
+	{
+		memory_ -= CommandMemory(redo_[i]);
+		Free(redo_[i]);
+	}
+	redo_.clear();
+	undo_.push_back(command);
+	memory_ += CommandMemory(command);
+	Collapse();
+}
+
+// undo or redo a step, steps after it were undone already so its shape is where it was left.
+// false when a shape or a paint tile could not be added back for lack of memory or a shape moved
+// or restored where the index can not hold it, nothing changed then
+bool History::Apply(Command& command, bool undo)
+{
+	switch (command.kind)
+	{
+	case COMMAND_ADD:
+		if (undo)
+			scene_.PopBack();
+		else
+		{
+			if (!command.points.empty())
+				command.shape.points = &command.points[0];
+			bool added = scene_.Add(command.shape);
+			command.shape.points = NULL;
+			if (!added) return false;
+		}
+		break;
+	case COMMAND_DELETE:
+		if (undo && !scene_.Restore(command.z)) return false;
+		if (!undo)
+			scene_.Delete(command.z);
+		break;
+	case COMMAND_MOVE:
+		if (undo && !scene_.Move(command.z, -command.offset.x, -command.offset.y)) return false;
+		if (!undo && !scene_.Move(command.z, command.offset.x, command.offset.y)) return false;
+		break;
+	case COMMAND_RECOLOR:
+	{
+		// the kept color and the scene color trade places both ways
+		Color color = scene_.Get(command.z).color;
+		scene_.SetColor(command.z, command.color);
+		command.color = color;
+		break;
+	}
+	case COMMAND_CLEAR:
+		scene_.Swap(*command.cleared);
+		if (command.cleared_paint != NULL)
+			paint_->Swap(*command.cleared_paint);
+		break;
+	case COMMAND_PAINT:
+		if (!paint_->Exchange(&command.tiles)) return false;
+		break;
+	}
+	if (journal_ != NULL)
+		Record(command, undo);
+	return true;
+}
+
+// journal what Apply changed
+void History::Record(const Command& command, bool undo)
+{
+	switch (command.kind)
+	{
+	case COMMAND_ADD:
+		if (undo)
+			journal_->PoppedBack();
+		else
+			journal_->Added(scene_.Get(scene_.Count() - 1));
+		break;
+	case COMMAND_DELETE:
+		if (undo)
+			journal_->Restored(command.z);
+		else
+			journal_->Deleted(command.z);
+		break;
+	case COMMAND_MOVE:
+		if (undo)
+			journal_->Moved(command.z, -command.offset.x, -command.offset.y);
+		else
+			journal_->Moved(command.z, command.offset.x, command.offset.y);
+		break;
+	case COMMAND_RECOLOR:
+		journal_->Recolored(command.z, scene_.Get(command.z).color);
+		break;
+	case COMMAND_CLEAR:
+		if (undo)
+			journal_->Uncleared();
+		else
+			journal_->Cleared();
+		break;
+	case COMMAND_PAINT:
+		journal_->Painted(*paint_, command.tiles);
+		break;
+	}
+}
+
+size_t History::CommandMemory(const Command& command) const
+{
+	size_t memory = sizeof(Command) + command.points.capacity() * sizeof(Vector2);
+	if (command.cleared != NULL)
+		memory += sizeof(Scene) + command.cleared->MemoryUsage();
+	if (command.cleared_paint != NULL)
+		memory += sizeof(PaintLayer) + command.cleared_paint->MemoryUsage();
+	memory += command.tiles.capacity() * sizeof(PaintTileCopy);
+	for (size_t i = 0; i < command.tiles.size(); i++)
+		if (command.tiles[i].pixels != NULL)
+			memory += PAINT_TILE_BYTES;
+	return memory;
+}
+
+void History::Free(Command& command)
+{
+	delete command.cleared;
+	command.cleared = NULL;
+	delete command.cleared_paint;
+	command.cleared_paint = NULL;
+	PaintLayer::FreeCopies(&command.tiles);
+}
+
+// a step that can no longer be undone, the journal drops the shapes it keeps for a clear
+void History::Forget(const Command& command)
+{
+	if (command.kind == COMMAND_CLEAR && journal_ != NULL)
+		journal_->ClearForgotten();
+}
+
+// drop the oldest steps until the history fits the budget, the last step is always kept
+void History::Collapse()
+{
+	while (memory_ > budget_ && undo_.size() > 1)
+	{
+		memory_ -= CommandMemory(undo_.front());
+		Forget(undo_.front());
+		Free(undo_.front());
+		undo_.pop_front();
+		collapsed_++;
+	}
+}
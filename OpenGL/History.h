@@ -0,0 +1,92 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "Scene.h"
+#include "PaintLayer.h"
+#include <deque>
+#include <vector>
+#include <cstddef>
+
+class Journal;
+
+const size_t HISTORY_DEFAULT_BUDGET = 64 << 20; // bytes kept for undo before old steps are dropped
+
+enum CommandKind
+{
+	COMMAND_ADD,
+	COMMAND_DELETE,
+	COMMAND_MOVE,
+	COMMAND_RECOLOR,
+	COMMAND_CLEAR,
+	COMMAND_PAINT
+};
+// One undoable step. Only what the step changed is kept, a clear keeps the cleared
+// shapes by swapping them into a scene of its own instead of copying them.
+// Paint keeps only the tiles a stroke changed.
+struct Command
+{
+	unsigned char kind;
+	size_t z; // shape of a delete, move or recolor
+	ShapeData shape; // shape of an add, so it can be added again on redo
+	std::vector<Vector2> points; // points of an added stroke, the scene drops its own on undo
+	Vector2 offset; // translation of a move
+	Color color; // recolor: the color before, after an undo the color after
+	Scene* cleared; // clear: shapes before the clear, owned by the command
+	PaintLayer* cleared_paint; // clear: paint before the clear, owned by the command
+	std::vector<PaintTileCopy> tiles; // paint: the tiles before, after an undo the tiles after
+};
+
+// Undo and redo stacks of a scene. Every edit of the scene goes through here.
+// When the steps take more memory than the budget the oldest ones are collapsed,
+// they are applied for good and can no longer be undone.
+class History
+{
+public:
+	History(Scene& scene, size_t budget = HISTORY_DEFAULT_BUDGET);
+	~History();
+	void Added(); // record the shape just added on top of the scene
+	void Delete(size_t z);
+	bool Move(size_t z, float dx, float dy); // false when the scene refused the move, nothing is recorded
+	void Recolor(size_t z, const Color& color);
+	void Clear(); // O(1), and so is its undo
+	// record the paint since PaintLayer::BeginEdit, undo trades the changed tiles back. O(tiles changed)
+	void Painted();
+	// false too when the step can not be applied, e.g. its shape does not fit in memory, it stays
+	// to be undone or redone then
+	bool Undo();
+	bool Redo();
+	void Reset(); // forget every step, e.g. after the scene was released
+	void SetBudget(size_t bytes);
+	// journal every change of the scene made here, undo and redo included. NULL for none
+	void SetJournal(Journal* journal) { journal_ = journal; }
+	// the paint layer over the scene, cleared along with it and journaled by the tiles changed
+	void SetPaintLayer(PaintLayer* paint) { paint_ = paint; }
+
+	size_t UndoCount() const { return undo_.size(); }
+	size_t RedoCount() const { return redo_.size(); }
+	size_t CollapsedCount() const { return collapsed_; }
+	size_t Budget() const { return budget_; }
+	size_t MemoryUsage() const { return memory_; }
+private:
+	History(const History&);
+	History& operator=(const History&);
+
+	void Push(const Command& command);
+	bool Apply(Command& command, bool undo);
+	void Record(const Command& command, bool undo);
+	size_t CommandMemory(const Command& command) const;
+	void Free(Command& command);
+	void Forget(const Command& command);
+	void Collapse();
+
+	Scene& scene_;
+	Journal* journal_;
+	PaintLayer* paint_;
+	std::deque<Command> undo_;
+	std::vector<Command> redo_;
+	size_t budget_;
+	size_t memory_; // of both stacks
+	size_t collapsed_;
+};
+
+#endif
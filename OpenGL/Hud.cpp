@@ -0,0 +1,136 @@
+#include "Hud.h"
+#include <cstdio>
+#include <FL/gl.h>
+
+using namespace std;
+
+const double HUD_REFRESH_SECONDS = 0.25;
+
+static double Milliseconds(chrono::steady_clock::time_point from, chrono::steady_clock::time_point to)
+{
+	return chrono::duration<double, milli>(to - from).count();
+}
+
+Hud::Hud()
+{
+	draw_ms_ = 0;
+	SetVisible(false);
+}
+
+void Hud::SetVisible(bool visible)
+{
+	visible_ = visible;
+	// start counting afresh, the frames while hidden were not measured
+	refreshed_ = Clock::now();
+	frames_ = 0;
+	frame_total_ms_ = 0;
+	frame_max_ms_ = 0;
+	fit_total_ms_ = 0;
+	draw_total_ms_ = 0;
+	present_total_ms_ = 0;
+	sprintf_s(text_, sizeof(text_), "measuring...");
+}
+
+void Hud::BeginFrame()
+{
+	if (!visible_) return;
+	frame_.Clear();
+	draw_ms_ = 0;
+	frame_start_ = Clock::now();
+}
+
+void Hud::BeginDraw()
+{
+	if (!visible_) return;
+	draw_start_ = Clock::now();
+}
+
+void Hud::EndDraw()
+{
+	if (!visible_) return;
+	draw_ms_ = Milliseconds(draw_start_, Clock::now());
+}
+
+void Hud::EndFrame(const Scene& scene, const History& history)
+{
+	if (!visible_) return;
+	Clock::time_point now = Clock::now();
+	double frame_ms = Milliseconds(frame_start_, now);
+	frames_++;
+	frame_total_ms_ += frame_ms;
+	frame_max_ms_ = max(frame_max_ms_, frame_ms);
+	fit_total_ms_ += frame_.fit_ms;
+	draw_total_ms_ += draw_ms_ - frame_.fit_ms;
+	present_total_ms_ += frame_ms - draw_ms_;
+	double seconds = Milliseconds(refreshed_, now) / 1000;
+	if (seconds >= HUD_REFRESH_SECONDS)
+	{
+		Refresh(seconds, scene, history);
+		refreshed_ = now;
+		frames_ = 0;
+		frame_total_ms_ = 0;
+		frame_max_ms_ = 0;
+		fit_total_ms_ = 0;
+		draw_total_ms_ = 0;
+		present_total_ms_ = 0;
+	}
+}
+
+void Hud::Refresh(double seconds, const Scene& scene, const History& history)
+{
+	double frames = frames_ > 0 ? frames_ : 1;
+	// memory is only summed here, the index size takes a walk over its nodes
+	double scene_mb = scene.MemoryUsage() / 1048576.0;
+	double history_mb = history.MemoryUsage() / 1048576.0;
+	sprintf_s(text_, sizeof(text_),
+		"%.1f fps, frame %.2f ms avg %.2f max\n"
+		"fit %.2f  draw %.2f  present %.2f ms\n"
+		"%zu shapes, %zu vertices\n"
+		"%d draw calls, %d state changes\n"
+		"scene %.1f MB, history %.1f MB",
+		frames_ / seconds, frame_total_ms_ / frames, frame_max_ms_,
+		fit_total_ms_ / frames, draw_total_ms_ / frames, present_total_ms_ / frames,
+		scene.Count(), frame_.vertices,
+		frame_.draw_calls, frame_.state_changes,
+		scene_mb, history_mb);
+}
+
+void Hud::Draw(int w, int h)
+{
+	if (!visible_) return;
+	// pixel coordinates from the bottom left corner
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0, w, 0, h, -1, 1);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	gl_font(FL_COURIER, 12);
+	int line_height = gl_height();
+	int lines = 1;
+	for (const char* c = text_; *c != '\0'; c++)
+		if (*c == '\n') lines++;
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glColor4f(0, 0, 0, 0.6f);
+	glRectf(4, (float)(h - 8 - lines * line_height), 300, (float)(h - 4));
+	glDisable(GL_BLEND);
+
+	glColor3f(0, 1, 0);
+	const char* line = text_;
+	for (int i = 0; i < lines; i++)
+	{
+		const char* end = line;
+		while (*end != '\0' && *end != '\n') end++;
+		gl_draw(line, (int)(end - line), 8.0f, (float)(h - 6 - (i + 1) * line_height + gl_descent()));
+		line = *end == '\n' ? end + 1 : end;
+	}
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+}
@@ -0,0 +1,49 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <chrono>
+#include "Renderer.h"
+#include "History.h"
+
+// Performance overlay of a window: fps, the CPU time of a frame split into fit (packing
+// vertices for the view), draw and present (the buffer swap), shape and vertex counts, GL
+// draw calls and state changes of a frame and the memory of the scene and history.
+// The numbers are refreshed a few times a second from the frames in between.
+// Nothing is timed or counted while it is hidden.
+class Hud
+{
+public:
+	Hud();
+	void SetVisible(bool visible);
+	bool Visible() const { return visible_; }
+	// counters of the frame being drawn, NULL while hidden so the renderers count nothing
+	RenderStats* Stats() { return visible_ ? &frame_ : NULL; }
+	// around a whole frame, drawing and swapping the buffers
+	void BeginFrame();
+	void EndFrame(const Scene& scene, const History& history);
+	// around drawing the frame
+	void BeginDraw();
+	void EndDraw();
+	// text of the last refresh in the top left corner of a w x h window
+	void Draw(int w, int h);
+private:
+	typedef std::chrono::steady_clock Clock;
+	void Refresh(double seconds, const Scene& scene, const History& history);
+
+	bool visible_;
+	RenderStats frame_;
+	Clock::time_point frame_start_;
+	Clock::time_point draw_start_;
+	double draw_ms_; // of the frame being drawn
+	// sums since the last refresh
+	Clock::time_point refreshed_;
+	int frames_;
+	double frame_total_ms_;
+	double frame_max_ms_;
+	double fit_total_ms_;
+	double draw_total_ms_;
+	double present_total_ms_;
+	char text_[512];
+};
+
+#endif
@@ -0,0 +1,1036 @@
+#include "Import.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+using namespace std;
+
+const double IMPORT_ARC_SNAP = 0.02; // radius a half arc may exceed half its chord by, numbers are often rounded to two decimals
+static const Color default_color(1, 1, 1);
+
+// shapes parsed from one chunk of the file, stroke points refer into points once the chunk is parsed
+struct ImportChunk
+{
+	const char* begin; // first tag of the chunk
+	const char* end; // the tags starting before end belong to the chunk
+	const char* stop; // where the tags after the chunk start, as found by parsing it
+	vector<ShapeData> shapes;
+	vector<Vector2> points;
+	vector<size_t> stroke_points; // first point of each stroke in points, in order
+	bool svg; // an svg element was seen
+	bool done;
+};
+
+// the chunks and the workers taking them in order
+struct ImportJob
+{
+	vector<ImportChunk> chunks;
+	const char* limit;
+	mutex lock;
+	condition_variable ready; // a chunk was parsed or added
+	size_t next; // chunk taken next by a worker
+	size_t added; // chunks added to the scene
+	size_t ahead; // chunks taken ahead of the scene at most
+};
+
+// piece of the file, not terminated
+struct Text
+{
+	const char* begin;
+	const char* end;
+};
+
+enum SvgElement
+{
+	ELEMENT_SVG,
+	ELEMENT_LINE,
+	ELEMENT_POLYLINE,
+	ELEMENT_POLYGON,
+	ELEMENT_RECT,
+	ELEMENT_CIRCLE,
+	ELEMENT_PATH,
+	ELEMENT_COUNT
+};
+static const char* const element_names[ELEMENT_COUNT] = { "svg", "line", "polyline", "polygon", "rect", "circle", "path" };
+
+enum SvgAttribute
+{
+	ATTRIBUTE_X1,
+	ATTRIBUTE_Y1,
+	ATTRIBUTE_X2,
+	ATTRIBUTE_Y2,
+	ATTRIBUTE_X,
+	ATTRIBUTE_Y,
+	ATTRIBUTE_WIDTH,
+	ATTRIBUTE_HEIGHT,
+	ATTRIBUTE_CX,
+	ATTRIBUTE_CY,
+	ATTRIBUTE_R,
+	ATTRIBUTE_POINTS,
+	ATTRIBUTE_D,
+	ATTRIBUTE_FILL,
+	ATTRIBUTE_STROKE,
+	ATTRIBUTE_STYLE,
+	ATTRIBUTE_COUNT
+};
+static const char* const attribute_names[ATTRIBUTE_COUNT] = {
+	"x1", "y1", "x2", "y2", "x", "y", "width", "height", "cx", "cy", "r", "points", "d", "fill", "stroke", "style"
+};
+
+enum PaintKind
+{
+	PAINT_UNSET,
+	PAINT_NONE,
+	PAINT_COLOR
+};
+struct SvgPaint
+{
+	PaintKind kind;
+	Color color;
+};
+struct NamedColor
+{
+	const char* name;
+	unsigned char r;
+	unsigned char g;
+	unsigned char b;
+};
+static const NamedColor named_colors[] = {
+	{ "black", 0, 0, 0 }, { "white", 255, 255, 255 }, { "red", 255, 0, 0 }, { "lime", 0, 255, 0 },
+	{ "green", 0, 128, 0 }, { "blue", 0, 0, 255 }, { "yellow", 255, 255, 0 }, { "cyan", 0, 255, 255 },
+	{ "aqua", 0, 255, 255 }, { "magenta", 255, 0, 255 }, { "fuchsia", 255, 0, 255 }, { "gray", 128, 128, 128 },
+	{ "grey", 128, 128, 128 }, { "silver", 192, 192, 192 }, { "maroon", 128, 0, 0 }, { "navy", 0, 0, 128 },
+	{ "olive", 128, 128, 0 }, { "purple", 128, 0, 128 }, { "teal", 0, 128, 128 }, { "orange", 255, 165, 0 }
+};
+
+// a coordinate out of the range of a float is not a number, the shape it ends up in is dropped
+static float Coordinate(double value)
+{
+	return fabs(value) <= FLT_MAX ? (float)value : NAN;
+}
+
+static Vector2 Point(double x, double y)
+{
+	Vector2 v = { Coordinate(x), Coordinate(y) };
+	return v;
+}
+
+// every vertex fits in a float, what the scene can hold
+static bool Finite(const Vector2* v, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		if (!(fabsf(v[i].x) <= FLT_MAX && fabsf(v[i].y) <= FLT_MAX)) return false;
+	return true;
+}
+
+static bool Space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static const char* SkipSpace(const char* p, const char* end)
+{
+	while (p < end && Space(*p)) p++;
+	return p;
+}
+
+static const char* SkipSeparators(const char* p, const char* end)
+{
+	while (p < end && (Space(*p) || *p == ',')) p++;
+	return p;
+}
+
+static Text Trim(Text text)
+{
+	text.begin = SkipSpace(text.begin, text.end);
+	while (text.end > text.begin && Space(text.end[-1])) text.end--;
+	return text;
+}
+
+// text equals name, letters in any case
+static bool Is(const Text& text, const char* name)
+{
+	size_t n = strlen(name);
+	if ((size_t)(text.end - text.begin) != n) return false;
+	for (size_t i = 0; i < n; i++)
+		if (tolower((unsigned char)text.begin[i]) != name[i]) return false;
+	return true;
+}
+
+static bool StartsWith(const char* p, const char* end, const char* prefix)
+{
+	size_t n = strlen(prefix);
+	return (size_t)(end - p) >= n && memcmp(p, prefix, n) == 0;
+}
+
+// just past the first match of text from p on, end when there is none
+static const char* Skip(const char* p, const char* end, const char* text)
+{
+	size_t n = strlen(text);
+	while ((p = (const char*)memchr(p, text[0], end - p)) != NULL)
+	{
+		if ((size_t)(end - p) >= n && memcmp(p, text, n) == 0) return p + n;
+		p++;
+	}
+	return end;
+}
+
+// a number of the SVG grammar after optional separators, NULL when there is none or it is not finite
+static const char* Number(const char* p, const char* end, float* value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	p = SkipSeparators(p, end);
+	bool negative = false;
+	if (p < end && (*p == '+' || *p == '-'))
+		negative = *p++ == '-';
+	double mantissa = 0;
+	int exponent = 0;
+	bool digits = false;
+	for (; p < end && *p >= '0' && *p <= '9'; p++, digits = true)
+		mantissa = mantissa * 10 + (*p - '0');
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits = true, exponent--)
+			mantissa = mantissa * 10 + (*p - '0');
+	}
+	if (!digits) return NULL;
+	// an exponent needs digits, "1em" is a number and a unit
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* q = p + 1;
+		bool negative_exponent = false;
+		if (q < end && (*q == '+' || *q == '-'))
+			negative_exponent = *q++ == '-';
+		if (q < end && *q >= '0' && *q <= '9')
+		{
+			int e = 0;
+			for (; q < end && *q >= '0' && *q <= '9'; q++)
+				e = min(e * 10 + (*q - '0'), 1000);
+			exponent += negative_exponent ? -e : e;
+			p = q;
+		}
+	}
+	double result = mantissa;
+	if (exponent < 0)
+		result /= -exponent <= 22 ? powers[-exponent] : pow(10.0, -exponent);
+	else if (exponent > 0)
+		result *= exponent <= 22 ? powers[exponent] : pow(10.0, exponent);
+	if (!(result <= FLT_MAX)) return NULL;
+	*value = (float)(negative ? -result : result);
+	return p;
+}
+
+// a flag of an arc, which needs no separator after it
+static const char* Flag(const char* p, const char* end, float* value)
+{
+	p = SkipSeparators(p, end);
+	if (p == end || (*p != '0' && *p != '1')) return NULL;
+	*value = (float)(*p - '0');
+	return p + 1;
+}
+
+static int HexDigit(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static SvgPaint Paint(Text value)
+{
+	SvgPaint paint;
+	paint.kind = PAINT_UNSET;
+	value = Trim(value);
+	if (value.begin == value.end) return paint;
+	if (Is(value, "none"))
+	{
+		paint.kind = PAINT_NONE;
+		return paint;
+	}
+	float channels[3];
+	if (*value.begin == '#')
+	{
+		int digits[6];
+		int n = 0;
+		for (const char* p = value.begin + 1; p < value.end && n < 6 && HexDigit(*p) >= 0; p++)
+			digits[n++] = HexDigit(*p);
+		if (n != 3 && n != 6) return paint;
+		for (int i = 0; i < 3; i++)
+			channels[i] = n == 3 ? digits[i] * 17 / 255.0f : (digits[i * 2] * 16 + digits[i * 2 + 1]) / 255.0f;
+	}
+	else if (value.end - value.begin > 4 && Is(Text{ value.begin, value.begin + 4 }, "rgb("))
+	{
+		const char* p = value.begin + 4;
+		for (int i = 0; i < 3; i++)
+		{
+			if ((p = Number(p, value.end, &channels[i])) == NULL) return paint;
+			bool percent = p < value.end && *p == '%';
+			if (percent) p++;
+			channels[i] = max(0.0f, min(1.0f, channels[i] / (percent ? 100 : 255)));
+		}
+	}
+	else
+	{
+		size_t i = 0;
+		size_t count = sizeof(named_colors) / sizeof(named_colors[0]);
+		while (i < count && !Is(value, named_colors[i].name)) i++;
+		if (i == count) return paint; // gradients and currentColor too
+		channels[0] = named_colors[i].r / 255.0f;
+		channels[1] = named_colors[i].g / 255.0f;
+		channels[2] = named_colors[i].b / 255.0f;
+	}
+	paint.kind = PAINT_COLOR;
+	paint.color = Color(channels[0], channels[1], channels[2]);
+	return paint;
+}
+
+// a simple convex polygon: every corner turns the same way and the turns add up to one round
+static bool Convex(const Vector2* v, size_t n)
+{
+	int sign = 0;
+	double turned = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		const Vector2& a = v[(i + n - 1) % n];
+		const Vector2& b = v[i];
+		const Vector2& c = v[(i + 1) % n];
+		double x1 = b.x - a.x, y1 = b.y - a.y, x2 = c.x - b.x, y2 = c.y - b.y;
+		double cross = x1 * y2 - y1 * x2;
+		if (cross != 0)
+		{
+			int turn = cross > 0 ? 1 : -1;
+			if (sign != 0 && turn != sign) return false;
+			sign = turn;
+		}
+		turned += atan2(cross, x1 * x2 + y1 * y2);
+	}
+	return sign != 0 && fabs(fabs(turned) - 2 * M_PI) < 0.01;
+}
+
+// positive when a, b, c turn clockwise on screen
+static double Turn(const Vector2& a, const Vector2& b, const Vector2& c)
+{
+	return ((double)b.x - a.x) * ((double)c.y - b.y) - ((double)b.y - a.y) * ((double)c.x - b.x);
+}
+
+// line segments for a curve that strays deviation / n^2 from n of them
+static int Segments(double deviation)
+{
+	double n = ceil(sqrt(deviation / IMPORT_FLATNESS));
+	if (!(n < IMPORT_MAX_SEGMENTS)) return IMPORT_MAX_SEGMENTS;
+	return max((int)n, 1);
+}
+
+// Parses the tags of a chunk and turns its elements into shapes. A path is drawn into subpath_
+// one subpath at a time, each becomes shapes of its own when it ends.
+class SvgParser
+{
+public:
+	SvgParser(ImportChunk& chunk, const char* limit) : chunk_(chunk), limit_(limit)
+	{
+		filled_ = false;
+		circle_ = true;
+		arcs_ = 0;
+		sweep_ = 0;
+		circle_radius_ = 0;
+	}
+	// parse the tags starting in [from, chunk.end)
+	void Parse(const char* from);
+private:
+	const char* Tag(const char* p);
+	void Element(int element, const Text* attributes);
+	float Attribute(const Text* attributes, int attribute) const;
+	void Declarations(const Text& style);
+	bool Style(bool can_fill);
+
+	void Path(const Text& d);
+	void MoveTo(const Vector2& v);
+	void LineTo(const Vector2& v);
+	void Add(const Vector2& v);
+	void Cubic(const Vector2& c1, const Vector2& c2, const Vector2& to);
+	void Quadratic(const Vector2& c, const Vector2& to);
+	void Arc(float rx, float ry, float rotation, bool large, bool sweep, const Vector2& to);
+	void Close();
+	void EndSubpath(bool closed);
+
+	void Polygon(const Vector2* v, size_t n, bool closed);
+	bool Triangulate(const Vector2* v, size_t n);
+	void Outline(const Vector2* v, size_t n, bool closed);
+	void Circle(const Vector2& center, float radius);
+	void Shape(unsigned char type, const Vector2* v, int n);
+
+	ImportChunk& chunk_;
+	const char* limit_;
+	// paint of the element
+	SvgPaint fill_;
+	SvgPaint stroke_;
+	Color color_;
+	bool filled_;
+	// subpath being drawn
+	vector<Vector2> subpath_;
+	Vector2 current_;
+	Vector2 start_;
+	bool circle_; // all segments so far are arcs of one circle
+	int arcs_;
+	double sweep_;
+	Vector2 circle_center_;
+	float circle_radius_;
+	// scratch of Triangulate
+	vector<size_t> corners_;
+	vector<size_t> triangles_;
+};
+
+void SvgParser::Parse(const char* from)
+{
+	chunk_.shapes.clear();
+	chunk_.points.clear();
+	chunk_.stroke_points.clear();
+	chunk_.svg = false;
+	const char* p = from;
+	for (;;)
+	{
+		p = (const char*)memchr(p, '<', limit_ - p);
+		if (p == NULL)
+		{
+			p = limit_;
+			break;
+		}
+		if (p >= chunk_.end) break;
+		p = Tag(p);
+	}
+	chunk_.stop = p;
+	// the points do not move any more
+	size_t stroke = 0;
+	for (size_t i = 0; i < chunk_.shapes.size(); i++)
+		if (chunk_.shapes[i].type == SHAPE_STROKE)
+			chunk_.shapes[i].points = &chunk_.points[chunk_.stroke_points[stroke++]];
+}
+
+// the tag at p, returns where it ends
+const char* SvgParser::Tag(const char* p)
+{
+	const char* q = p + 1;
+	if (StartsWith(q, limit_, "!--")) return Skip(q + 3, limit_, "-->");
+	if (StartsWith(q, limit_, "![CDATA[")) return Skip(q + 8, limit_, "]]>");
+	if (StartsWith(q, limit_, "?")) return Skip(q + 1, limit_, "?>");
+	if (q < limit_ && (*q == '!' || *q == '/')) return Skip(q, limit_, ">");
+
+	Text name = { q, q };
+	while (q < limit_ && !Space(*q) && *q != '>' && *q != '/')
+	{
+		if (*q == ':') name.begin = q + 1; // namespace prefix
+		q++;
+	}
+	name.end = q;
+	int element = 0;
+	while (element < ELEMENT_COUNT && !Is(name, element_names[element])) element++;
+
+	Text attributes[ATTRIBUTE_COUNT] = {};
+	for (;;)
+	{
+		q = SkipSpace(q, limit_);
+		if (q == limit_) return limit_;
+		if (*q == '>') break;
+		if (*q == '/')
+		{
+			q++;
+			continue;
+		}
+		Text attribute = { q, q };
+		while (q < limit_ && !Space(*q) && *q != '=' && *q != '>' && *q != '/') q++;
+		attribute.end = q;
+		Text value = { q, q };
+		q = SkipSpace(q, limit_);
+		if (q < limit_ && *q == '=')
+		{
+			q = SkipSpace(q + 1, limit_);
+			if (q < limit_ && (*q == '"' || *q == '\''))
+			{
+				// '>' may appear in quotes
+				const char* close = (const char*)memchr(q + 1, *q, limit_ - q - 1);
+				if (close == NULL) return limit_;
+				value.begin = q + 1;
+				value.end = close;
+				q = close + 1;
+			}
+			else
+			{
+				value.begin = q;
+				while (q < limit_ && !Space(*q) && *q != '>') q++;
+				value.end = q;
+			}
+		}
+		if (element == ELEMENT_COUNT) continue;
+		for (int i = 0; i < ATTRIBUTE_COUNT; i++)
+			if (Is(attribute, attribute_names[i]))
+				attributes[i] = value;
+	}
+	if (element < ELEMENT_COUNT)
+		Element(element, attributes);
+	return q + 1;
+}
+
+void SvgParser::Element(int element, const Text* attributes)
+{
+	if (element == ELEMENT_SVG)
+	{
+		chunk_.svg = true;
+		return;
+	}
+	fill_ = Paint(attributes[ATTRIBUTE_FILL]);
+	stroke_ = Paint(attributes[ATTRIBUTE_STROKE]);
+	Declarations(attributes[ATTRIBUTE_STYLE]);
+	if (!Style(element != ELEMENT_LINE && element != ELEMENT_POLYLINE)) return;
+
+	switch (element)
+	{
+	case ELEMENT_LINE:
+	{
+		Vector2 v[2] = {
+			Point(Attribute(attributes, ATTRIBUTE_X1), Attribute(attributes, ATTRIBUTE_Y1)),
+			Point(Attribute(attributes, ATTRIBUTE_X2), Attribute(attributes, ATTRIBUTE_Y2))
+		};
+		Outline(v, 2, false);
+		break;
+	}
+	case ELEMENT_POLYLINE:
+	case ELEMENT_POLYGON:
+	{
+		const Text& points = attributes[ATTRIBUTE_POINTS];
+		const char* p = points.begin;
+		float x, y;
+		subpath_.clear();
+		while ((p = Number(p, points.end, &x)) != NULL && (p = Number(p, points.end, &y)) != NULL)
+			subpath_.push_back(Point(x, y));
+		if (!subpath_.empty())
+			Polygon(&subpath_[0], subpath_.size(), element == ELEMENT_POLYGON);
+		subpath_.clear();
+		break;
+	}
+	case ELEMENT_RECT:
+	{
+		float x = Attribute(attributes, ATTRIBUTE_X);
+		float y = Attribute(attributes, ATTRIBUTE_Y);
+		float w = Attribute(attributes, ATTRIBUTE_WIDTH);
+		float h = Attribute(attributes, ATTRIBUTE_HEIGHT);
+		if (!(w > 0 && h > 0)) break;
+		double right = (double)x + w, bottom = (double)y + h;
+		Vector2 v[4] = { Point(x, y), Point(right, y), Point(right, bottom), Point(x, bottom) };
+		Polygon(v, 4, true);
+		break;
+	}
+	case ELEMENT_CIRCLE:
+	{
+		float r = Attribute(attributes, ATTRIBUTE_R);
+		if (r > 0)
+			Circle(Point(Attribute(attributes, ATTRIBUTE_CX), Attribute(attributes, ATTRIBUTE_CY)), r);
+		break;
+	}
+	case ELEMENT_PATH:
+		Path(attributes[ATTRIBUTE_D]);
+		break;
+	}
+}
+
+// value of a length or coordinate, units are ignored and a missing one is 0
+float SvgParser::Attribute(const Text* attributes, int attribute) const
+{
+	float value;
+	if (Number(attributes[attribute].begin, attributes[attribute].end, &value) == NULL) return 0;
+	return value;
+}
+
+// fill and stroke of a style attribute, they win over the presentation attributes
+void SvgParser::Declarations(const Text& style)
+{
+	const char* p = style.begin;
+	while (p < style.end)
+	{
+		const char* colon = (const char*)memchr(p, ':', style.end - p);
+		if (colon == NULL) break;
+		const char* semicolon = (const char*)memchr(colon, ';', style.end - colon);
+		if (semicolon == NULL) semicolon = style.end;
+		Text name = { p, colon };
+		Text value = { colon + 1, semicolon };
+		name = Trim(name);
+		if (Is(name, "fill"))
+			fill_ = Paint(value);
+		else if (Is(name, "stroke"))
+			stroke_ = Paint(value);
+		p = semicolon + 1;
+	}
+}
+
+// how the element is drawn: filled with its fill color or outlined with its stroke color,
+// paint it does not set is white. false when it is not drawn at all
+bool SvgParser::Style(bool can_fill)
+{
+	if (can_fill && fill_.kind == PAINT_COLOR)
+	{
+		color_ = fill_.color;
+		filled_ = true;
+		return true;
+	}
+	filled_ = false;
+	if (stroke_.kind == PAINT_COLOR)
+	{
+		color_ = stroke_.color;
+		return true;
+	}
+	color_ = default_color;
+	if (can_fill && fill_.kind == PAINT_UNSET)
+	{
+		filled_ = true;
+		return true;
+	}
+	return stroke_.kind == PAINT_UNSET;
+}
+
+void SvgParser::Path(const Text& d)
+{
+	const Vector2 origin = { 0, 0 };
+	const char* p = d.begin;
+	char command = 0;
+	char previous = 0; // last segment, its control point is reflected by S and T
+	Vector2 control = origin;
+	current_ = origin;
+	start_ = origin;
+	subpath_.clear();
+	EndSubpath(false);
+	for (;;)
+	{
+		p = SkipSeparators(p, d.end);
+		if (p == d.end) break;
+		if (isalpha((unsigned char)*p))
+		{
+			if (command == 0 && *p != 'M' && *p != 'm') break; // a path starts with a move
+			command = *p++;
+			if (command == 'Z' || command == 'z')
+			{
+				Close();
+				previous = 'Z';
+				continue;
+			}
+		}
+		else if (command == 0 || command == 'Z' || command == 'z')
+			break;
+		char upper = (char)toupper((unsigned char)command);
+		Vector2 base = islower((unsigned char)command) ? current_ : origin;
+		int needed = 0;
+		switch (upper)
+		{
+		case 'H': case 'V': needed = 1; break;
+		case 'M': case 'L': case 'T': needed = 2; break;
+		case 'S': case 'Q': needed = 4; break;
+		case 'C': needed = 6; break;
+		case 'A': needed = 7; break;
+		}
+		// an unknown command or a malformed number ends the path, what came before it is kept
+		if (needed == 0) break;
+		float n[7];
+		for (int i = 0; i < needed && p != NULL; i++)
+			p = upper == 'A' && (i == 3 || i == 4) ? Flag(p, d.end, &n[i]) : Number(p, d.end, &n[i]);
+		if (p == NULL) break;
+
+		bool smooth = (upper == 'S' && (previous == 'C' || previous == 'S')) || (upper == 'T' && (previous == 'Q' || previous == 'T'));
+		Vector2 reflected = smooth ? Point(2.0 * current_.x - control.x, 2.0 * current_.y - control.y) : current_;
+		switch (upper)
+		{
+		case 'M':
+			MoveTo(Point((double)base.x + n[0], (double)base.y + n[1]));
+			command = command == 'm' ? 'l' : 'L'; // more pairs are lines
+			break;
+		case 'L': LineTo(Point((double)base.x + n[0], (double)base.y + n[1])); break;
+		case 'H': LineTo(Point((double)base.x + n[0], current_.y)); break;
+		case 'V': LineTo(Point(current_.x, (double)base.y + n[0])); break;
+		case 'C':
+			control = Point((double)base.x + n[2], (double)base.y + n[3]);
+			Cubic(Point((double)base.x + n[0], (double)base.y + n[1]), control, Point((double)base.x + n[4], (double)base.y + n[5]));
+			break;
+		case 'S':
+			control = Point((double)base.x + n[0], (double)base.y + n[1]);
+			Cubic(reflected, control, Point((double)base.x + n[2], (double)base.y + n[3]));
+			break;
+		case 'Q':
+			control = Point((double)base.x + n[0], (double)base.y + n[1]);
+			Quadratic(control, Point((double)base.x + n[2], (double)base.y + n[3]));
+			break;
+		case 'T':
+			control = reflected;
+			Quadratic(control, Point((double)base.x + n[0], (double)base.y + n[1]));
+			break;
+		case 'A':
+			Arc(n[0], n[1], n[2], n[3] != 0, n[4] != 0, Point((double)base.x + n[5], (double)base.y + n[6]));
+			break;
+		}
+		previous = upper;
+	}
+	EndSubpath(false);
+}
+
+void SvgParser::MoveTo(const Vector2& v)
+{
+	EndSubpath(false);
+	current_ = v;
+	start_ = v;
+}
+
+void SvgParser::LineTo(const Vector2& v)
+{
+	circle_ = false;
+	Add(v);
+}
+
+// a point of the subpath, which starts at the current point
+void SvgParser::Add(const Vector2& v)
+{
+	if (subpath_.empty())
+		subpath_.push_back(current_);
+	subpath_.push_back(v);
+	current_ = v;
+}
+
+void SvgParser::Cubic(const Vector2& c1, const Vector2& c2, const Vector2& to)
+{
+	Vector2 from = current_;
+	double dx = max(fabs(from.x - 2.0 * c1.x + c2.x), fabs(c1.x - 2.0 * c2.x + to.x));
+	double dy = max(fabs(from.y - 2.0 * c1.y + c2.y), fabs(c1.y - 2.0 * c2.y + to.y));
+	int n = Segments(0.75 * sqrt(dx * dx + dy * dy));
+	for (int i = 1; i < n; i++)
+	{
+		double t = (double)i / n, u = 1 - t;
+		double a = u * u * u, b = 3 * u * u * t, c = 3 * u * t * t, e = t * t * t;
+		LineTo(Point(a * from.x + b * c1.x + c * c2.x + e * to.x, a * from.y + b * c1.y + c * c2.y + e * to.y));
+	}
+	LineTo(to);
+}
+
+void SvgParser::Quadratic(const Vector2& c, const Vector2& to)
+{
+	Vector2 from = current_;
+	double dx = from.x - 2.0 * c.x + to.x, dy = from.y - 2.0 * c.y + to.y;
+	int n = Segments(0.25 * sqrt(dx * dx + dy * dy));
+	for (int i = 1; i < n; i++)
+	{
+		double t = (double)i / n, u = 1 - t;
+		double a = u * u, b = 2 * u * t, e = t * t;
+		LineTo(Point(a * from.x + b * c.x + e * to.x, a * from.y + b * c.y + e * to.y));
+	}
+	LineTo(to);
+}
+
+// elliptical arc from the current point, converted to its center as in the implementation notes of SVG
+void SvgParser::Arc(float rx, float ry, float rotation, bool large, bool sweep, const Vector2& to)
+{
+	Vector2 from = current_;
+	if (from.x == to.x && from.y == to.y) return; // left out like renderers do
+	if (rx == 0 || ry == 0 || !Finite(&from, 1) || !Finite(&to, 1))
+	{
+		LineTo(to);
+		return;
+	}
+	double a = fabs(rx), b = fabs(ry);
+	double angle = rotation * M_PI / 180, cs = cos(angle), sn = sin(angle);
+	double hx = (from.x - to.x) / 2.0, hy = (from.y - to.y) / 2.0;
+	double x1 = cs * hx + sn * hy, y1 = -sn * hx + cs * hy;
+	double lambda = x1 * x1 / (a * a) + y1 * y1 / (b * b);
+	if (lambda > 1)
+	{
+		a *= sqrt(lambda);
+		b *= sqrt(lambda);
+	}
+	// a chord that is a diameter up to the rounding of the numbers is taken as one, so the half
+	// arcs of a circle share their center
+	double k = 0;
+	if (max(a, b) * (1 - sqrt(min(lambda, 1.0))) > IMPORT_ARC_SNAP)
+	{
+		double numerator = a * a * b * b - a * a * y1 * y1 - b * b * x1 * x1;
+		double denominator = a * a * y1 * y1 + b * b * x1 * x1;
+		k = sqrt(max(0.0, numerator / denominator));
+		if (large == sweep) k = -k;
+	}
+	double cx1 = k * a * y1 / b, cy1 = -k * b * x1 / a;
+	double cx = cs * cx1 - sn * cy1 + (from.x + to.x) / 2.0;
+	double cy = sn * cx1 + cs * cy1 + (from.y + to.y) / 2.0;
+	double first = atan2((y1 - cy1) / b, (x1 - cx1) / a);
+	double delta = atan2((-y1 - cy1) / b, (-x1 - cx1) / a) - first;
+	if (sweep && delta < 0)
+		delta += 2 * M_PI;
+	else if (!sweep && delta > 0)
+		delta -= 2 * M_PI;
+
+	double tolerance = max(IMPORT_ARC_SNAP, 1e-4 * max(a, b));
+	if (fabs(a - b) > tolerance || (arcs_ > 0 && (fabs(cx - circle_center_.x) > tolerance
+		|| fabs(cy - circle_center_.y) > tolerance || fabs(a - circle_radius_) > tolerance)))
+		circle_ = false;
+	if (arcs_ == 0)
+	{
+		circle_center_ = Point(cx, cy);
+		circle_radius_ = Coordinate(a);
+	}
+	arcs_++;
+	sweep_ += delta;
+
+	double radius = max(a, b);
+	double step = radius > IMPORT_FLATNESS ? 2 * acos(1 - IMPORT_FLATNESS / radius) : M_PI / 2;
+	int n = (int)min(ceil(fabs(delta) / step), (double)IMPORT_MAX_SEGMENTS);
+	for (int i = 1; i < n; i++)
+	{
+		double t = first + delta * i / n;
+		double ex = a * cos(t), ey = b * sin(t);
+		Add(Point(cx + cs * ex - sn * ey, cy + sn * ex + cs * ey));
+	}
+	Add(to);
+}
+
+void SvgParser::Close()
+{
+	EndSubpath(true);
+	current_ = start_;
+}
+
+void SvgParser::EndSubpath(bool closed)
+{
+	size_t n = subpath_.size();
+	if (circle_ && arcs_ > 0 && fabs(sweep_) >= 2 * M_PI - 1e-3)
+	{
+		Circle(circle_center_, circle_radius_);
+	}
+	else if (n >= 2)
+	{
+		if (subpath_[n - 1].x == subpath_[0].x && subpath_[n - 1].y == subpath_[0].y)
+		{
+			n--;
+			closed = true;
+		}
+		Polygon(&subpath_[0], n, closed);
+	}
+	subpath_.clear();
+	circle_ = true;
+	arcs_ = 0;
+	sweep_ = 0;
+}
+
+// filled convex polygons become quads and a triangle fanning out of the first vertex, other
+// filled polygons triangles. Outlines and filled polygons that can not be split are strokes
+void SvgParser::Polygon(const Vector2* v, size_t n, bool closed)
+{
+	if (!Finite(v, n)) return;
+	if (!filled_ || n < 3)
+	{
+		Outline(v, n, closed);
+		return;
+	}
+	if (!Convex(v, n))
+	{
+		if (n > IMPORT_MAX_TRIANGULATED || !Triangulate(v, n))
+			Outline(v, n, true);
+		return;
+	}
+	size_t i = 1;
+	for (; i + 2 < n; i += 2)
+	{
+		Vector2 quad[4] = { v[0], v[i], v[i + 1], v[i + 2] };
+		Shape(SHAPE_QUAD, quad, 4);
+	}
+	if (i + 1 < n)
+	{
+		Vector2 triangle[3] = { v[0], v[i], v[i + 1] };
+		Shape(SHAPE_TRIANGLE, triangle, 3);
+	}
+}
+
+// Ear clipping: cut off a corner turning the way the polygon does with no other vertex in its
+// triangle until one triangle is left. A polygon crossing itself runs out of such corners,
+// then nothing is added and false is returned. O(n^3) at worst
+bool SvgParser::Triangulate(const Vector2* v, size_t n)
+{
+	double area = 0;
+	for (size_t i = 0, j = n - 1; i < n; j = i++)
+		area += (double)v[j].x * v[i].y - (double)v[i].x * v[j].y;
+	if (area == 0) return false;
+	double sign = area > 0 ? 1 : -1;
+	corners_.clear();
+	for (size_t i = 0; i < n; i++)
+		corners_.push_back(i);
+	triangles_.clear();
+	while (corners_.size() > 3)
+	{
+		size_t m = corners_.size();
+		size_t ear = m;
+		for (size_t i = 0; i < m && ear == m; i++)
+		{
+			const Vector2& a = v[corners_[(i + m - 1) % m]];
+			const Vector2& b = v[corners_[i]];
+			const Vector2& c = v[corners_[(i + 1) % m]];
+			if (Turn(a, b, c) * sign <= 0) continue;
+			ear = i;
+			for (size_t j = 0; j < m && ear == i; j++)
+			{
+				if (j == i || j == (i + 1) % m || j == (i + m - 1) % m) continue;
+				const Vector2& p = v[corners_[j]];
+				if (Turn(a, b, p) * sign >= 0 && Turn(b, c, p) * sign >= 0 && Turn(c, a, p) * sign >= 0)
+					ear = m;
+			}
+		}
+		if (ear == m) return false;
+		triangles_.push_back(corners_[(ear + m - 1) % m]);
+		triangles_.push_back(corners_[ear]);
+		triangles_.push_back(corners_[(ear + 1) % m]);
+		corners_.erase(corners_.begin() + ear);
+	}
+	triangles_.insert(triangles_.end(), corners_.begin(), corners_.end());
+	for (size_t i = 0; i < triangles_.size(); i += 3)
+	{
+		Vector2 triangle[3] = { v[triangles_[i]], v[triangles_[i + 1]], v[triangles_[i + 2]] };
+		Shape(SHAPE_TRIANGLE, triangle, 3);
+	}
+	return true;
+}
+
+// a line for two points, longer outlines are strokes of STROKE_MAX_POINTS at most that share their ends
+void SvgParser::Outline(const Vector2* v, size_t n, bool closed)
+{
+	size_t total = closed && n > 2 ? n + 1 : n;
+	if (total < 2 || !Finite(v, n)) return;
+	if (total == 2)
+	{
+		Shape(SHAPE_LINE, v, 2);
+		return;
+	}
+	for (size_t first = 0; first + 1 < total; first += STROKE_MAX_POINTS - 1)
+	{
+		size_t count = min(STROKE_MAX_POINTS, total - first);
+		chunk_.stroke_points.push_back(chunk_.points.size());
+		for (size_t i = 0; i < count; i++)
+			chunk_.points.push_back(v[(first + i) % n]);
+		ShapeData shape = ShapeData();
+		shape.type = SHAPE_STROKE;
+		shape.color = color_;
+		shape.point_count = (unsigned int)count;
+		chunk_.shapes.push_back(shape);
+	}
+}
+
+void SvgParser::Circle(const Vector2& center, float radius)
+{
+	// the box around it has to fit in a float too
+	if (!(fabs((double)center.x) + radius <= FLT_MAX && fabs((double)center.y) + radius <= FLT_MAX)) return;
+	ShapeData shape = ShapeData();
+	shape.type = SHAPE_CIRCLE;
+	shape.flags = filled_ ? SHAPE_FILLED : 0;
+	shape.vertices[0] = center;
+	shape.radius = radius;
+	shape.color = color_;
+	chunk_.shapes.push_back(shape);
+}
+
+void SvgParser::Shape(unsigned char type, const Vector2* v, int n)
+{
+	ShapeData shape = ShapeData();
+	shape.type = type;
+	shape.flags = filled_ && type != SHAPE_LINE ? SHAPE_FILLED : 0;
+	for (int i = 0; i < n; i++)
+		shape.vertices[i] = v[i];
+	shape.color = color_;
+	chunk_.shapes.push_back(shape);
+}
+
+static void ParseChunks(ImportJob* job)
+{
+	unique_lock<mutex> lock(job->lock);
+	for (;;)
+	{
+		while (job->next < job->chunks.size() && job->next >= job->added + job->ahead)
+			job->ready.wait(lock);
+		if (job->next == job->chunks.size()) return;
+		ImportChunk& chunk = job->chunks[job->next++];
+		lock.unlock();
+		SvgParser parser(chunk, job->limit);
+		parser.Parse(chunk.begin);
+		lock.lock();
+		chunk.done = true;
+		job->ready.notify_all();
+	}
+}
+
+bool ImportSvg(const char* path, Scene* scene, int threads)
+{
+	MappedFile file;
+	if (!file.Open(path)) return false;
+	const char* data = file.Data();
+	const char* limit = data + file.Size();
+
+	// chunks start at the first '<' after every IMPORT_CHUNK_BYTES
+	ImportJob job;
+	job.limit = limit;
+	job.chunks.resize((file.Size() + IMPORT_CHUNK_BYTES - 1) / IMPORT_CHUNK_BYTES);
+	size_t count = job.chunks.size();
+	const char* begin = data;
+	for (size_t i = 0; i < count; i++)
+	{
+		const char* from = max(begin, data + i * IMPORT_CHUNK_BYTES);
+		const char* tag = (const char*)memchr(from, '<', limit - from);
+		begin = tag != NULL ? tag : limit;
+		job.chunks[i].begin = begin;
+		job.chunks[i].end = limit;
+		job.chunks[i].done = false;
+		if (i > 0)
+			job.chunks[i - 1].end = begin;
+	}
+	if (threads <= 0)
+		threads = max((int)thread::hardware_concurrency(), 1);
+	int workers = (int)min((size_t)threads, count);
+	job.next = 0;
+	job.added = 0;
+	job.ahead = (size_t)workers * IMPORT_CHUNKS_AHEAD;
+	vector<thread> pool;
+	for (int i = 0; i < workers; i++)
+		pool.push_back(thread(ParseChunks, &job));
+
+	// filled in a scene of its own, this one is left as it was when the file is refused
+	Scene imported;
+	imported.SetCompact(scene->Compact());
+	imported.SetPointStyle(scene->GetPointStyle());
+	bool svg = false;
+	bool added = true; // false once a shape did not fit in memory, the rest is parsed and dropped
+	for (size_t i = 0; i < count; i++)
+	{
+		ImportChunk& chunk = job.chunks[i];
+		{
+			unique_lock<mutex> lock(job.lock);
+			while (!chunk.done)
+				job.ready.wait(lock);
+		}
+		// the chunk started inside a comment or a quoted value, what the chunk before it ended with
+		// is right instead
+		if (i > 0 && chunk.begin != job.chunks[i - 1].stop)
+		{
+			SvgParser parser(chunk, limit);
+			parser.Parse(job.chunks[i - 1].stop);
+		}
+		svg = svg || chunk.svg;
+		for (size_t j = 0; j < chunk.shapes.size() && added; j++)
+			added = imported.Add(chunk.shapes[j]);
+		vector<ShapeData>().swap(chunk.shapes);
+		vector<Vector2>().swap(chunk.points);
+		vector<size_t>().swap(chunk.stroke_points);
+		lock_guard<mutex> lock(job.lock);
+		job.added++;
+		job.ready.notify_all();
+	}
+	for (size_t i = 0; i < pool.size(); i++)
+		pool[i].join();
+	if (!svg || !added) return false;
+	scene->Swap(imported);
+	return true;
+}
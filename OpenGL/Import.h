@@ -0,0 +1,23 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include "Scene.h"
+
+const size_t IMPORT_CHUNK_BYTES = 4 << 20; // input a worker parses at a time
+const int IMPORT_CHUNKS_AHEAD = 4; // parsed chunks per worker waiting to be added at most, bounds the memory
+const float IMPORT_FLATNESS = 0.25f; // curves and arcs stray at most this far from their line segments
+const int IMPORT_MAX_SEGMENTS = 1024; // line segments of one curve or arc at most
+const size_t IMPORT_MAX_TRIANGULATED = 256; // vertices of a filled concave polygon split into triangles at most, it costs O(n^3)
+
+// Replace the shapes of scene with the lines, polylines, polygons, rects, circles and paths of an
+// SVG file. The file is mapped and split into chunks at tags, workers parse the chunks into shapes
+// and the calling thread adds them to the scene in file order as each chunk gets ready.
+// Coordinates are taken as world units. Transforms, units and styles inherited from groups or
+// style sheets are not applied, so a shape without a fill or stroke color of its own is white,
+// and shapes inside defs are imported too. Curves and arcs are flattened, closed runs of arcs on
+// one circle become circles and filled outlines are split into quads and triangles, those crossing
+// themselves keep only their outline. threads 0 uses every core. false leaves scene as it was,
+// also when the shapes do not fit in memory
+bool ImportSvg(const char* path, Scene* scene, int threads = 0);
+
+#endif
@@ -0,0 +1,300 @@
+#include "InputRecording.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+static const char* INPUT_KIND_NAMES[INPUT_KIND_COUNT] = { "push", "drag", "move", "release", "wheel", "shortcut", "button", "color", "open", "resize" };
+
+static void WriteVarint(FILE* file, unsigned long long v)
+{
+	unsigned char bytes[10];
+	int n = 0;
+	do
+	{
+		bytes[n] = v & 0x7f;
+		v >>= 7;
+		if (v != 0) bytes[n] |= 0x80;
+		n++;
+	} while (v != 0);
+	fwrite(bytes, 1, n, file);
+}
+
+// small negative numbers stay short
+static void WriteSigned(FILE* file, int v)
+{
+	WriteVarint(file, ((unsigned int)v << 1) ^ (unsigned int)(v >> 31));
+}
+
+bool InputRecorder::Start(const char* path)
+{
+	Stop();
+	file_ = OpenFile(path, "wb");
+	if (file_ == NULL) return false;
+	fwrite(INPUT_FILE_MAGIC, 1, sizeof(INPUT_FILE_MAGIC), file_);
+	fwrite(&INPUT_FILE_VERSION, sizeof(INPUT_FILE_VERSION), 1, file_);
+	start_ = chrono::steady_clock::now();
+	last_us_ = 0;
+	return true;
+}
+
+void InputRecorder::Stop()
+{
+	if (file_ == NULL) return;
+	fclose(file_);
+	file_ = NULL;
+}
+
+double InputRecorder::Time() const
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start_).count();
+}
+
+void InputRecorder::Record(const InputEvent& event)
+{
+	if (file_ == NULL) return;
+	unsigned long long us = (unsigned long long)(max(event.time, 0.0) * 1e6 + 0.5);
+	us = max(us, last_us_);
+	fputc(event.kind | event.window << 7, file_);
+	WriteVarint(file_, us - last_us_);
+	last_us_ = us;
+	switch (event.kind)
+	{
+	case INPUT_PUSH: case INPUT_DRAG: case INPUT_MOVE: case INPUT_RELEASE:
+		WriteVarint(file_, event.button);
+		WriteSigned(file_, event.x);
+		WriteSigned(file_, event.y);
+		break;
+	case INPUT_WHEEL:
+		WriteSigned(file_, event.x);
+		WriteSigned(file_, event.y);
+		WriteSigned(file_, event.dy);
+		break;
+	case INPUT_SHORTCUT:
+		WriteVarint(file_, event.key);
+		WriteVarint(file_, event.state);
+		break;
+	case INPUT_BUTTON:
+		WriteVarint(file_, event.button);
+		break;
+	case INPUT_COLOR:
+		fwrite(&event.color, sizeof(float), 3, file_);
+		break;
+	case INPUT_OPEN:
+		WriteVarint(file_, event.path.size());
+		fwrite(event.path.data(), 1, event.path.size(), file_);
+		break;
+	case INPUT_RESIZE:
+		WriteVarint(file_, event.x);
+		WriteVarint(file_, event.y);
+		break;
+	}
+}
+
+class InputReader
+{
+public:
+	InputReader(const vector<unsigned char>& data) : data_(data) { position_ = 0; ok_ = true; }
+	bool Ok() const { return ok_; }
+	bool End() const { return position_ >= data_.size(); }
+	unsigned char Byte()
+	{
+		if (End())
+		{
+			ok_ = false;
+			return 0;
+		}
+		return data_[position_++];
+	}
+	unsigned long long Varint()
+	{
+		unsigned long long v = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			unsigned char b = Byte();
+			v |= (unsigned long long)(b & 0x7f) << shift;
+			if (!(b & 0x80)) return v;
+		}
+		ok_ = false;
+		return 0;
+	}
+	int Signed()
+	{
+		unsigned int v = (unsigned int)Varint();
+		return (int)(v >> 1) ^ -(int)(v & 1);
+	}
+	void Read(void* out, size_t size)
+	{
+		if (data_.size() - position_ < size)
+		{
+			ok_ = false;
+			position_ = data_.size();
+			return;
+		}
+		memcpy(out, &data_[position_], size);
+		position_ += size;
+	}
+	string String()
+	{
+		unsigned long long size = Varint();
+		if (size > data_.size() - position_)
+		{
+			ok_ = false;
+			position_ = data_.size();
+			return string();
+		}
+		string s((const char*)&data_[position_], (size_t)size);
+		position_ += (size_t)size;
+		return s;
+	}
+private:
+	const vector<unsigned char>& data_;
+	size_t position_;
+	bool ok_;
+};
+
+bool LoadInput(const char* path, vector<InputEvent>* events)
+{
+	FILE* file = OpenFile(path, "rb");
+	if (file == NULL) return false;
+	vector<unsigned char> data;
+	unsigned char buffer[65536];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.insert(data.end(), buffer, buffer + n);
+	fclose(file);
+
+	InputReader reader(data);
+	char magic[sizeof(INPUT_FILE_MAGIC)];
+	unsigned int version;
+	reader.Read(magic, sizeof(magic));
+	reader.Read(&version, sizeof(version));
+	if (!reader.Ok() || memcmp(magic, INPUT_FILE_MAGIC, sizeof(magic)) != 0 || version != INPUT_FILE_VERSION) return false;
+
+	events->clear();
+	unsigned long long us = 0;
+	while (!reader.End())
+	{
+		InputEvent event = InputEvent();
+		unsigned char head = reader.Byte();
+		event.kind = head & 0x7f;
+		event.window = head >> 7;
+		us += reader.Varint();
+		event.time = us / 1e6;
+		switch (event.kind)
+		{
+		case INPUT_PUSH: case INPUT_DRAG: case INPUT_MOVE: case INPUT_RELEASE:
+			event.button = (int)reader.Varint();
+			event.x = reader.Signed();
+			event.y = reader.Signed();
+			break;
+		case INPUT_WHEEL:
+			event.x = reader.Signed();
+			event.y = reader.Signed();
+			event.dy = reader.Signed();
+			break;
+		case INPUT_SHORTCUT:
+			event.key = (int)reader.Varint();
+			event.state = (int)reader.Varint();
+			break;
+		case INPUT_BUTTON:
+			event.button = (int)reader.Varint();
+			break;
+		case INPUT_COLOR:
+			reader.Read(&event.color, sizeof(float) * 3);
+			break;
+		case INPUT_OPEN:
+			event.path = reader.String();
+			break;
+		case INPUT_RESIZE:
+			event.x = (int)reader.Varint();
+			event.y = (int)reader.Varint();
+			break;
+		default:
+			return false;
+		}
+		if (!reader.Ok()) return false;
+		events->push_back(event);
+	}
+	return true;
+}
+
+bool InputReplay::Load(const char* path)
+{
+	if (!LoadInput(path, &events_)) return false;
+	Start();
+	return true;
+}
+
+void InputReplay::Start()
+{
+	next_ = 0;
+	pending_ = false;
+	latency_ms_.assign(events_.size(), -1);
+	start_ = chrono::steady_clock::now();
+}
+
+double InputReplay::Seconds() const
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start_).count();
+}
+
+double InputReplay::Delay() const
+{
+	return Finished() ? 0 : max(events_[next_].time - Seconds(), 0.0);
+}
+
+void InputReplay::Dispatch()
+{
+	dispatched_ = chrono::steady_clock::now();
+	pending_ = true;
+}
+
+void InputReplay::FrameDone()
+{
+	if (!pending_) return;
+	latency_ms_[next_] = chrono::duration<double, milli>(chrono::steady_clock::now() - dispatched_).count();
+	pending_ = false;
+}
+
+void InputReplay::Settle()
+{
+	pending_ = false;
+	next_++;
+}
+
+// nearest rank percentile of sorted samples
+static double Percentile(const vector<double>& sorted, int percent)
+{
+	return sorted[(sorted.size() * percent + 99) / 100 - 1];
+}
+
+void InputReplay::WriteReport(FILE* file) const
+{
+	fprintf(file, "event\tkind\ttime_s\tlatency_ms\n");
+	vector<double> per_kind[INPUT_KIND_COUNT];
+	vector<double> all;
+	for (size_t i = 0; i < next_; i++)
+	{
+		const InputEvent& event = events_[i];
+		if (latency_ms_[i] < 0)
+		{
+			fprintf(file, "%zu\t%s\t%.6f\t-\n", i, INPUT_KIND_NAMES[event.kind], event.time);
+			continue;
+		}
+		fprintf(file, "%zu\t%s\t%.6f\t%.3f\n", i, INPUT_KIND_NAMES[event.kind], event.time, latency_ms_[i]);
+		per_kind[event.kind].push_back(latency_ms_[i]);
+		all.push_back(latency_ms_[i]);
+	}
+	fprintf(file, "\nkind\tevents\tp50_ms\tp90_ms\tp99_ms\tmax_ms\n");
+	for (int k = 0; k <= INPUT_KIND_COUNT; k++)
+	{
+		vector<double> sorted = k < INPUT_KIND_COUNT ? per_kind[k] : all;
+		if (sorted.empty()) continue;
+		sort(sorted.begin(), sorted.end());
+		fprintf(file, "%s\t%zu\t%.3f\t%.3f\t%.3f\t%.3f\n", k < INPUT_KIND_COUNT ? INPUT_KIND_NAMES[k] : "all", sorted.size(),
+			Percentile(sorted, 50), Percentile(sorted, 90), Percentile(sorted, 99), sorted.back());
+	}
+	fprintf(file, "%zu events replayed in %.3f s\n", next_, Seconds());
+}
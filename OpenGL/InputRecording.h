@@ -0,0 +1,98 @@
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <chrono>
+#include "Geometry.h"
+
+// what the user did, as a window or the toolbar sees it
+enum InputKind
+{
+	INPUT_PUSH,
+	INPUT_DRAG,
+	INPUT_MOVE,
+	INPUT_RELEASE,
+	INPUT_WHEEL,
+	INPUT_SHORTCUT,
+	INPUT_BUTTON, // toolbar button, tool and fill changes included
+	INPUT_COLOR, // color picked in the color chooser
+	INPUT_OPEN, // scene or SVG file opened
+	INPUT_RESIZE, // the window has a new size, and the size it has when the recording starts
+	INPUT_KIND_COUNT
+};
+
+struct InputEvent
+{
+	double time; // seconds since the recording started
+	unsigned char kind;
+	unsigned char window; // 0 main window, 1 zoom window
+	int button; // mouse button, or child index of a toolbar button
+	int x; // pixels in the window, its width and height for a resize
+	int y;
+	int dy; // wheel steps
+	int key; // key of a shortcut
+	int state; // shift, ctrl and alt of a shortcut
+	Color color;
+	std::string path; // file of an open
+};
+
+const char INPUT_FILE_MAGIC[8] = { 'S', 'P', 'I', 'N', 'P', 'U', 'T', 0 };
+const unsigned int INPUT_FILE_VERSION = 2;
+
+// Writes events to a file as they happen. Every event is a kind byte, its time as microseconds
+// since the previous one and its fields, all variable length integers, most are 5 to 8 bytes.
+class InputRecorder
+{
+public:
+	InputRecorder() { file_ = NULL; last_us_ = 0; }
+	~InputRecorder() { Stop(); }
+	bool Start(const char* path);
+	void Stop();
+	bool Recording() const { return file_ != NULL; }
+	// seconds since Start, the time of an event when it arrives
+	double Time() const;
+	// write an event stamped with Time, nothing when not recording
+	void Record(const InputEvent& event);
+private:
+	FILE* file_;
+	std::chrono::steady_clock::time_point start_;
+	unsigned long long last_us_;
+};
+
+bool LoadInput(const char* path, std::vector<InputEvent>* events);
+
+// Events of a recording in order, with the time from dispatching each event to the end of the
+// frame drawn for it. An event that caused no frame has no latency.
+class InputReplay
+{
+public:
+	InputReplay() { next_ = 0; pending_ = false; }
+	bool Load(const char* path);
+	// restart the clock and the latencies from the first event
+	void Start();
+	bool Finished() const { return next_ >= events_.size(); }
+	const InputEvent& Next() const { return events_[next_]; }
+	// seconds until the next event is due at recorded speed
+	double Delay() const;
+	// call just before the next event is handled
+	void Dispatch();
+	// call after a frame was presented
+	void FrameDone();
+	// call once the frames of the dispatched event were drawn, it has no latency if none was
+	void Settle();
+	// per event latency and percentiles per kind
+	void WriteReport(FILE* file) const;
+private:
+	double Seconds() const;
+
+	std::vector<InputEvent> events_;
+	std::vector<double> latency_ms_; // negative when no frame was drawn
+	size_t next_;
+	std::chrono::steady_clock::time_point start_;
+	std::chrono::steady_clock::time_point dispatched_;
+	bool pending_;
+};
+
+#endif
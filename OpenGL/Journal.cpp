@@ -0,0 +1,586 @@
+#include "Journal.h"
+#include "MappedFile.h"
+#include "Import.h"
+#include <cstring>
+#include <chrono>
+
+using namespace std;
+
+const unsigned int JOURNAL_MAX_RECORD = 1 << 20; // a stroke of STROKE_MAX_POINTS or a tile of single pixel runs is smaller
+
+struct JournalHeader
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int kept; // cleared canvases saved along with the snapshot
+	unsigned long long generation; // of the snapshot the records apply to, 0 for an empty scene
+};
+// every record is a JournalRecordHeader, the kind byte and size bytes of payload
+struct JournalRecordHeader
+{
+	unsigned int size;
+	unsigned int checksum; // FNV-1a of the kind and the payload
+};
+
+static string SnapshotPath(const string& path, unsigned long long generation)
+{
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%llu.scene", generation);
+	return path + suffix;
+}
+
+// canvas put aside by the i-th clear that can be undone, saved with the snapshot of generation
+static string ClearedPath(const string& path, unsigned long long generation, unsigned int i)
+{
+	char suffix[48];
+	snprintf(suffix, sizeof(suffix), ".%llu.%u.scene", generation, i);
+	return path + suffix;
+}
+
+static void FreeCanvases(deque<JournalCanvas*>* canvases)
+{
+	for (size_t i = 0; i < canvases->size(); i++)
+		delete (*canvases)[i];
+	canvases->clear();
+}
+
+static unsigned int Checksum(unsigned char kind, const unsigned char* payload, size_t size)
+{
+	unsigned int hash = 2166136261u;
+	hash = (hash ^ kind) * 16777619u;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ payload[i]) * 16777619u;
+	return hash;
+}
+
+static void Put(vector<unsigned char>* out, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	out->insert(out->end(), bytes, bytes + size);
+}
+
+// fields of a record payload in order, false once the payload is too short
+class RecordReader
+{
+public:
+	RecordReader(const unsigned char* data, size_t size) { data_ = data; left_ = size; }
+	bool Get(void* out, size_t size)
+	{
+		if (size > left_) return false;
+		memcpy(out, data_, size);
+		data_ += size;
+		left_ -= size;
+		return true;
+	}
+	bool Tile(int* x, int* y)
+	{
+		return Get(x, sizeof(*x)) && Get(y, sizeof(*y)) && *x >= -PAINT_MAX_TILE && *x < PAINT_MAX_TILE
+			&& *y >= -PAINT_MAX_TILE && *y < PAINT_MAX_TILE;
+	}
+	bool Z(const Scene& scene, size_t* z)
+	{
+		unsigned long long value;
+		if (!Get(&value, sizeof(value)) || value >= scene.Count()) return false;
+		*z = (size_t)value;
+		return true;
+	}
+	bool Done() const { return left_ == 0; }
+private:
+	const unsigned char* data_;
+	size_t left_;
+};
+
+// redo one record on canvas, cleared holds what the clears that can be undone put aside.
+// false when it does not fit the canvas, e.g. a corrupt journal, or there is no memory for it
+static bool Apply(JournalCanvas* canvas, deque<JournalCanvas*>* cleared, unsigned char kind, const unsigned char* payload, size_t size)
+{
+	Scene* scene = &canvas->scene;
+	RecordReader in(payload, size);
+	size_t z;
+	switch (kind)
+	{
+	case JOURNAL_ADD:
+	{
+		ShapeData shape;
+		vector<Vector2> points;
+		if (!in.Get(&shape.type, 1) || !in.Get(&shape.flags, 1) || !in.Get(shape.vertices, sizeof(shape.vertices))
+			|| !in.Get(&shape.radius, sizeof(shape.radius)) || !in.Get(&shape.color, sizeof(shape.color))
+			|| !in.Get(&shape.point_count, sizeof(shape.point_count)) || shape.type >= SHAPE_TYPE_COUNT)
+			return false;
+		shape.points = NULL;
+		if (shape.type == SHAPE_STROKE)
+		{
+			if (shape.point_count < 2 || shape.point_count > STROKE_MAX_POINTS) return false;
+			points.resize(shape.point_count);
+			if (!in.Get(&points[0], points.size() * sizeof(Vector2))) return false;
+			shape.points = &points[0];
+		}
+		if (!in.Done()) return false;
+		return scene->Add(shape);
+	}
+	case JOURNAL_POP:
+		if (scene->Count() == 0 || !in.Done()) return false;
+		scene->PopBack();
+		return true;
+	case JOURNAL_DELETE:
+	case JOURNAL_RESTORE:
+		if (!in.Z(*scene, &z) || !in.Done()) return false;
+		if (kind == JOURNAL_DELETE)
+			scene->Delete(z);
+		else if (!scene->Restore(z))
+			return false;
+		return true;
+	case JOURNAL_MOVE:
+	{
+		Vector2 offset;
+		if (!in.Z(*scene, &z) || !in.Get(&offset, sizeof(offset)) || !in.Done()) return false;
+		return scene->Move(z, offset.x, offset.y);
+	}
+	case JOURNAL_COLOR:
+	{
+		Color color;
+		if (!in.Z(*scene, &z) || !in.Get(&color, sizeof(color)) || !in.Done()) return false;
+		scene->SetColor(z, color);
+		return true;
+	}
+	case JOURNAL_CLEAR:
+	{
+		if (!in.Done()) return false;
+		// swapped aside like History does, O(1)
+		JournalCanvas* kept = new JournalCanvas();
+		kept->scene.SetCompact(scene->Compact());
+		scene->Swap(kept->scene);
+		canvas->paint.Swap(kept->paint);
+		cleared->push_back(kept);
+		return true;
+	}
+	case JOURNAL_UNCLEAR:
+		if (cleared->empty() || !in.Done()) return false;
+		scene->Swap(cleared->back()->scene);
+		canvas->paint.Swap(cleared->back()->paint);
+		delete cleared->back();
+		cleared->pop_back();
+		return true;
+	case JOURNAL_FORGET:
+		if (cleared->empty() || !in.Done()) return false;
+		delete cleared->front();
+		cleared->pop_front();
+		return true;
+	case JOURNAL_POINT_STYLE:
+	{
+		PointStyle style;
+		if (!in.Get(&style, sizeof(style)) || !in.Done()) return false;
+		scene->SetPointStyle(style);
+		return true;
+	}
+	case JOURNAL_TILE:
+	{
+		int x, y;
+		if (!in.Tile(&x, &y)) return false;
+		if (in.Done())
+			return canvas->paint.SetTile(x, y, NULL);
+		vector<Pixel> pixels(PAINT_TILE_SIZE * PAINT_TILE_SIZE);
+		size_t filled = 0;
+		while (!in.Done())
+		{
+			unsigned int count;
+			Pixel pixel;
+			if (!in.Get(&count, sizeof(count)) || !in.Get(&pixel, sizeof(pixel)) || count == 0 || count > pixels.size() - filled)
+				return false;
+			FillPixels(&pixels[filled], count, pixel);
+			filled += count;
+		}
+		return filled == pixels.size() && canvas->paint.SetTile(x, y, &pixels[0]);
+	}
+	}
+	return false;
+}
+
+Journal::Journal()
+{
+	compact_ = false;
+	stopping_ = false;
+	opening_ = false;
+	given_up_ = false;
+	file_ = NULL;
+	generation_ = 0;
+	kept_ = 0;
+	journal_bytes_ = 0;
+	snapshot_due_ = false;
+	copy_short_ = false;
+}
+
+bool Journal::Recover(const char* path, Scene* scene, PaintLayer* paint)
+{
+	JournalCanvas canvas;
+	canvas.scene.SetCompact(scene->Compact());
+	unsigned long long generation;
+	unsigned int kept;
+	unsigned long long end;
+	if (!Read(path, &canvas, &generation, &kept, &end)) return false;
+	scene->Swap(canvas.scene);
+	paint->Swap(canvas.paint);
+	return true;
+}
+
+// the snapshot and the records up to the first one torn or corrupt. Nothing is left to undo
+// after a recovery, the cleared canvases saved with the snapshot are dropped at the end
+bool Journal::Read(const char* path, JournalCanvas* canvas, unsigned long long* generation, unsigned int* kept, unsigned long long* end)
+{
+	FILE* file = OpenFile(path, "rb");
+	if (file == NULL) return false;
+	JournalHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, JOURNAL_FILE_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != JOURNAL_FILE_VERSION)
+	{
+		fclose(file);
+		return false;
+	}
+	JournalCanvas recovered;
+	recovered.scene.SetCompact(canvas->scene.Compact());
+	deque<JournalCanvas*> cleared;
+	bool opened = header.generation > 0 ? recovered.scene.Open(SnapshotPath(path, header.generation).c_str(), &recovered.paint)
+		: header.kept == 0;
+	for (unsigned int i = 0; opened && i < header.kept; i++)
+	{
+		cleared.push_back(new JournalCanvas());
+		cleared.back()->scene.SetCompact(canvas->scene.Compact());
+		opened = cleared.back()->scene.Open(ClearedPath(path, header.generation, i).c_str(), &cleared.back()->paint);
+	}
+	if (!opened)
+	{
+		FreeCanvases(&cleared);
+		fclose(file);
+		return false;
+	}
+	vector<unsigned char> payload;
+	JournalRecordHeader record;
+	unsigned char kind;
+	*end = sizeof(header);
+	while (fread(&record, sizeof(record), 1, file) == 1 && record.size <= JOURNAL_MAX_RECORD && fread(&kind, 1, 1, file) == 1)
+	{
+		payload.resize(record.size);
+		if (record.size > 0 && fread(&payload[0], 1, record.size, file) != record.size) break;
+		const unsigned char* data = payload.empty() ? NULL : &payload[0];
+		if (Checksum(kind, data, record.size) != record.checksum || !Apply(&recovered, &cleared, kind, data, record.size)) break;
+		*end += sizeof(record) + 1 + record.size;
+	}
+	fclose(file);
+	FreeCanvases(&cleared);
+	canvas->scene.Swap(recovered.scene);
+	canvas->paint.Swap(recovered.paint);
+	*generation = header.generation;
+	*kept = header.kept;
+	return true;
+}
+
+bool Journal::Start(const char* path, bool compact)
+{
+	Stop();
+	// the journal has to be writable, found out here once instead of on the writer thread
+	FILE* file = OpenFile(path, "ab");
+	if (file == NULL) return false;
+	fclose(file);
+	path_ = path;
+	compact_ = compact;
+	stopping_ = false;
+	opening_ = false;
+	given_up_ = false;
+	pending_.clear();
+	writer_ = thread(&Journal::Write, this);
+	return true;
+}
+
+void Journal::Stop()
+{
+	if (!writer_.joinable()) return;
+	{
+		lock_guard<mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	wake_.notify_one();
+	writer_.join();
+}
+
+void Journal::Append(unsigned char kind, const void* payload, size_t size)
+{
+	if (!Started()) return;
+	JournalRecordHeader record = { (unsigned int)size, Checksum(kind, (const unsigned char*)payload, size) };
+	bool wake;
+	{
+		lock_guard<mutex> lock(mutex_);
+		Put(&pending_, &record, sizeof(record));
+		pending_.push_back(kind);
+		Put(&pending_, payload, size);
+		// the file of an open is read again as soon as possible, while it is most likely unchanged
+		opening_ = opening_ || kind == JOURNAL_OPEN;
+		wake = pending_.size() >= JOURNAL_BATCH_BYTES || opening_;
+	}
+	if (wake)
+		wake_.notify_one();
+}
+
+void Journal::Added(const ShapeData& shape)
+{
+	if (!Started()) return;
+	unsigned char flags = shape.flags & ~SHAPE_TRANSIENT;
+	unsigned int point_count = shape.type == SHAPE_STROKE ? shape.point_count : 0;
+	record_.clear();
+	Put(&record_, &shape.type, 1);
+	Put(&record_, &flags, 1);
+	Put(&record_, shape.vertices, sizeof(shape.vertices));
+	Put(&record_, &shape.radius, sizeof(shape.radius));
+	Put(&record_, &shape.color, sizeof(shape.color));
+	Put(&record_, &point_count, sizeof(point_count));
+	if (point_count > 0)
+		Put(&record_, shape.points, point_count * sizeof(Vector2));
+	Append(JOURNAL_ADD, &record_[0], record_.size());
+}
+
+void Journal::PoppedBack()
+{
+	Append(JOURNAL_POP, NULL, 0);
+}
+
+void Journal::Deleted(size_t z)
+{
+	unsigned long long value = z;
+	Append(JOURNAL_DELETE, &value, sizeof(value));
+}
+
+void Journal::Restored(size_t z)
+{
+	unsigned long long value = z;
+	Append(JOURNAL_RESTORE, &value, sizeof(value));
+}
+
+void Journal::Moved(size_t z, float dx, float dy)
+{
+	unsigned char payload[sizeof(unsigned long long) + sizeof(Vector2)];
+	unsigned long long value = z;
+	Vector2 offset = { dx, dy };
+	memcpy(payload, &value, sizeof(value));
+	memcpy(payload + sizeof(value), &offset, sizeof(offset));
+	Append(JOURNAL_MOVE, payload, sizeof(payload));
+}
+
+void Journal::Recolored(size_t z, const Color& color)
+{
+	unsigned char payload[sizeof(unsigned long long) + sizeof(Color)];
+	unsigned long long value = z;
+	memcpy(payload, &value, sizeof(value));
+	memcpy(payload + sizeof(value), &color, sizeof(color));
+	Append(JOURNAL_COLOR, payload, sizeof(payload));
+}
+
+void Journal::Cleared()
+{
+	Append(JOURNAL_CLEAR, NULL, 0);
+}
+
+void Journal::PointStyleChanged(const PointStyle& style)
+{
+	Append(JOURNAL_POINT_STYLE, &style, sizeof(style));
+}
+
+void Journal::Uncleared()
+{
+	Append(JOURNAL_UNCLEAR, NULL, 0);
+}
+
+void Journal::ClearForgotten()
+{
+	Append(JOURNAL_FORGET, NULL, 0);
+}
+
+// a record per tile, runs of equal pixels as a count and the pixel: paint is mostly flat color
+void Journal::Painted(const PaintLayer& paint, const vector<PaintTileCopy>& tiles)
+{
+	if (!Started()) return;
+	for (size_t t = 0; t < tiles.size(); t++)
+	{
+		record_.clear();
+		Put(&record_, &tiles[t].x, sizeof(tiles[t].x));
+		Put(&record_, &tiles[t].y, sizeof(tiles[t].y));
+		int i = paint.Find(tiles[t].x, tiles[t].y);
+		if (i >= 0)
+		{
+			const Pixel* pixels = paint.Tile(i).pixels;
+			const unsigned int n = PAINT_TILE_SIZE * PAINT_TILE_SIZE;
+			for (unsigned int first = 0; first < n;)
+			{
+				unsigned int end = first + 1;
+				while (end < n && pixels[end] == pixels[first])
+					end++;
+				unsigned int count = end - first;
+				Put(&record_, &count, sizeof(count));
+				Put(&record_, &pixels[first], sizeof(Pixel));
+				first = end;
+			}
+		}
+		Append(JOURNAL_TILE, &record_[0], record_.size());
+	}
+}
+
+// the path goes in the record, after a byte telling an SVG import from a scene file
+void Journal::Opened(const char* path, bool svg)
+{
+	if (!Started()) return;
+	record_.clear();
+	record_.push_back(svg ? 1 : 0);
+	Put(&record_, path, strlen(path));
+	Append(JOURNAL_OPEN, &record_[0], record_.size());
+}
+
+// writer thread: the canvas of a JOURNAL_OPEN record replaces the copy. A canvas that can not be
+// read whole is not taken, a journal of the scene before it would recover the wrong canvas
+bool Journal::Replace(JournalCanvas* copy, const unsigned char* payload, size_t size)
+{
+	if (size < 1) return false;
+	string path((const char*)payload + 1, size - 1);
+	JournalCanvas replacement;
+	replacement.scene.SetCompact(compact_);
+	// one worker for the import, the cores are left to the thread drawing the scene
+	if (!(payload[0] ? ImportSvg(path.c_str(), &replacement.scene, 1) : replacement.scene.Open(path.c_str(), &replacement.paint)))
+		return false;
+	copy->scene.Swap(replacement.scene);
+	copy->paint.Swap(replacement.paint);
+	return true;
+}
+
+// writer thread: takes the pending records every JOURNAL_FLUSH_MS or once a batch is full,
+// appends them, keeps its copy of the scene up to date and takes snapshots of it
+void Journal::Write()
+{
+	JournalCanvas copy;
+	copy.scene.SetCompact(compact_);
+	generation_ = 0;
+	kept_ = 0;
+	unsigned long long end;
+	bool read = Read(path_.c_str(), &copy, &generation_, &kept_, &end);
+	if (!read)
+	{
+		generation_ = 0;
+		kept_ = 0;
+	}
+	// the recovered journal may end in a torn record, it is cut off so that records appended
+	// when the snapshot fails follow the last good one. An unreadable journal waits for a snapshot
+	snapshot_due_ = !read || !TruncateFile(path_.c_str(), end);
+	file_ = NULL;
+	Compact(copy);
+
+	vector<unsigned char> batch;
+	unique_lock<mutex> lock(mutex_);
+	for (;;)
+	{
+		wake_.wait_for(lock, chrono::milliseconds(JOURNAL_FLUSH_MS),
+			[this] { return stopping_ || opening_ || pending_.size() >= JOURNAL_BATCH_BYTES; });
+		batch.swap(pending_);
+		opening_ = false;
+		bool stopping = stopping_;
+		lock.unlock();
+		if (!batch.empty())
+		{
+			size_t written = 0; // records before were appended
+			for (size_t i = 0; i < batch.size();)
+			{
+				JournalRecordHeader record;
+				memcpy(&record, &batch[i], sizeof(record));
+				unsigned char kind = batch[i + sizeof(record)];
+				const unsigned char* payload = &batch[0] + i + sizeof(record) + 1;
+				size_t next = i + sizeof(record) + 1 + record.size;
+				if (kind == JOURNAL_OPEN)
+				{
+					// the records before still go to the old journal, the new scene starts with a snapshot
+					Flush(batch, written, i);
+					written = next;
+					if (!Replace(&copy, payload, record.size))
+					{
+						// the edits after it belong to a canvas the writer does not have
+						given_up_ = true;
+						written = batch.size();
+						stopping = true;
+						break;
+					}
+					snapshot_due_ = true;
+					copy_short_ = false;
+					Compact(copy);
+				}
+				else if (!Apply(&copy, &cleared_, kind, payload, record.size))
+					copy_short_ = true;
+				i = next;
+			}
+			Flush(batch, written, batch.size());
+			batch.clear();
+			if (!copy_short_ && (snapshot_due_ || journal_bytes_ >= JOURNAL_COMPACT_BYTES))
+				Compact(copy);
+		}
+		if (stopping) break;
+		lock.lock();
+	}
+	if (file_ != NULL)
+		fclose(file_);
+	file_ = NULL;
+	FreeCanvases(&cleared_);
+}
+
+// append the records of batch from begin to end
+void Journal::Flush(const vector<unsigned char>& batch, size_t begin, size_t end)
+{
+	if (file_ == NULL || begin == end) return;
+	fwrite(&batch[begin], 1, end - begin, file_);
+	fflush(file_);
+	journal_bytes_ += end - begin;
+}
+
+// save copy as the next snapshot and start an empty journal on it, the old pair stays
+// in place until the new one is complete. The cleared canvases are saved again with every
+// snapshot, History drops the oldest clears once they take more than its budget
+bool Journal::Compact(JournalCanvas& copy)
+{
+	unsigned long long next = generation_ + 1;
+	string snapshot = SnapshotPath(path_, next);
+	unsigned int kept = (unsigned int)cleared_.size();
+	if (file_ != NULL)
+		fclose(file_);
+	file_ = NULL;
+	// erased shapes are kept, the records that follow refer to shapes by z
+	bool written = copy.scene.Save(snapshot.c_str(), true, true, &copy.paint);
+	for (unsigned int i = 0; written && i < kept; i++)
+		written = cleared_[i]->scene.Save(ClearedPath(path_, next, i).c_str(), true, true, &cleared_[i]->paint);
+	string temp = path_ + ".tmp";
+	FILE* file = written ? OpenFile(temp.c_str(), "wb") : NULL;
+	JournalHeader header = JournalHeader();
+	memcpy(header.magic, JOURNAL_FILE_MAGIC, sizeof(header.magic));
+	header.version = JOURNAL_FILE_VERSION;
+	header.kept = kept;
+	header.generation = next;
+	written = file != NULL && fwrite(&header, sizeof(header), 1, file) == 1;
+	if (file != NULL && fclose(file) != 0)
+		written = false;
+	if (!written || !MoveFileOver(temp.c_str(), path_.c_str()))
+	{
+		remove(temp.c_str());
+		RemoveSnapshot(next, kept);
+		// the old journal goes on unless it no longer holds the copy
+		if (!snapshot_due_)
+			file_ = OpenFile(path_.c_str(), "ab");
+		return false;
+	}
+	if (generation_ > 0)
+		RemoveSnapshot(generation_, kept_);
+	generation_ = next;
+	kept_ = kept;
+	journal_bytes_ = 0;
+	snapshot_due_ = false;
+	file_ = OpenFile(path_.c_str(), "ab");
+	return true;
+}
+
+// a mapped snapshot is only marked for deletion, the scenes opened from it keep their pages
+void Journal::RemoveSnapshot(unsigned long long generation, unsigned int kept)
+{
+	remove(SnapshotPath(path_, generation).c_str());
+	for (unsigned int i = 0; i < kept; i++)
+		remove(ClearedPath(path_, generation, i).c_str());
+}
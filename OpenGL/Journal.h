@@ -0,0 +1,128 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "Scene.h"
+#include "PaintLayer.h"
+
+const char JOURNAL_FILE_MAGIC[8] = { 'S', 'P', 'J', 'O', 'U', 'R', 'N', 0 };
+const unsigned int JOURNAL_FILE_VERSION = 2;
+const int JOURNAL_FLUSH_MS = 250; // records reach the file this long after the edit at most
+const size_t JOURNAL_BATCH_BYTES = 64 << 10; // pending records that wake the writer early
+const unsigned long long JOURNAL_COMPACT_BYTES = 16 << 20; // journal size that starts a snapshot
+
+enum JournalRecord
+{
+	JOURNAL_ADD, // a shape on top, flags included
+	JOURNAL_POP, // the top shape erased
+	JOURNAL_DELETE,
+	JOURNAL_RESTORE,
+	JOURNAL_MOVE,
+	JOURNAL_COLOR,
+	JOURNAL_CLEAR, // the shapes put aside, an undo of the clear brings them back
+	JOURNAL_POINT_STYLE,
+	JOURNAL_OPEN, // the scene replaced by a file the writer reads again, never reaches the file
+	JOURNAL_UNCLEAR, // the last clear undone
+	JOURNAL_FORGET, // the oldest clear can no longer be undone, its shapes are dropped
+	JOURNAL_TILE // a paint tile as it is now, its pixels in runs, none when it was erased
+};
+
+// shapes and paint of a canvas, as the writer keeps them
+struct JournalCanvas
+{
+	Scene scene;
+	PaintLayer paint;
+};
+
+// Autosave of a scene as an append-only journal of its edits on top of a snapshot. The edits are
+// encoded on the calling thread into memory only, a writer thread appends them to the journal in
+// batches and applies them to a copy of the scene of its own. When the journal grows past
+// JOURNAL_COMPACT_BYTES that copy is saved as the next snapshot and the journal starts over, so
+// the thread drawing the scene never waits for the disk.
+//
+// The journal at path names the generation of the snapshot it applies to, path.<generation>.scene,
+// 0 for an empty scene. A new snapshot is written before the journal naming it replaces the old
+// journal, a crash in between leaves the old pair intact. A record torn by a crash ends the journal.
+//
+// Paint is journaled by the tiles an edit changed, snapshots save it in the scene file.
+//
+// A clear puts the shapes and paint aside as History does, so its undo is one record as well.
+// The writer keeps what every clear that can still be undone put aside, each snapshot saves it
+// along as path.<generation>.<i>.scene, oldest first.
+class Journal
+{
+public:
+	Journal();
+	~Journal() { Stop(); }
+	// replace scene and paint by the snapshot and journal at path, false when there is none or it is
+	// unreadable. Call before Start, on the scene Start is given
+	static bool Recover(const char* path, Scene* scene, PaintLayer* paint);
+	// journal the edits of scene from now on, the writer first recovers path on its own copy and
+	// compacts it. compact gives the copy the storage mode of the scene so both round alike
+	bool Start(const char* path, bool compact);
+	// write the pending records and stop the writer
+	void Stop();
+	// false too once the writer gave up, records are dropped then
+	bool Started() const { return writer_.joinable() && !given_up_; }
+
+	void Added(const ShapeData& shape); // shape.points are copied
+	void PoppedBack();
+	void Deleted(size_t z);
+	void Restored(size_t z);
+	void Moved(size_t z, float dx, float dy);
+	void Recolored(size_t z, const Color& color);
+	void Cleared();
+	void PointStyleChanged(const PointStyle& style);
+	void Uncleared(); // the last clear undone
+	void ClearForgotten(); // the oldest clear that can be undone no longer can
+	// the tiles at the positions of tiles as they are in paint now, O(pixels of the tiles)
+	void Painted(const PaintLayer& paint, const std::vector<PaintTileCopy>& tiles);
+	// The scene and paint were replaced by the scene file at path, or by the shapes of the SVG
+	// file at path with the paint erased when svg. Only the path is handed over, the writer opens
+	// or imports the file once more for a canvas of its own and takes a snapshot of it right away.
+	// When it can not, e.g. for lack of memory, the edits before are kept and autosave stops
+	void Opened(const char* path, bool svg);
+private:
+	Journal(const Journal&);
+	Journal& operator=(const Journal&);
+
+	// end is the size of the journal up to the last good record
+	static bool Read(const char* path, JournalCanvas* canvas, unsigned long long* generation, unsigned int* kept, unsigned long long* end);
+	void Append(unsigned char kind, const void* payload, size_t size);
+	void Write(); // writer thread
+	bool Replace(JournalCanvas* copy, const unsigned char* payload, size_t size);
+	void Flush(const std::vector<unsigned char>& batch, size_t begin, size_t end);
+	bool Compact(JournalCanvas& copy);
+	void RemoveSnapshot(unsigned long long generation, unsigned int kept);
+
+	std::string path_;
+	std::thread writer_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::vector<unsigned char> pending_; // records not yet taken by the writer
+	std::vector<unsigned char> record_; // scratch of the calling thread
+	bool compact_;
+	bool stopping_;
+	bool opening_; // a JOURNAL_OPEN record is pending
+	std::atomic<bool> given_up_; // the writer stopped on its own, a canvas could not be replaced
+	// writer thread only
+	std::deque<JournalCanvas*> cleared_; // put aside by the clears that can be undone, oldest first
+	FILE* file_;
+	unsigned long long generation_;
+	unsigned int kept_; // cleared canvases saved along with the snapshot of generation_
+	unsigned long long journal_bytes_;
+	// the file does not hold the copy, nothing is appended until a snapshot succeeds
+	bool snapshot_due_;
+	// a record did not fit the copy for lack of memory, the journal keeps growing instead of
+	// folding the copy into a snapshot until the next canvas is opened
+	bool copy_short_;
+};
+
+#endif
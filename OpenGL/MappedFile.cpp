@@ -0,0 +1,161 @@
+#include "MappedFile.h"
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FILE* OpenFile(const char* path, const char* mode)
+{
+#ifdef _MSC_VER
+	FILE* file = NULL;
+	if (fopen_s(&file, path, mode) != 0) return NULL;
+	return file;
+#else
+	return fopen(path, mode);
+#endif
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+{
+	data_ = NULL;
+	size_ = 0;
+	file_ = INVALID_HANDLE_VALUE;
+	mapping_ = NULL;
+}
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+	// share delete, so a save can move a new file over the mapped one
+	file_ = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (file_ == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0 || (unsigned long long)size.QuadPart > (size_t)-1)
+	{
+		Close();
+		return false;
+	}
+	// PAGE_WRITECOPY with FILE_MAP_COPY gives private writable pages on a read only file
+	mapping_ = CreateFileMappingA(file_, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (mapping_ == NULL)
+	{
+		Close();
+		return false;
+	}
+	data_ = (char*)MapViewOfFile(mapping_, FILE_MAP_COPY, 0, 0, 0);
+	if (data_ == NULL)
+	{
+		Close();
+		return false;
+	}
+	size_ = (size_t)size.QuadPart;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data_ != NULL)
+		UnmapViewOfFile(data_);
+	if (mapping_ != NULL)
+		CloseHandle(mapping_);
+	if (file_ != INVALID_HANDLE_VALUE)
+		CloseHandle(file_);
+	data_ = NULL;
+	size_ = 0;
+	file_ = INVALID_HANDLE_VALUE;
+	mapping_ = NULL;
+}
+
+bool MoveFileOver(const char* from, const char* to)
+{
+	// a mapped file can not be overwritten but it can be renamed away, it is deleted once unmapped
+	char old[MAX_PATH + 8];
+	if (strlen(to) + 5 > MAX_PATH) return false;
+	strcpy_s(old, sizeof(old), to);
+	strcat_s(old, sizeof(old), ".old");
+	DeleteFileA(old);
+	bool moved_away = MoveFileExA(to, old, MOVEFILE_REPLACE_EXISTING) != 0;
+	if (!MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING))
+	{
+		if (moved_away)
+			MoveFileExA(old, to, 0);
+		return false;
+	}
+	if (moved_away)
+		DeleteFileA(old); // pending until the old file is unmapped
+	return true;
+}
+
+bool TruncateFile(const char* path, unsigned long long size)
+{
+	HANDLE file = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER position;
+	position.QuadPart = (LONGLONG)size;
+	bool ok = SetFilePointerEx(file, position, NULL, FILE_BEGIN) && SetEndOfFile(file);
+	CloseHandle(file);
+	return ok;
+}
+
+#else
+
+MappedFile::MappedFile()
+{
+	data_ = NULL;
+	size_ = 0;
+	file_ = -1;
+}
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+	file_ = open(path, O_RDONLY);
+	if (file_ < 0) return false;
+	struct stat info;
+	if (fstat(file_, &info) != 0 || info.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+	void* data = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file_, 0);
+	if (data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	data_ = (char*)data;
+	size_ = (size_t)info.st_size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data_ != NULL)
+		munmap(data_, size_);
+	if (file_ >= 0)
+		close(file_);
+	data_ = NULL;
+	size_ = 0;
+	file_ = -1;
+}
+
+bool MoveFileOver(const char* from, const char* to)
+{
+	// the mapped file keeps its pages until it is unmapped
+	return rename(from, to) == 0;
+}
+
+bool TruncateFile(const char* path, unsigned long long size)
+{
+	return truncate(path, (off_t)size) == 0;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdio>
+
+// Whole file mapped copy-on-write: pages are read from the file on first touch,
+// writes stay private to the process and never reach the file.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile() { Close(); }
+	bool Open(const char* path);
+	void Close();
+	char* Data() { return data_; }
+	size_t Size() const { return size_; }
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	char* data_;
+	size_t size_;
+#ifdef _WIN32
+	void* file_;
+	void* mapping_;
+#else
+	int file_;
+#endif
+};
+
+// fopen that builds with the secure CRT checks of Visual Studio, NULL on failure
+FILE* OpenFile(const char* path, const char* mode);
+// replace file to with file from, also when to is mapped by a MappedFile
+bool MoveFileOver(const char* from, const char* to);
+// cut the file at path down to size bytes
+bool TruncateFile(const char* path, unsigned long long size);
+
+#endif
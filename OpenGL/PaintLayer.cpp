@@ -0,0 +1,493 @@
+#include "PaintLayer.h"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+
+using namespace std;
+
+// versions of all layers are different, a renderer never mistakes one layer's tile for another's
+static atomic<int> last_paint_version(0);
+
+PaintLayer::PaintLayer()
+{
+	version_ = ++last_paint_version;
+	edit_version_ = 0;
+	editing_ = false;
+}
+
+unsigned long long PaintLayer::Key(int x, int y)
+{
+	return (unsigned long long)(unsigned int)y << 32 | (unsigned int)x;
+}
+
+int PaintLayer::Find(int x, int y) const
+{
+	unordered_map<unsigned long long, unsigned int>::const_iterator it = index_.find(Key(x, y));
+	return it == index_.end() ? -1 : (int)it->second;
+}
+
+Pixel* PaintLayer::Writable(int x, int y)
+{
+	int i = Find(x, y);
+	if (i < 0)
+	{
+		PaintTile tile;
+		tile.x = x;
+		tile.y = y;
+		tile.pixels = (Pixel*)calloc(1, PAINT_TILE_BYTES);
+		if (tile.pixels == NULL) return NULL;
+		tile.version = version_;
+		PaintTileCopy copy = { x, y, NULL };
+		if (editing_ && !Keep(copy))
+		{
+			free(tile.pixels);
+			return NULL;
+		}
+		if (!Insert(tile))
+		{
+			if (editing_)
+				before_.pop_back();
+			free(tile.pixels);
+			return NULL;
+		}
+		return tile.pixels;
+	}
+	PaintTile& tile = tiles_[i];
+	if (editing_ && tile.version <= edit_version_)
+	{
+		// a tile that can not be kept for undo is not changed either
+		PaintTileCopy copy = { x, y, (Pixel*)malloc(PAINT_TILE_BYTES) };
+		if (copy.pixels == NULL) return NULL;
+		memcpy(copy.pixels, tile.pixels, PAINT_TILE_BYTES);
+		if (!Keep(copy))
+		{
+			free(copy.pixels);
+			return NULL;
+		}
+	}
+	tile.version = version_;
+	return tile.pixels;
+}
+
+// add the copy to those of the edit, false when out of memory
+bool PaintLayer::Keep(const PaintTileCopy& copy)
+{
+	try
+	{
+		before_.push_back(copy);
+	}
+	catch (const bad_alloc&)
+	{
+		return false;
+	}
+	return true;
+}
+
+// add a tile missing from the layer, false when out of memory and the layer is unchanged
+bool PaintLayer::Insert(const PaintTile& tile)
+{
+	size_t count = tiles_.size();
+	try
+	{
+		tiles_.push_back(tile);
+		index_[Key(tile.x, tile.y)] = (unsigned int)count;
+	}
+	catch (const bad_alloc&)
+	{
+		tiles_.resize(count);
+		return false;
+	}
+	return true;
+}
+
+// the last tile takes the place of tile i, its pixels are left to the caller
+void PaintLayer::Remove(size_t i)
+{
+	index_.erase(Key(tiles_[i].x, tiles_[i].y));
+	if (i + 1 < tiles_.size())
+	{
+		tiles_[i] = tiles_.back();
+		index_[Key(tiles_[i].x, tiles_[i].y)] = (unsigned int)i;
+	}
+	tiles_.pop_back();
+}
+
+// The brush is the set of points within radius of the segment, a convex shape, so each pixel row
+// it touches is one span: the hull of where the row crosses the two end discs and the band between.
+bool PaintLayer::PaintLine(const Vector2& a, const Vector2& b, float radius, const Color& color)
+{
+	if (radius <= 0) return true;
+	version_ = ++last_paint_version;
+	Pixel pixel = PackColor(color);
+	double r = radius;
+	double dx = (double)b.x - a.x;
+	double dy = (double)b.y - a.y;
+	double length = sqrt(dx * dx + dy * dy);
+	double top = max(min((double)a.y, (double)b.y) - r, -(double)PAINT_LIMIT);
+	double bottom = min(max((double)a.y, (double)b.y) + r, (double)PAINT_LIMIT);
+	for (double row = floor(top); row < bottom; row++)
+	{
+		double cy = row + 0.5;
+		double lo = HUGE_VAL;
+		double hi = -HUGE_VAL;
+		const Vector2* ends[2] = { &a, &b };
+		for (int e = 0; e < 2; e++)
+		{
+			double ey = cy - ends[e]->y;
+			if (ey * ey > r * r) continue;
+			double half = sqrt(r * r - ey * ey);
+			lo = min(lo, ends[e]->x - half);
+			hi = max(hi, ends[e]->x + half);
+		}
+		if (length > 0)
+		{
+			// x where the row is within radius of the line through a and b, then between a and b
+			double band_lo = -HUGE_VAL;
+			double band_hi = HUGE_VAL;
+			double across = dx * (cy - a.y); // cross product with (x - a.x, cy - a.y) is across - dy * (x - a.x)
+			double along = dy * (cy - a.y); // dot product is dx * (x - a.x) + along
+			if (dy != 0)
+			{
+				double x0 = a.x + (across - r * length) / dy;
+				double x1 = a.x + (across + r * length) / dy;
+				band_lo = min(x0, x1);
+				band_hi = max(x0, x1);
+			}
+			else if (fabs(across) > r * length)
+				band_lo = HUGE_VAL;
+			if (dx != 0)
+			{
+				double x0 = a.x - along / dx;
+				double x1 = a.x + (length * length - along) / dx;
+				band_lo = max(band_lo, min(x0, x1));
+				band_hi = min(band_hi, max(x0, x1));
+			}
+			else if (along < 0 || along > length * length)
+				band_lo = HUGE_VAL;
+			if (band_lo <= band_hi)
+			{
+				lo = min(lo, band_lo);
+				hi = max(hi, band_hi);
+			}
+		}
+		// pixels whose centers are inside
+		lo = max(ceil(lo - 0.5), -(double)PAINT_LIMIT);
+		hi = min(floor(hi - 0.5), (double)PAINT_LIMIT - 1);
+		if (lo > hi) continue;
+		if (!Span((int)row, (int)lo, (int)hi, pixel)) return false;
+	}
+	return true;
+}
+
+bool PaintLayer::Span(int y, int x0, int x1, Pixel pixel)
+{
+	int tile_y = y >> PAINT_TILE_SHIFT;
+	size_t offset = (size_t)(y & (PAINT_TILE_SIZE - 1)) * PAINT_TILE_SIZE;
+	for (int x = x0; x <= x1; )
+	{
+		int tile_x = x >> PAINT_TILE_SHIFT;
+		int end = min(x1 + 1, (tile_x + 1) * PAINT_TILE_SIZE);
+		Pixel* pixels = Writable(tile_x, tile_y);
+		if (pixels == NULL) return false;
+		FillPixels(pixels + offset + (x & (PAINT_TILE_SIZE - 1)), end - x, pixel);
+		x = end;
+	}
+	return true;
+}
+
+// pixels x1 to x2 of row y to fill from, found next to filled pixels of row y - dy
+struct FillSeed
+{
+	int x1;
+	int x2;
+	int y;
+	int dy;
+};
+// filled run of row y, in pixels of the fill image
+struct FillSpan
+{
+	int y;
+	int x0;
+	int x1;
+};
+
+// The image is filled with the span algorithm of Smith and Heckbert: a seed is a run of a row to
+// look at, every run filled from it pushes the runs above and below it that can be reached,
+// including those reached only by going back around an obstacle. No pixel is tested more than a
+// few times and the stack holds runs, not pixels.
+bool PaintLayer::Fill(const Scene& scene, const Vector2& seed, const Rect& region, const Color& color)
+{
+	double half = PAINT_FILL_MAX_SIDE / 2;
+	double seed_x = floor((double)seed.x);
+	double seed_y = floor((double)seed.y);
+	double left = max(max(floor((double)region.left), seed_x - half), -(double)PAINT_LIMIT);
+	double top = max(max(floor((double)region.top), seed_y - half), -(double)PAINT_LIMIT);
+	double right = min(min(ceil((double)region.right), seed_x + half), (double)PAINT_LIMIT);
+	double bottom = min(min(ceil((double)region.bottom), seed_y + half), (double)PAINT_LIMIT);
+	if (!(seed_x >= left && seed_x < right && seed_y >= top && seed_y < bottom)) return false;
+	int w = (int)(right - left);
+	int h = (int)(bottom - top);
+	// what is drawn there, shapes and paint as a window shows them at scale 1
+	View view;
+	view.Set(left, top, 1);
+	Framebuffer& image = fill_image_;
+	image.Resize(w, h);
+	fill_renderer_.Draw(scene, view, &image);
+	Draw(view, &image);
+	int x = (int)(seed_x - left);
+	int y = (int)(seed_y - top);
+	Pixel inside = image.Row(y)[x];
+	Pixel filled = PackColor(color);
+	if (inside == filled) return false;
+
+	vector<FillSpan> spans;
+	vector<FillSeed> stack;
+	FillSeed first = { x, x, y, 1 };
+	stack.push_back(first);
+	FillSeed second = { x, x, y - 1, -1 };
+	stack.push_back(second);
+	while (!stack.empty())
+	{
+		FillSeed s = stack.back();
+		stack.pop_back();
+		if (s.y < 0 || s.y >= h) continue;
+		Pixel* row = image.Row(s.y);
+		int x1 = s.x1;
+		x = x1;
+		if (row[x] == inside)
+		{
+			// the run reaches left of the seed, what is behind it is looked at from the other side
+			while (x > 0 && row[x - 1] == inside)
+				row[--x] = filled;
+			if (x < x1)
+			{
+				FillSeed back = { x, x1 - 1, s.y - s.dy, -s.dy };
+				stack.push_back(back);
+			}
+		}
+		while (x1 <= s.x2)
+		{
+			int end = x1;
+			while (end < w && row[end] == inside)
+				end++;
+			if (end > x1)
+				FillPixels(row + x1, end - x1, filled);
+			x1 = end;
+			if (x1 > x)
+			{
+				FillSeed next = { x, x1 - 1, s.y + s.dy, s.dy };
+				stack.push_back(next);
+				FillSpan span = { s.y, x, x1 - 1 };
+				spans.push_back(span);
+			}
+			if (x1 - 1 > s.x2)
+			{
+				FillSeed back = { s.x2 + 1, x1 - 1, s.y - s.dy, -s.dy };
+				stack.push_back(back);
+			}
+			x1++;
+			while (x1 < s.x2 && row[x1] != inside)
+				x1++;
+			x = x1;
+		}
+	}
+
+	version_ = ++last_paint_version;
+	for (size_t i = 0; i < spans.size(); i++)
+		if (!Span(spans[i].y + (int)top, spans[i].x0 + (int)left, spans[i].x1 + (int)left, filled))
+			return false;
+	return true;
+}
+
+void PaintLayer::BeginEdit()
+{
+	FreeCopies(&before_);
+	edit_version_ = last_paint_version;
+	editing_ = true;
+}
+
+void PaintLayer::EndEdit(vector<PaintTileCopy>* before)
+{
+	before->swap(before_);
+	before_.clear();
+	editing_ = false;
+}
+
+// The tiles missing from the layer are added first, the only part that can run out of memory,
+// then they are told from the others by holding the pixels of their copy
+bool PaintLayer::Exchange(vector<PaintTileCopy>* copies)
+{
+	size_t count = tiles_.size();
+	for (size_t c = 0; c < copies->size(); c++)
+	{
+		const PaintTileCopy& copy = (*copies)[c];
+		PaintTile tile = { copy.x, copy.y, copy.pixels, 0 };
+		if (copy.pixels == NULL || Find(copy.x, copy.y) >= 0 || Insert(tile)) continue;
+		while (tiles_.size() > count)
+			Remove(tiles_.size() - 1);
+		return false;
+	}
+	version_ = ++last_paint_version;
+	for (size_t c = 0; c < copies->size(); c++)
+	{
+		PaintTileCopy& copy = (*copies)[c];
+		int i = Find(copy.x, copy.y);
+		if (i < 0) continue;
+		Pixel* pixels = tiles_[i].pixels;
+		if (copy.pixels != NULL)
+		{
+			tiles_[i].pixels = copy.pixels;
+			tiles_[i].version = version_;
+		}
+		else
+			Remove(i);
+		copy.pixels = pixels == copy.pixels ? NULL : pixels;
+	}
+	return true;
+}
+
+bool PaintLayer::SetTile(int x, int y, const Pixel* pixels)
+{
+	version_ = ++last_paint_version;
+	int i = Find(x, y);
+	if (pixels == NULL)
+	{
+		if (i >= 0)
+		{
+			free(tiles_[i].pixels);
+			Remove(i);
+		}
+		return true;
+	}
+	if (i < 0)
+	{
+		Pixel* copy = (Pixel*)malloc(PAINT_TILE_BYTES);
+		if (copy == NULL) return false;
+		PaintTile tile = { x, y, copy, version_ };
+		if (!Insert(tile))
+		{
+			free(copy);
+			return false;
+		}
+		i = (int)tiles_.size() - 1;
+	}
+	memcpy(tiles_[i].pixels, pixels, PAINT_TILE_BYTES);
+	tiles_[i].version = version_;
+	return true;
+}
+
+void PaintLayer::FreeCopies(vector<PaintTileCopy>* copies)
+{
+	for (size_t i = 0; i < copies->size(); i++)
+		free((*copies)[i].pixels);
+	copies->clear();
+}
+
+void PaintLayer::Release()
+{
+	for (size_t i = 0; i < tiles_.size(); i++)
+		free(tiles_[i].pixels);
+	vector<PaintTile>().swap(tiles_);
+	index_.clear();
+	FreeCopies(&before_);
+	editing_ = false;
+	version_ = ++last_paint_version;
+}
+
+void PaintLayer::Swap(PaintLayer& other)
+{
+	tiles_.swap(other.tiles_);
+	index_.swap(other.index_);
+	before_.swap(other.before_);
+	swap(edit_version_, other.edit_version_);
+	swap(editing_, other.editing_);
+	version_ = ++last_paint_version;
+	other.version_ = ++last_paint_version;
+}
+
+void PaintLayer::Query(const Rect& rect, vector<unsigned int>* result) const
+{
+	if (tiles_.empty()) return;
+	float limit = (float)PAINT_MAX_TILE;
+	float left = max(floorf(rect.left / PAINT_TILE_SIZE), -limit);
+	float top = max(floorf(rect.top / PAINT_TILE_SIZE), -limit);
+	float right = min(floorf(rect.right / PAINT_TILE_SIZE), limit - 1);
+	float bottom = min(floorf(rect.bottom / PAINT_TILE_SIZE), limit - 1);
+	if (left > right || top > bottom) return;
+	if ((double)(right - left + 1) * (bottom - top + 1) <= tiles_.size())
+	{
+		for (int y = (int)top; y <= (int)bottom; y++)
+			for (int x = (int)left; x <= (int)right; x++)
+			{
+				int i = Find(x, y);
+				if (i >= 0)
+					result->push_back((unsigned int)i);
+			}
+		return;
+	}
+	for (size_t i = 0; i < tiles_.size(); i++)
+		if (tiles_[i].x >= left && tiles_[i].x <= right && tiles_[i].y >= top && tiles_[i].y <= bottom)
+			result->push_back((unsigned int)i);
+}
+
+void PaintLayer::Draw(const View& view, Framebuffer* target) const
+{
+	int w = target->Width();
+	int h = target->Height();
+	vector<unsigned int> visible;
+	Query(view.VisibleRect(w, h), &visible);
+	double scale = view.Scale();
+	vector<int> columns; // tile pixel under each target column, -1 outside the tile
+	for (size_t v = 0; v < visible.size(); v++)
+	{
+		const PaintTile& tile = tiles_[visible[v]];
+		double left = (double)tile.x * PAINT_TILE_SIZE;
+		double top = (double)tile.y * PAINT_TILE_SIZE;
+		// target pixels whose centers fall on the tile
+		int x0 = max((int)ceil((left - view.OriginX()) * scale - 0.5), 0);
+		int x1 = min((int)ceil((left + PAINT_TILE_SIZE - view.OriginX()) * scale - 0.5), w);
+		int y0 = max((int)ceil((top - view.OriginY()) * scale - 0.5), 0);
+		int y1 = min((int)ceil((top + PAINT_TILE_SIZE - view.OriginY()) * scale - 0.5), h);
+		if (x0 >= x1 || y0 >= y1) continue;
+		columns.resize(x1 - x0);
+		for (int x = x0; x < x1; x++)
+		{
+			int i = (int)floor(view.OriginX() + (x + 0.5) / scale - left);
+			columns[x - x0] = i >= 0 && i < PAINT_TILE_SIZE ? i : -1;
+		}
+		// at scale 1 the tile pixels are in a run, e.g. for a fill, and the loop below vectorizes
+		int first = columns[0];
+		bool run = first >= 0 && columns[x1 - x0 - 1] == first + (x1 - x0 - 1);
+		for (int y = y0; y < y1; y++)
+		{
+			int j = (int)floor(view.OriginY() + (y + 0.5) / scale - top);
+			if (j < 0 || j >= PAINT_TILE_SIZE) continue;
+			const Pixel* source = tile.pixels + (size_t)j * PAINT_TILE_SIZE;
+			Pixel* row = target->Row(y);
+			if (run)
+			{
+				source += first - x0;
+				for (int x = x0; x < x1; x++)
+					row[x] = (source[x] >> 24) != 0 ? source[x] : row[x];
+				continue;
+			}
+			for (int x = x0; x < x1; x++)
+			{
+				int i = columns[x - x0];
+				if (i >= 0 && (source[i] >> 24) != 0)
+					row[x] = source[i];
+			}
+		}
+	}
+}
+
+size_t PaintLayer::MemoryUsage() const
+{
+	return tiles_.size() * PAINT_TILE_BYTES + tiles_.capacity() * sizeof(PaintTile) +
+		(size_t)fill_image_.Width() * fill_image_.Height() * sizeof(Pixel) +
+		index_.size() * (sizeof(unsigned long long) + sizeof(unsigned int) + 2 * sizeof(void*)) +
+		index_.bucket_count() * sizeof(void*);
+}
@@ -0,0 +1,96 @@
+#ifndef PAINT_LAYER_H
+#define PAINT_LAYER_H
+
+#include <vector>
+#include <unordered_map>
+#include "Raster.h"
+
+const int PAINT_TILE_SHIFT = 8;
+const int PAINT_TILE_SIZE = 1 << PAINT_TILE_SHIFT; // pixels on a side of a tile
+const size_t PAINT_TILE_BYTES = (size_t)PAINT_TILE_SIZE * PAINT_TILE_SIZE * sizeof(Pixel);
+const float PAINT_LIMIT = 1 << 30; // paint is kept within this many world units of the origin
+const int PAINT_MAX_TILE = (int)(PAINT_LIMIT / PAINT_TILE_SIZE); // tiles are from -PAINT_MAX_TILE to PAINT_MAX_TILE - 1
+const int PAINT_FILL_MAX_SIDE = 4096; // pixels on a side of the square around the seed a fill looks at
+
+// Square of PAINT_TILE_SIZE x PAINT_TILE_SIZE pixels, pixel (i, j) covers the world square
+// from (x * PAINT_TILE_SIZE + i, y * PAINT_TILE_SIZE + j) one unit wide
+struct PaintTile
+{
+	int x;
+	int y;
+	Pixel* pixels; // rows from the top, alpha 0 where nothing is painted
+	int version; // changes whenever the pixels do
+};
+// tile kept for undo, pixels NULL for a tile that did not exist
+struct PaintTileCopy
+{
+	int x;
+	int y;
+	Pixel* pixels;
+};
+
+// Raster paint over the vector shapes, one pixel per world unit. It is stored in tiles that are
+// allocated only where something was painted, so its memory follows the painted area however
+// large the canvas is. Every tile carries a version that changes with its pixels, renderers keep
+// what they uploaded and send only the tiles changed since.
+class PaintLayer
+{
+public:
+	PaintLayer();
+	~PaintLayer() { Release(); }
+	// paint a round opaque brush of radius world units along the segment from a to b,
+	// O(painted pixels). false when out of memory, the rows painted so far stay
+	bool PaintLine(const Vector2& a, const Vector2& b, float radius, const Color& color);
+	// Flood fill: paint the pixels connected to seed that show its color, bounded by anything of
+	// another color the scene and the paint show at one pixel per world unit, by region and by
+	// PAINT_FILL_MAX_SIDE. Spans are filled from an explicit stack, O(pixels of the region).
+	// false when there is nothing to fill, or out of memory with the spans painted so far kept
+	bool Fill(const Scene& scene, const Vector2& seed, const Rect& region, const Color& color);
+	// keep a copy of every tile before its first change from now on
+	void BeginEdit();
+	// stop copying and hand the copies over, the caller owns their pixels
+	void EndEdit(std::vector<PaintTileCopy>* before);
+	// trade the tiles for the copies, the copies then hold what was replaced: an undo that
+	// exchanged again is a redo. O(copies). false when out of memory, nothing is traded then
+	bool Exchange(std::vector<PaintTileCopy>* copies);
+	// replace the pixels of tile (x, y) by a copy of pixels, NULL erases the tile. Not kept for
+	// undo, e.g. paint read from a file. false when out of memory
+	bool SetTile(int x, int y, const Pixel* pixels);
+	void Release(); // erase all paint and free its memory
+	void Swap(PaintLayer& other); // O(1)
+	// position of tile (x, y) in the tiles, -1 when nothing was painted there
+	int Find(int x, int y) const;
+	size_t TileCount() const { return tiles_.size(); }
+	const PaintTile& Tile(size_t i) const { return tiles_[i]; }
+	// append the tiles intersecting rect to result, O(tiles in rect) or O(tiles) if less
+	void Query(const Rect& rect, std::vector<unsigned int>* result) const;
+	// draw the paint in the view over target, nearest pixel
+	void Draw(const View& view, Framebuffer* target) const;
+	int Version() const { return version_; } // changes with any tile
+	size_t MemoryUsage() const;
+	static void FreeCopies(std::vector<PaintTileCopy>* copies);
+	static unsigned long long Key(int x, int y); // one number for tile (x, y)
+private:
+	PaintLayer(const PaintLayer&);
+	PaintLayer& operator=(const PaintLayer&);
+
+	// pixels of tile (x, y) about to change, created if missing. NULL when out of memory, the tile
+	// is left as it was
+	Pixel* Writable(int x, int y);
+	bool Keep(const PaintTileCopy& copy);
+	bool Insert(const PaintTile& tile);
+	bool Span(int y, int x0, int x1, Pixel pixel); // x0 to x1 inclusive, false when out of memory
+	void Remove(size_t i);
+
+	std::vector<PaintTile> tiles_;
+	std::unordered_map<unsigned long long, unsigned int> index_; // tile key to position in tiles_
+	std::vector<PaintTileCopy> before_; // tiles as they were when the edit began
+	int version_;
+	int edit_version_; // tiles of a newer version were copied in this edit already
+	bool editing_;
+	// scratch of Fill, kept so the next fill does not wait for fresh memory
+	Framebuffer fill_image_;
+	SoftwareRenderer fill_renderer_;
+};
+
+#endif
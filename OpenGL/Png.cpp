@@ -0,0 +1,212 @@
+#include "Png.h"
+#include "MappedFile.h"
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+struct CrcTable
+{
+	unsigned int values[256];
+
+	CrcTable()
+	{
+		for (unsigned int n = 0; n < 256; n++)
+		{
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			values[n] = c;
+		}
+	}
+};
+
+static unsigned int Crc(unsigned int crc, const unsigned char* data, size_t size)
+{
+	static const CrcTable table; // made once, also when images are written from several threads
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = table.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static unsigned int Adler(const vector<unsigned char>& data)
+{
+	unsigned int a = 1, b = 0;
+	size_t i = 0;
+	while (i < data.size())
+	{
+		// 5552 bytes is the most that can be summed before b overflows
+		size_t end = data.size() - i < 5552 ? data.size() : i + 5552;
+		for (; i < end; i++)
+		{
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return b << 16 | a;
+}
+
+// deflate bits, least significant bit first
+class BitWriter
+{
+public:
+	BitWriter(vector<unsigned char>* out) { out_ = out; bits_ = 0; count_ = 0; }
+	void Bits(unsigned int value, int n)
+	{
+		bits_ |= (unsigned long long)value << count_;
+		count_ += n;
+		while (count_ >= 8)
+		{
+			out_->push_back((unsigned char)bits_);
+			bits_ >>= 8;
+			count_ -= 8;
+		}
+	}
+	// huffman codes are sent from their most significant bit
+	void Code(unsigned int code, int n)
+	{
+		unsigned int reversed = 0;
+		for (int i = 0; i < n; i++)
+			reversed |= ((code >> i) & 1) << (n - 1 - i);
+		Bits(reversed, n);
+	}
+	void Flush()
+	{
+		if (count_ > 0)
+			out_->push_back((unsigned char)bits_);
+		bits_ = 0;
+		count_ = 0;
+	}
+private:
+	vector<unsigned char>* out_;
+	unsigned long long bits_;
+	int count_;
+};
+
+// fixed huffman literal/length code
+static void Symbol(BitWriter& writer, int symbol)
+{
+	if (symbol < 144) writer.Code(0x30 + symbol, 8);
+	else if (symbol < 256) writer.Code(0x190 + symbol - 144, 9);
+	else if (symbol < 280) writer.Code(symbol - 256, 7);
+	else writer.Code(0xc0 + symbol - 280, 8);
+}
+
+static const int length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const int length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+static void Match(BitWriter& writer, int length, int distance)
+{
+	int code = 28;
+	while (length_base[code] > length)
+		code--;
+	Symbol(writer, 257 + code);
+	writer.Bits(length - length_base[code], length_extra[code]);
+	// distances 1 to 4 are the codes 0 to 3 without extra bits
+	writer.Code(distance - 1, 5);
+}
+
+// one fixed huffman block, repeats at distance 1 and of the previous pixel are the only matches
+static void Deflate(const vector<unsigned char>& data, vector<unsigned char>* out)
+{
+	BitWriter writer(out);
+	writer.Bits(1, 1); // final block
+	writer.Bits(1, 2); // fixed huffman
+	size_t n = data.size();
+	size_t i = 0;
+	while (i < n)
+	{
+		int best_length = 0;
+		int best_distance = 0;
+		for (int distance = 1; distance <= 3; distance += 2)
+		{
+			if (i < (size_t)distance) continue;
+			int length = 0;
+			while (length < 258 && i + length < n && data[i + length] == data[i + length - distance])
+				length++;
+			if (length > best_length)
+			{
+				best_length = length;
+				best_distance = distance;
+			}
+		}
+		if (best_length >= 3)
+		{
+			Match(writer, best_length, best_distance);
+			i += best_length;
+		}
+		else
+		{
+			Symbol(writer, data[i]);
+			i++;
+		}
+	}
+	Symbol(writer, 256);
+	writer.Flush();
+}
+
+static void Put32(unsigned char* p, unsigned int value)
+{
+	p[0] = (unsigned char)(value >> 24);
+	p[1] = (unsigned char)(value >> 16);
+	p[2] = (unsigned char)(value >> 8);
+	p[3] = (unsigned char)value;
+}
+
+static bool WriteChunk(FILE* file, const char* type, const unsigned char* data, size_t size)
+{
+	unsigned char head[8];
+	Put32(head, (unsigned int)size);
+	memcpy(head + 4, type, 4);
+	unsigned char tail[4];
+	Put32(tail, Crc(Crc(0, head + 4, 4), data, size));
+	return fwrite(head, 1, 8, file) == 8 && (size == 0 || fwrite(data, 1, size, file) == size) && fwrite(tail, 1, 4, file) == 4;
+}
+
+bool WritePng(const char* path, const Framebuffer& image)
+{
+	int w = image.Width();
+	int h = image.Height();
+
+	// rows of the up filter, equal rows become zeros that the runs take away
+	vector<unsigned char> filtered;
+	filtered.reserve((size_t)h * (w * 3 + 1));
+	for (int y = 0; y < h; y++)
+	{
+		const unsigned char* row = (const unsigned char*)image.Row(y);
+		const unsigned char* above = y > 0 ? (const unsigned char*)image.Row(y - 1) : NULL;
+		filtered.push_back(y > 0 ? 2 : 0);
+		for (int x = 0; x < w; x++)
+			for (int c = 0; c < 3; c++)
+				filtered.push_back((unsigned char)(row[x * 4 + c] - (above != NULL ? above[x * 4 + c] : 0)));
+	}
+
+	vector<unsigned char> zlib;
+	zlib.push_back(0x78); // deflate, 32K window
+	zlib.push_back(0x01);
+	Deflate(filtered, &zlib);
+	unsigned char adler[4];
+	Put32(adler, Adler(filtered));
+	zlib.insert(zlib.end(), adler, adler + 4);
+
+	unsigned char header[13];
+	Put32(header, w);
+	Put32(header + 4, h);
+	header[8] = 8; // bits per channel
+	header[9] = 2; // RGB
+	header[10] = 0;
+	header[11] = 0;
+	header[12] = 0;
+
+	FILE* file = OpenFile(path, "wb");
+	if (file == NULL) return false;
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	bool ok = fwrite(signature, 1, 8, file) == 8
+		&& WriteChunk(file, "IHDR", header, sizeof(header))
+		&& WriteChunk(file, "IDAT", &zlib[0], zlib.size())
+		&& WriteChunk(file, "IEND", NULL, 0);
+	return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,10 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include "Raster.h"
+
+// Write a framebuffer as an 8 bit RGB PNG. The deflate stream is made here, long runs of equal
+// pixels and rows are coded as matches, which is most of the size of a drawing on a flat background.
+bool WritePng(const char* path, const Framebuffer& image);
+
+#endif
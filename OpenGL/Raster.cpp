@@ -0,0 +1,726 @@
+#include "Raster.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define RASTER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define RASTER_AVX2_FUNCTION
+#else
+// gcc and clang only emit avx2 code in functions marked for it, the rest stays baseline
+#define RASTER_AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef _MSC_VER
+#define RASTER_INLINE __forceinline
+#else
+// code shared by the kernels goes into the avx2 ones too, called it would run baseline instructions
+// with the upper halves of the registers in use, which costs more than the work itself
+#define RASTER_INLINE inline __attribute__((always_inline))
+#endif
+
+using namespace std;
+
+static void FillScalar(Pixel* pixels, size_t count, Pixel pixel)
+{
+	for (size_t i = 0; i < count; i++)
+		pixels[i] = pixel;
+}
+
+// A triangle for the span kernels, its vertices sorted by y. The span of a row lies between the long
+// edge from top to bottom and the short edges through the middle vertex, taken at the row center
+struct TriangleSetup
+{
+	Vector2 top;
+	Vector2 middle;
+	Vector2 bottom;
+	float long_slope; // x per y of the edges
+	float upper_slope;
+	float lower_slope;
+	int first_row; // rows [first_row, end_row) of the band
+	int end_row;
+	float width; // of the target
+};
+
+// a disc for the span kernels, its span of a row is taken at the row center
+struct DiscSetup
+{
+	Vector2 center;
+	float r2;
+	int first_row;
+	int end_row;
+	float width;
+};
+
+// Ceil of v as an int in [0, high], 0 for NaN. The vector kernels do it with their max, min and ceil,
+// written here the way those treat NaN, so every kernel finds the same spans
+static RASTER_INLINE int CeilSpan(float v, float high)
+{
+	v = v > 0 ? v : 0;
+	v = v < high ? v : high;
+	return (int)ceilf(v);
+}
+
+// pixels [first, end) of row y in the triangle, end not above first when none is
+static RASTER_INLINE void TriangleSpan(const TriangleSetup& t, int y, int* first, int* end)
+{
+	float center = y + 0.5f;
+	float x_long = t.top.x + (center - t.top.y) * t.long_slope;
+	float x_short = center < t.middle.y ? t.top.x + (center - t.top.y) * t.upper_slope : t.middle.x + (center - t.middle.y) * t.lower_slope;
+	float left = x_long < x_short ? x_long : x_short;
+	float right = x_long > x_short ? x_long : x_short;
+	*first = CeilSpan(left - 0.5f, t.width);
+	*end = CeilSpan(right - 0.5f, t.width);
+}
+
+static RASTER_INLINE void DiscSpan(const DiscSetup& d, int y, int* first, int* end)
+{
+	float dy = y + 0.5f - d.center.y;
+	float h2 = d.r2 - dy * dy;
+	float half = sqrtf(h2 > 0 ? h2 : 0);
+	*first = CeilSpan(d.center.x - half - 0.5f, d.width);
+	*end = CeilSpan(d.center.x + half - 0.5f, d.width);
+}
+
+static void TriangleScalar(Framebuffer* target, const TriangleSetup& t, Pixel pixel)
+{
+	for (int y = t.first_row; y < t.end_row; y++)
+	{
+		int first, end;
+		TriangleSpan(t, y, &first, &end);
+		if (end > first)
+			FillPixels(target->Row(y) + first, end - first, pixel);
+	}
+}
+
+static void DiscScalar(Framebuffer* target, const DiscSetup& d, Pixel pixel)
+{
+	for (int y = d.first_row; y < d.end_row; y++)
+	{
+		int first, end;
+		DiscSpan(d, y, &first, &end);
+		if (end > first)
+			FillPixels(target->Row(y) + first, end - first, pixel);
+	}
+}
+
+#ifdef RASTER_X86
+static void FillSse2(Pixel* pixels, size_t count, Pixel pixel)
+{
+	__m128i four = _mm_set1_epi32((int)pixel);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i*)(pixels + i), four);
+	for (; i < count; i++)
+		pixels[i] = pixel;
+}
+
+RASTER_AVX2_FUNCTION static void FillAvx2(Pixel* pixels, size_t count, Pixel pixel)
+{
+	__m256i eight = _mm256_set1_epi32((int)pixel);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm256_storeu_si256((__m256i*)(pixels + i), eight);
+		_mm256_storeu_si256((__m256i*)(pixels + i + 8), eight);
+	}
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_si256((__m256i*)(pixels + i), eight);
+	// the tail overlaps pixels already written instead of a scalar loop
+	if (i < count)
+		_mm256_storeu_si256((__m256i*)(pixels + count - 8), eight);
+}
+
+// FillPixels without leaving avx2 code
+RASTER_AVX2_FUNCTION static RASTER_INLINE void SpanAvx2(Pixel* pixels, int count, Pixel pixel)
+{
+	if (count < 8)
+	{
+		for (int i = 0; i < count; i++)
+			pixels[i] = pixel;
+		return;
+	}
+	FillAvx2(pixels, count, pixel);
+}
+
+// CeilSpan of 4 values, sse2 has no ceil: the truncation is one too low where it is below v
+static RASTER_INLINE __m128i CeilSpanSse2(__m128 v, __m128 high)
+{
+	v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), high);
+	__m128i truncated = _mm_cvttps_epi32(v);
+	return _mm_sub_epi32(truncated, _mm_castps_si128(_mm_cmplt_ps(_mm_cvtepi32_ps(truncated), v)));
+}
+
+RASTER_AVX2_FUNCTION static RASTER_INLINE __m256i CeilSpanAvx2(__m256 v, __m256 high)
+{
+	v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), high);
+	return _mm256_cvttps_epi32(_mm256_ceil_ps(v));
+}
+
+// TriangleSpan of 4 rows at a time, the lanes past the last row are left unused
+static void TriangleSse2(Framebuffer* target, const TriangleSetup& t, Pixel pixel)
+{
+	__m128 top_x = _mm_set1_ps(t.top.x), top_y = _mm_set1_ps(t.top.y);
+	__m128 middle_x = _mm_set1_ps(t.middle.x), middle_y = _mm_set1_ps(t.middle.y);
+	__m128 long_slope = _mm_set1_ps(t.long_slope);
+	__m128 upper_slope = _mm_set1_ps(t.upper_slope);
+	__m128 lower_slope = _mm_set1_ps(t.lower_slope);
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 width = _mm_set1_ps(t.width);
+	for (int y = t.first_row; y < t.end_row; y += 4)
+	{
+		__m128 center = _mm_add_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(y), _mm_setr_epi32(0, 1, 2, 3))), half);
+		__m128 from_top = _mm_sub_ps(center, top_y);
+		__m128 x_long = _mm_add_ps(top_x, _mm_mul_ps(from_top, long_slope));
+		__m128 x_upper = _mm_add_ps(top_x, _mm_mul_ps(from_top, upper_slope));
+		__m128 x_lower = _mm_add_ps(middle_x, _mm_mul_ps(_mm_sub_ps(center, middle_y), lower_slope));
+		__m128 upper = _mm_cmplt_ps(center, middle_y);
+		__m128 x_short = _mm_or_ps(_mm_and_ps(upper, x_upper), _mm_andnot_ps(upper, x_lower));
+		int first[4], end[4];
+		_mm_storeu_si128((__m128i*)first, CeilSpanSse2(_mm_sub_ps(_mm_min_ps(x_long, x_short), half), width));
+		_mm_storeu_si128((__m128i*)end, CeilSpanSse2(_mm_sub_ps(_mm_max_ps(x_long, x_short), half), width));
+		int rows = min(4, t.end_row - y);
+		for (int i = 0; i < rows; i++)
+			if (end[i] > first[i])
+				FillPixels(target->Row(y + i) + first[i], end[i] - first[i], pixel);
+	}
+}
+
+RASTER_AVX2_FUNCTION static void TriangleAvx2(Framebuffer* target, const TriangleSetup& t, Pixel pixel)
+{
+	__m256 top_x = _mm256_set1_ps(t.top.x), top_y = _mm256_set1_ps(t.top.y);
+	__m256 middle_x = _mm256_set1_ps(t.middle.x), middle_y = _mm256_set1_ps(t.middle.y);
+	__m256 long_slope = _mm256_set1_ps(t.long_slope);
+	__m256 upper_slope = _mm256_set1_ps(t.upper_slope);
+	__m256 lower_slope = _mm256_set1_ps(t.lower_slope);
+	__m256 half = _mm256_set1_ps(0.5f);
+	__m256 width = _mm256_set1_ps(t.width);
+	for (int y = t.first_row; y < t.end_row; y += 8)
+	{
+		__m256 center = _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(y), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7))), half);
+		__m256 from_top = _mm256_sub_ps(center, top_y);
+		__m256 x_long = _mm256_add_ps(top_x, _mm256_mul_ps(from_top, long_slope));
+		__m256 x_upper = _mm256_add_ps(top_x, _mm256_mul_ps(from_top, upper_slope));
+		__m256 x_lower = _mm256_add_ps(middle_x, _mm256_mul_ps(_mm256_sub_ps(center, middle_y), lower_slope));
+		__m256 x_short = _mm256_blendv_ps(x_lower, x_upper, _mm256_cmp_ps(center, middle_y, _CMP_LT_OQ));
+		int first[8], end[8];
+		_mm256_storeu_si256((__m256i*)first, CeilSpanAvx2(_mm256_sub_ps(_mm256_min_ps(x_long, x_short), half), width));
+		_mm256_storeu_si256((__m256i*)end, CeilSpanAvx2(_mm256_sub_ps(_mm256_max_ps(x_long, x_short), half), width));
+		int rows = min(8, t.end_row - y);
+		for (int i = 0; i < rows; i++)
+			SpanAvx2(target->Row(y + i) + first[i], end[i] - first[i], pixel);
+	}
+}
+
+static void DiscSse2(Framebuffer* target, const DiscSetup& d, Pixel pixel)
+{
+	__m128 center_x = _mm_set1_ps(d.center.x), center_y = _mm_set1_ps(d.center.y);
+	__m128 r2 = _mm_set1_ps(d.r2);
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 width = _mm_set1_ps(d.width);
+	for (int y = d.first_row; y < d.end_row; y += 4)
+	{
+		__m128 center = _mm_add_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(y), _mm_setr_epi32(0, 1, 2, 3))), half);
+		__m128 dy = _mm_sub_ps(center, center_y);
+		__m128 span = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(r2, _mm_mul_ps(dy, dy)), _mm_setzero_ps()));
+		int first[4], end[4];
+		_mm_storeu_si128((__m128i*)first, CeilSpanSse2(_mm_sub_ps(_mm_sub_ps(center_x, span), half), width));
+		_mm_storeu_si128((__m128i*)end, CeilSpanSse2(_mm_sub_ps(_mm_add_ps(center_x, span), half), width));
+		int rows = min(4, d.end_row - y);
+		for (int i = 0; i < rows; i++)
+			if (end[i] > first[i])
+				FillPixels(target->Row(y + i) + first[i], end[i] - first[i], pixel);
+	}
+}
+
+RASTER_AVX2_FUNCTION static void DiscAvx2(Framebuffer* target, const DiscSetup& d, Pixel pixel)
+{
+	__m256 center_x = _mm256_set1_ps(d.center.x), center_y = _mm256_set1_ps(d.center.y);
+	__m256 r2 = _mm256_set1_ps(d.r2);
+	__m256 half = _mm256_set1_ps(0.5f);
+	__m256 width = _mm256_set1_ps(d.width);
+	for (int y = d.first_row; y < d.end_row; y += 8)
+	{
+		__m256 center = _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(y), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7))), half);
+		__m256 dy = _mm256_sub_ps(center, center_y);
+		__m256 span = _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(r2, _mm256_mul_ps(dy, dy)), _mm256_setzero_ps()));
+		int first[8], end[8];
+		_mm256_storeu_si256((__m256i*)first, CeilSpanAvx2(_mm256_sub_ps(_mm256_sub_ps(center_x, span), half), width));
+		_mm256_storeu_si256((__m256i*)end, CeilSpanAvx2(_mm256_sub_ps(_mm256_add_ps(center_x, span), half), width));
+		int rows = min(8, d.end_row - y);
+		for (int i = 0; i < rows; i++)
+			SpanAvx2(target->Row(y + i) + first[i], end[i] - first[i], pixel);
+	}
+}
+
+static bool CpuHasAvx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init(); // may run before the constructors that normally do this
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+typedef void (*FillFunction)(Pixel* pixels, size_t count, Pixel pixel);
+typedef void (*TriangleFunction)(Framebuffer* target, const TriangleSetup& t, Pixel pixel);
+typedef void (*DiscFunction)(Framebuffer* target, const DiscSetup& d, Pixel pixel);
+
+static RasterKernel BestRasterKernel()
+{
+#ifdef RASTER_X86
+	return CpuHasAvx2() ? RASTER_AVX2 : RASTER_SSE2;
+#else
+	return RASTER_SCALAR;
+#endif
+}
+
+static FillFunction FillFor(RasterKernel kernel)
+{
+#ifdef RASTER_X86
+	if (kernel == RASTER_AVX2) return FillAvx2;
+	if (kernel == RASTER_SSE2) return FillSse2;
+#endif
+	return FillScalar;
+}
+
+static TriangleFunction TriangleFor(RasterKernel kernel)
+{
+#ifdef RASTER_X86
+	if (kernel == RASTER_AVX2) return TriangleAvx2;
+	if (kernel == RASTER_SSE2) return TriangleSse2;
+#endif
+	return TriangleScalar;
+}
+
+static DiscFunction DiscFor(RasterKernel kernel)
+{
+#ifdef RASTER_X86
+	if (kernel == RASTER_AVX2) return DiscAvx2;
+	if (kernel == RASTER_SSE2) return DiscSse2;
+#endif
+	return DiscScalar;
+}
+
+static RasterKernel raster_kernel = BestRasterKernel();
+static FillFunction fill_pixels = FillFor(raster_kernel);
+static TriangleFunction fill_triangle = TriangleFor(raster_kernel);
+static DiscFunction fill_disc = DiscFor(raster_kernel);
+
+bool RasterKernelSupported(RasterKernel kernel)
+{
+	// every x86 cpu that runs the app has sse2, avx2 is asked of the cpu
+	return kernel == RASTER_SCALAR || (kernel == RASTER_SSE2 && BestRasterKernel() != RASTER_SCALAR) || (kernel == RASTER_AVX2 && BestRasterKernel() == RASTER_AVX2);
+}
+
+bool SetRasterKernel(RasterKernel kernel)
+{
+	if (!RasterKernelSupported(kernel)) return false;
+	raster_kernel = kernel;
+	fill_pixels = FillFor(kernel);
+	fill_triangle = TriangleFor(kernel);
+	fill_disc = DiscFor(kernel);
+	return true;
+}
+
+RasterKernel CurrentRasterKernel()
+{
+	return raster_kernel;
+}
+
+const char* RasterKernelName(RasterKernel kernel)
+{
+	static const char* names[RASTER_KERNEL_COUNT] = { "scalar", "sse2", "avx2" };
+	return kernel >= 0 && kernel < RASTER_KERNEL_COUNT ? names[kernel] : "unknown";
+}
+
+void FillPixels(Pixel* pixels, size_t count, Pixel pixel)
+{
+	// most spans of small shapes are a few pixels, not worth a call
+	if (count < 8)
+	{
+		for (size_t i = 0; i < count; i++)
+			pixels[i] = pixel;
+		return;
+	}
+	fill_pixels(pixels, count, pixel);
+}
+
+// ceil of v as an int in [low, high], v may be far outside of the int range when zoomed in
+static inline int CeilClamp(float v, int low, int high)
+{
+	if (!(v > low)) return low;
+	if (!(v < high)) return high;
+	return (int)ceilf(v);
+}
+
+// draws shapes into rows [top, bottom) of the target, every thread has its own band
+class BandRasterizer
+{
+public:
+	BandRasterizer(Framebuffer* target, const View& view, const PointStyle& points, int top, int bottom);
+	void DrawShape(const ShapeData& shape);
+private:
+	Vector2 ToPixel(const Vector2& v) const;
+	void Plot(int x, int y, Pixel pixel);
+	void Span(int y, int x0, int x1, Pixel pixel); // [x0, x1] of row y, already clipped
+	void Line(Vector2 a, Vector2 b, Pixel pixel);
+	void Triangle(const Vector2& a, const Vector2& b, const Vector2& c, Pixel pixel);
+	void Disc(const Vector2& center, float radius, Pixel pixel);
+	void Square(const Vector2& center, float side, Pixel pixel);
+
+	Framebuffer* target_;
+	int top_;
+	int bottom_;
+	double origin_x_;
+	double origin_y_;
+	double scale_;
+	float lod_scale_;
+	PointStyle points_;
+};
+
+BandRasterizer::BandRasterizer(Framebuffer* target, const View& view, const PointStyle& points, int top, int bottom)
+{
+	points_ = points;
+	target_ = target;
+	top_ = top;
+	bottom_ = bottom;
+	origin_x_ = view.OriginX();
+	origin_y_ = view.OriginY();
+	scale_ = view.Scale();
+	lod_scale_ = view.LodScale();
+}
+
+inline Vector2 BandRasterizer::ToPixel(const Vector2& v) const
+{
+	Vector2 p;
+	p.x = (float)((v.x - origin_x_) * scale_);
+	p.y = (float)((v.y - origin_y_) * scale_);
+	return p;
+}
+
+void BandRasterizer::DrawShape(const ShapeData& shape)
+{
+	Pixel pixel = PackColor(shape.color);
+	bool filled = (shape.flags & SHAPE_FILLED) != 0;
+	if (shape.type == SHAPE_STROKE)
+	{
+		Vector2 a = ToPixel(shape.points[0]);
+		for (unsigned int i = 1; i < shape.point_count; i++)
+		{
+			Vector2 b = ToPixel(shape.points[i]);
+			Line(a, b, pixel);
+			a = b;
+		}
+		return;
+	}
+	Vector2 v[4];
+	int n = shape.type == SHAPE_LINE ? 2 : shape.type == SHAPE_TRIANGLE ? 3 : shape.type == SHAPE_QUAD ? 4 : 1;
+	for (int i = 0; i < n; i++)
+		v[i] = ToPixel(shape.vertices[i]);
+	switch (shape.type)
+	{
+	case SHAPE_POINT:
+		// larger points cover the pixels whose centers they cover, like GL points
+		if (points_.size > 1 && points_.shape == POINT_ROUND)
+			Disc(v[0], points_.size / 2, pixel);
+		else if (points_.size > 1)
+			Square(v[0], points_.size, pixel);
+		else if (v[0].x >= 0 && v[0].y >= top_ && v[0].x < target_->Width() && v[0].y < bottom_)
+			Plot((int)v[0].x, (int)v[0].y, pixel);
+		break;
+	case SHAPE_LINE:
+		Line(v[0], v[1], pixel);
+		break;
+	case SHAPE_TRIANGLE: case SHAPE_QUAD:
+		if (filled)
+		{
+			// a quad is filled as the two triangles GL_QUADS is split into
+			Triangle(v[0], v[1], v[2], pixel);
+			if (n == 4)
+				Triangle(v[0], v[2], v[3], pixel);
+		}
+		else
+		{
+			for (int i = 0; i < n; i++)
+				Line(v[i], v[(i + 1) % n], pixel);
+		}
+		break;
+	case SHAPE_CIRCLE:
+	{
+		float radius = (float)(shape.radius * scale_);
+		if (filled)
+		{
+			Disc(v[0], radius, pixel);
+			break;
+		}
+		int sides;
+		const Vector2* unit = UnitCircle(CircleLodLevel(shape.radius * lod_scale_), &sides);
+		for (int i = 0; i < sides; i++)
+		{
+			Vector2 a = { v[0].x + radius * unit[i].x, v[0].y + radius * unit[i].y };
+			Vector2 b = { v[0].x + radius * unit[i + 1].x, v[0].y + radius * unit[i + 1].y };
+			Line(a, b, pixel);
+		}
+		break;
+	}
+	}
+}
+
+inline void BandRasterizer::Plot(int x, int y, Pixel pixel)
+{
+	if (x >= 0 && y >= top_ && x < target_->Width() && y < bottom_)
+		target_->Row(y)[x] = pixel;
+}
+
+void BandRasterizer::Span(int y, int x0, int x1, Pixel pixel)
+{
+	if (x1 >= x0)
+		FillPixels(target_->Row(y) + x0, x1 - x0 + 1, pixel);
+}
+
+// One pixel line, clipped to the band first so far away endpoints cost nothing. The pixel of each
+// column (or row when steep) is taken from the line at the column center, wherever it was clipped,
+// so the bands of a frame meet without seams.
+void BandRasterizer::Line(Vector2 a, Vector2 b, Pixel pixel)
+{
+	int w = target_->Width();
+	float t0 = 0, t1 = 1;
+	float dx = b.x - a.x;
+	float dy = b.y - a.y;
+	float p[4] = { -dx, dx, -dy, dy };
+	float q[4] = { a.x, w - a.x, a.y - top_, bottom_ - a.y };
+	for (int i = 0; i < 4; i++)
+	{
+		if (p[i] == 0)
+		{
+			// the right and bottom edges belong to the next pixel, maybe in the next band
+			if (q[i] < 0 || (q[i] == 0 && (i & 1))) return;
+			continue;
+		}
+		float t = q[i] / p[i];
+		if (p[i] < 0)
+		{
+			if (t > t1) return;
+			if (t > t0) t0 = t;
+		}
+		else
+		{
+			if (t < t0) return;
+			if (t < t1) t1 = t;
+		}
+	}
+	if (dx == 0 && dy == 0)
+	{
+		Plot((int)floorf(a.x), (int)floorf(a.y), pixel);
+		return;
+	}
+	Pixel* pixels = target_->Row(0);
+	if (fabsf(dx) >= fabsf(dy))
+	{
+		float slope = dy / dx;
+		float x_start = a.x + t0 * dx;
+		float x_end = a.x + t1 * dx;
+		if (x_start > x_end) swap(x_start, x_end);
+		int first = max((int)floorf(x_start), 0);
+		int last = min((int)floorf(x_end), w - 1);
+		for (int x = first; x <= last; x++)
+		{
+			float y = a.y + (x + 0.5f - a.x) * slope;
+			if (y >= top_ && y < bottom_)
+				pixels[(size_t)y * w + x] = pixel;
+		}
+	}
+	else
+	{
+		float slope = dx / dy;
+		float y_start = a.y + t0 * dy;
+		float y_end = a.y + t1 * dy;
+		if (y_start > y_end) swap(y_start, y_end);
+		int first = max((int)floorf(y_start), top_);
+		int last = min((int)floorf(y_end), bottom_ - 1);
+		for (int y = first; y <= last; y++)
+		{
+			float x = a.x + (y + 0.5f - a.y) * slope;
+			if (x >= 0 && x < w)
+				pixels[(size_t)y * w + (size_t)x] = pixel;
+		}
+	}
+}
+
+// Rows whose pixel center lies in the triangle, filled from the left to the right edge. The edges are
+// taken at every row center on their own rather than stepped from row to row, so the kernels can
+// take several rows at once and every band of a frame finds the same spans
+void BandRasterizer::Triangle(const Vector2& a, const Vector2& b, const Vector2& c, Pixel pixel)
+{
+	const Vector2* v[3] = { &a, &b, &c };
+	// sort by y
+	if (v[1]->y < v[0]->y) swap(v[0], v[1]);
+	if (v[2]->y < v[1]->y) swap(v[1], v[2]);
+	if (v[1]->y < v[0]->y) swap(v[0], v[1]);
+	TriangleSetup t;
+	t.top = *v[0];
+	t.middle = *v[1];
+	t.bottom = *v[2];
+	if (t.bottom.y - t.top.y <= 0) return;
+
+	t.first_row = CeilClamp(t.top.y - 0.5f, top_, bottom_);
+	t.end_row = CeilClamp(t.bottom.y - 0.5f, top_, bottom_);
+	t.long_slope = (t.bottom.x - t.top.x) / (t.bottom.y - t.top.y);
+	t.upper_slope = t.middle.y > t.top.y ? (t.middle.x - t.top.x) / (t.middle.y - t.top.y) : 0;
+	t.lower_slope = t.bottom.y > t.middle.y ? (t.bottom.x - t.middle.x) / (t.bottom.y - t.middle.y) : 0;
+	t.width = (float)target_->Width();
+	fill_triangle(target_, t, pixel);
+}
+
+void BandRasterizer::Disc(const Vector2& center, float radius, Pixel pixel)
+{
+	DiscSetup d;
+	d.center = center;
+	d.r2 = radius * radius;
+	d.first_row = CeilClamp(center.y - radius - 0.5f, top_, bottom_);
+	d.end_row = CeilClamp(center.y + radius - 0.5f, top_, bottom_);
+	d.width = (float)target_->Width();
+	fill_disc(target_, d, pixel);
+}
+
+void BandRasterizer::Square(const Vector2& center, float side, Pixel pixel)
+{
+	int w = target_->Width();
+	int y_first = CeilClamp(center.y - side / 2 - 0.5f, top_, bottom_);
+	int y_end = CeilClamp(center.y + side / 2 - 0.5f, top_, bottom_);
+	int x_first = CeilClamp(center.x - side / 2 - 0.5f, 0, w);
+	int x_end = CeilClamp(center.x + side / 2 - 0.5f, 0, w);
+	for (int y = y_first; y < y_end; y++)
+		Span(y, x_first, x_end - 1, pixel);
+}
+
+// shapes given by z, or every shape when z is NULL
+static void DrawBand(const Scene& scene, const unsigned int* z, size_t count, BandRasterizer band)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		ShapeData shape = scene.Get(z != NULL ? z[i] : i);
+		if (!(shape.flags & SHAPE_INVISIBLE))
+			band.DrawShape(shape);
+	}
+}
+
+SoftwareRenderer::SoftwareRenderer()
+{
+	threads_ = max((int)thread::hardware_concurrency(), 1);
+	frame_ = 0;
+	scene_ = NULL;
+	view_ = NULL;
+	target_ = NULL;
+	z_ = NULL;
+	count_ = 0;
+	bands_ = 0;
+	pending_ = 0;
+	stopping_ = false;
+}
+
+SoftwareRenderer::~SoftwareRenderer()
+{
+	{
+		lock_guard<mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	start_.notify_all();
+	for (size_t i = 0; i < workers_.size(); i++)
+		workers_[i].join();
+}
+
+void SoftwareRenderer::Work(int band)
+{
+	unsigned long long seen = 0;
+	unique_lock<mutex> lock(mutex_);
+	while (true)
+	{
+		start_.wait(lock, [&] { return stopping_ || frame_ != seen; });
+		if (stopping_) return;
+		seen = frame_;
+		// a frame of fewer bands leaves this thread waiting for the next one
+		if (band >= bands_) continue;
+		const Scene& scene = *scene_;
+		BandRasterizer rasterizer(target_, *view_, scene.GetPointStyle(), target_->Height() * band / bands_, target_->Height() * (band + 1) / bands_);
+		const unsigned int* z = z_;
+		size_t count = count_;
+		lock.unlock();
+		DrawBand(scene, z, count, rasterizer);
+		lock.lock();
+		if (--pending_ == 0)
+			done_.notify_one();
+	}
+}
+
+void SoftwareRenderer::SetThreads(int threads)
+{
+	threads_ = max(threads, 1);
+}
+
+void SoftwareRenderer::Draw(const Scene& scene, const View& view, Framebuffer* target)
+{
+	target->Clear(PackColor(Color(0, 0, 0)));
+
+	const unsigned int* z = NULL;
+	size_t count = scene.Count();
+	Rect visible = view.VisibleRect(target->Width(), target->Height());
+	// points just outside reach into the frame when they are large
+	float margin = (float)(scene.GetPointStyle().size / 2 / view.Scale());
+	visible.left -= margin;
+	visible.top -= margin;
+	visible.right += margin;
+	visible.bottom += margin;
+	if (!RectContains(visible, scene.Bounds()))
+	{
+		visible_.clear();
+		scene.Query(visible, &visible_);
+		sort(visible_.begin(), visible_.end());
+		z = visible_.empty() ? NULL : &visible_[0];
+		count = visible_.size();
+	}
+
+	// small frames are not worth starting threads for
+	const size_t SHAPES_PER_THREAD = 4096;
+	const int ROWS_PER_THREAD = 32;
+	int bands = (int)min((size_t)threads_, count / SHAPES_PER_THREAD + 1);
+	bands = max(min(bands, target->Height() / ROWS_PER_THREAD), 1);
+	if (bands > 1)
+	{
+		// the workers are kept from frame to frame, only the bands never drawn before start one
+		while ((int)workers_.size() < bands - 1)
+			workers_.push_back(thread(&SoftwareRenderer::Work, this, (int)workers_.size() + 1));
+		{
+			lock_guard<mutex> lock(mutex_);
+			scene_ = &scene;
+			view_ = &view;
+			target_ = target;
+			z_ = z;
+			count_ = count;
+			bands_ = bands;
+			pending_ = bands - 1;
+			frame_++;
+		}
+		start_.notify_all();
+	}
+	DrawBand(scene, z, count, BandRasterizer(target, view, scene.GetPointStyle(), 0, target->Height() / bands));
+	if (bands > 1)
+	{
+		// the frame is done when every band is, the scene and target may change after that
+		unique_lock<mutex> lock(mutex_);
+		done_.wait(lock, [&] { return pending_ == 0; });
+	}
+}
@@ -0,0 +1,97 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Scene.h"
+#include "View.h"
+
+// pixel of a framebuffer, bytes r, g, b, a in memory
+typedef unsigned int Pixel;
+
+// Pixel kernels of the software renderer: they find the spans of filled triangles and discs several
+// rows at a time and fill spans. All of them draw the same pixels, the fastest one the CPU supports
+// is used by default
+enum RasterKernel
+{
+	RASTER_SCALAR,
+	RASTER_SSE2,
+	RASTER_AVX2,
+	RASTER_KERNEL_COUNT
+};
+bool RasterKernelSupported(RasterKernel kernel);
+// false when the CPU lacks it, the current kernel is kept then
+bool SetRasterKernel(RasterKernel kernel);
+RasterKernel CurrentRasterKernel();
+const char* RasterKernelName(RasterKernel kernel);
+// set count pixels to pixel with the current kernel
+void FillPixels(Pixel* pixels, size_t count, Pixel pixel);
+
+// image of the software renderer, rows from top to bottom
+class Framebuffer
+{
+public:
+	Framebuffer() { w_ = 0; h_ = 0; }
+	void Resize(int w, int h)
+	{
+		w_ = w;
+		h_ = h;
+		pixels_.resize((size_t)w * h);
+	}
+	void Clear(Pixel pixel)
+	{
+		if (!pixels_.empty())
+			FillPixels(&pixels_[0], pixels_.size(), pixel);
+	}
+	int Width() const { return w_; }
+	int Height() const { return h_; }
+	Pixel* Row(int y) { return &pixels_[(size_t)y * w_]; }
+	const Pixel* Row(int y) const { return &pixels_[(size_t)y * w_]; }
+private:
+	int w_;
+	int h_;
+	std::vector<Pixel> pixels_;
+};
+
+// Draws a scene into a framebuffer on the CPU, no window or GPU is needed.
+// It follows the OpenGL output of the window: one pixel points and lines, pixel center
+// sampling of filled shapes and circle outlines tessellated like BatchRenderer.
+// Large scenes are drawn in horizontal bands on several threads, each band in z-order.
+// The threads are started by the first frame that needs them and wait for the next frame
+// between frames, a renderer that only draws small frames never starts any.
+class SoftwareRenderer
+{
+public:
+	SoftwareRenderer();
+	~SoftwareRenderer();
+	// threads drawing a frame at once, 1 draws on the calling thread only
+	void SetThreads(int threads);
+	// clear the target to black and draw the visible shapes through the view
+	void Draw(const Scene& scene, const View& view, Framebuffer* target);
+private:
+	SoftwareRenderer(const SoftwareRenderer&);
+	SoftwareRenderer& operator=(const SoftwareRenderer&);
+
+	void Work(int band); // worker thread drawing band of every frame that has it
+
+	int threads_;
+	std::vector<unsigned int> visible_;
+	std::vector<std::thread> workers_; // worker i draws band i + 1
+	std::mutex mutex_;
+	std::condition_variable start_; // a frame was given to the workers or they are stopping
+	std::condition_variable done_; // the last band of the frame was drawn
+	// the frame being drawn, under the mutex
+	unsigned long long frame_;
+	const Scene* scene_;
+	const View* view_;
+	Framebuffer* target_;
+	const unsigned int* z_;
+	size_t count_;
+	int bands_;
+	int pending_; // bands of workers not drawn yet
+	bool stopping_;
+};
+
+#endif
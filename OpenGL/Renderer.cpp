@@ -0,0 +1,759 @@
+#include "Renderer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace std;
+
+void LoadView(const View& view, int w, int h, double anchor_x, double anchor_y)
+{
+	double scale = view.Scale();
+	GLdouble m[16] = {
+		scale, 0, 0, 0,
+		0, scale, 0, 0,
+		0, 0, 1, 0,
+		(anchor_x - view.OriginX()) * scale, (anchor_y - view.OriginY()) * scale, 0, 1 };
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(0, w, h, 0, -1, 1);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadMatrixd(m);
+}
+
+void RectAnchor(const Rect& rect, double* anchor_x, double* anchor_y)
+{
+	*anchor_x = floor((rect.left + rect.right) / 2);
+	*anchor_y = floor((rect.top + rect.bottom) / 2);
+}
+
+PointCloud::PointCloud()
+{
+	anchor_x_ = 0;
+	anchor_y_ = 0;
+	epoch_ = -1;
+	changes_read_ = 0;
+}
+
+void PointCloud::Update(const Scene& scene)
+{
+	if (epoch_ != scene.PointsEpoch())
+	{
+		positions_.clear();
+		colors_.clear();
+		epoch_ = scene.PointsEpoch();
+		changes_read_ = 0;
+		// a whole number near the points, keeps their floats precise far from the world origin
+		const Rect& bounds = scene.Bounds();
+		bool empty = scene.Points().Count() == 0;
+		anchor_x_ = empty ? 0 : floor((bounds.left + bounds.right) / 2);
+		anchor_y_ = empty ? 0 : floor((bounds.top + bounds.bottom) / 2);
+	}
+	size_t count = scene.Points().Count();
+	if (positions_.size() > count)
+	{
+		positions_.resize(count);
+		colors_.resize(count);
+	}
+	const ChunkArray<unsigned int>& changes = scene.PointChanges();
+	for (; changes_read_ < changes.Count(); changes_read_++)
+	{
+		size_t i = changes[changes_read_];
+		if (i < positions_.size())
+			Read(scene, i);
+	}
+	while (positions_.size() < count)
+	{
+		positions_.push_back(Vector2());
+		colors_.push_back(0);
+		Read(scene, positions_.size() - 1);
+	}
+}
+
+void PointCloud::Read(const Scene& scene, size_t i)
+{
+	const ShapeArrays<1>& points = scene.Points();
+	Vector2 v = points.Vertex(i, 0);
+	positions_[i].x = (float)(v.x - anchor_x_);
+	positions_[i].y = (float)(v.y - anchor_y_);
+	colors_[i] = points.PackedColor(i);
+	if (points.flags[i] & SHAPE_INVISIBLE)
+		colors_[i] &= 0x00ffffff; // alpha 0, dropped by the alpha test
+}
+
+void PointCloud::Draw(const View& view, int w, int h, const PointStyle& style, size_t first, size_t count, RenderStats* stats)
+{
+	if (first >= positions_.size()) return;
+	count = min(count, positions_.size() - first);
+	bool round = style.shape == POINT_ROUND && style.size > 1;
+	LoadView(view, w, h, anchor_x_, anchor_y_);
+	glPointSize(style.size);
+	if (round)
+	{
+		// smooth points are round, their edges blended
+		glEnable(GL_POINT_SMOOTH);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	glEnable(GL_ALPHA_TEST);
+	glAlphaFunc(GL_GREATER, 0);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(2, GL_FLOAT, sizeof(Vector2), &positions_[0].x);
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Pixel), &colors_[0]);
+	glDrawArrays(GL_POINTS, (GLint)first, (GLsizei)count);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisable(GL_ALPHA_TEST);
+	if (round)
+	{
+		glDisable(GL_BLEND);
+		glDisable(GL_POINT_SMOOTH);
+	}
+	glPointSize(1);
+	LoadView(view, w, h);
+	if (stats != NULL)
+	{
+		stats->draw_calls++;
+		stats->state_changes += round ? 16 : 12; // views, point size, alpha test, client arrays and pointers, smoothing and blending
+		stats->vertices += count;
+	}
+}
+
+// vertex position relative to the batch anchor
+inline Vector2 ShapeBatch::Relative(const Vector2& v) const
+{
+	Vector2 r;
+	r.x = v.x - anchor_fx_;
+	r.y = v.y - anchor_fy_;
+	return r;
+}
+
+// world position of the batch anchor, a whole number near the center
+void ShapeBatch::SetAnchor(const Rect& center)
+{
+	RectAnchor(center, &anchor_x_, &anchor_y_);
+	anchor_fx_ = (float)anchor_x_;
+	anchor_fy_ = (float)anchor_y_;
+}
+
+void ShapeBatch::Build(const Scene& scene, float pixel_scale, const Rect& region)
+{
+	Clear();
+	const Rect& bounds = scene.Bounds();
+	bool all_visible = RectContains(region, bounds);
+	// an empty scene anchors at the view, shapes drawn over it line up with nothing yet but stay precise
+	SetAnchor(scene.Count() > 0 && all_visible ? bounds : region);
+
+	if (!all_visible)
+	{
+		// only shapes the index finds in the region, sorted to keep the z-order and memory order
+		visible_.clear();
+		scene.Query(region, &visible_);
+		sort(visible_.begin(), visible_.end());
+		for (size_t i = 0; i < visible_.size(); i++)
+		{
+			const ShapeRef& ref = scene.At(visible_[i]);
+			if (ref.type == SHAPE_POINT)
+				AddCloudPoint(ref.index);
+			else if (!scene.Hidden(visible_[i]))
+				AddShape(scene, ref, pixel_scale);
+		}
+		return;
+	}
+
+	// every shape in z-order, the index of each type goes up with z so its arrays are read in order.
+	// Points get runs whatever their flags, the cloud hides them and shows them again
+	for (size_t z = 0; z < scene.Count(); z++)
+	{
+		const ShapeRef& ref = scene.At(z);
+		if (ref.type == SHAPE_POINT)
+			AddCloudPoint(ref.index);
+		else if (!scene.Hidden(z) && !scene.Deleted(z))
+			AddShape(scene, ref, pixel_scale);
+	}
+}
+
+void ShapeBatch::BuildShape(const Scene& scene, size_t z, float pixel_scale)
+{
+	Clear();
+	SetAnchor(scene.ShapeBounds(z));
+	AddShape(scene, scene.At(z), pixel_scale);
+}
+
+void ShapeBatch::AddShape(const Scene& scene, const ShapeRef& ref, float pixel_scale)
+{
+	switch (ref.type)
+	{
+	case SHAPE_POINT: AddPoint(scene, ref.index); break;
+	case SHAPE_LINE: AddLine(scene, ref.index); break;
+	case SHAPE_TRIANGLE: AddTriangle(scene, ref.index); break;
+	case SHAPE_QUAD: AddQuad(scene, ref.index); break;
+	case SHAPE_CIRCLE: AddCircle(scene, ref.index, pixel_scale); break;
+	case SHAPE_STROKE: AddStroke(scene, ref.index); break;
+	}
+}
+
+void ShapeBatch::AddPoint(const Scene& scene, size_t i)
+{
+	const ShapeArrays<1>& points = scene.Points();
+	Add(BATCH_POINTS, Relative(points.Vertex(i, 0)), points.ShapeColor(i));
+}
+
+// point i of the cloud extends its run, points come in z-order
+void ShapeBatch::AddCloudPoint(size_t i)
+{
+	if (runs_.empty() || runs_.back().bucket != BATCH_POINT_CLOUD)
+	{
+		BatchRun run = { BATCH_POINT_CLOUD, (unsigned int)i, 0 };
+		runs_.push_back(run);
+	}
+	runs_.back().count = (unsigned int)i - runs_.back().first + 1;
+}
+
+void ShapeBatch::AddLine(const Scene& scene, size_t i)
+{
+	const ShapeArrays<2>& lines = scene.Lines();
+	Color color = lines.ShapeColor(i);
+	for (int j = 0; j < 2; j++)
+		Add(BATCH_LINES, Relative(lines.Vertex(i, j)), color);
+}
+
+void ShapeBatch::AddTriangle(const Scene& scene, size_t i)
+{
+	const ShapeArrays<3>& triangles = scene.Triangles();
+	BatchBucket bucket = (triangles.flags[i] & SHAPE_FILLED) ? BATCH_TRIANGLES_FILL : BATCH_TRIANGLES_LINE;
+	Color color = triangles.ShapeColor(i);
+	for (int j = 0; j < 3; j++)
+		Add(bucket, Relative(triangles.Vertex(i, j)), color);
+}
+
+void ShapeBatch::AddQuad(const Scene& scene, size_t i)
+{
+	const ShapeArrays<4>& quads = scene.Quads();
+	BatchBucket bucket = (quads.flags[i] & SHAPE_FILLED) ? BATCH_QUADS_FILL : BATCH_QUADS_LINE;
+	Color color = quads.ShapeColor(i);
+	for (int j = 0; j < 4; j++)
+		Add(bucket, Relative(quads.Vertex(i, j)), color);
+}
+
+void ShapeBatch::AddCircle(const Scene& scene, size_t i, float pixel_scale)
+{
+	const CircleArrays& circles = scene.Circles();
+	Vector2 center = Relative(circles.Vertex(i, 0));
+	float radius = circles.radii[i];
+	Color color = circles.ShapeColor(i);
+	bool filled = (circles.flags[i] & SHAPE_FILLED) != 0;
+	int sides;
+	const Vector2* unit = UnitCircle(CircleLodLevel(radius * pixel_scale), &sides);
+	Vector2 v0, v1;
+	for (int j = 0; j < sides; j++)
+	{
+		v0.x = center.x + radius * unit[j].x;
+		v0.y = center.y + radius * unit[j].y;
+		v1.x = center.x + radius * unit[j + 1].x;
+		v1.y = center.y + radius * unit[j + 1].y;
+		if (filled)
+		{
+			Add(BATCH_TRIANGLES_FILL, center, color);
+			Add(BATCH_TRIANGLES_FILL, v0, color);
+			Add(BATCH_TRIANGLES_FILL, v1, color);
+		}
+		else
+		{
+			Add(BATCH_LINES, v0, color);
+			Add(BATCH_LINES, v1, color);
+		}
+	}
+}
+
+// a stroke goes into the line bucket segment by segment, so strokes cost no draw call of their own
+void ShapeBatch::AddStroke(const Scene& scene, size_t i)
+{
+	const StrokeArrays& strokes = scene.Strokes();
+	const Vector2* points = strokes.Points(i);
+	unsigned int n = strokes.spans[i].count;
+	const Color& color = strokes.colors[i];
+	for (unsigned int j = 1; j < n; j++)
+	{
+		Add(BATCH_LINES, Relative(points[j - 1]), color);
+		Add(BATCH_LINES, Relative(points[j]), color);
+	}
+}
+
+SharedGeometry::SharedGeometry()
+{
+	for (int i = 0; i < SHARED_GEOMETRY_LISTS; i++)
+	{
+		entries_[i].list = 0;
+		entries_[i].list_count = 0;
+		entries_[i].points = 0;
+		entries_[i].version = -1;
+		entries_[i].used = 0;
+	}
+	clock_ = 0;
+	compiles_ = 0;
+	anchor_x_ = 0;
+	anchor_y_ = 0;
+}
+
+// what DrawRuns issues for runs begin to end, also when the display list it was compiled into is called
+static void CountRuns(const ShapeBatch& batch, size_t begin, size_t end, RenderStats* stats)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		const BatchRun& run = batch.Runs()[i];
+		if (run.bucket == BATCH_POINT_CLOUD) continue;
+		stats->draw_calls++;
+		stats->state_changes += 3; // polygon mode, vertex and color pointers
+		stats->vertices += run.count;
+	}
+}
+
+static double Milliseconds(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// one draw call per run from begin to end, point cloud runs are left out. The vertex and color
+// arrays must be enabled
+static void DrawRuns(const ShapeBatch& batch, size_t begin, size_t end)
+{
+	static const GLenum modes[BATCH_BUCKET_COUNT] = { GL_POINTS, GL_LINES, GL_TRIANGLES, GL_TRIANGLES, GL_QUADS, GL_QUADS };
+	static const GLenum polygon_modes[BATCH_BUCKET_COUNT] = { GL_LINE, GL_LINE, GL_LINE, GL_FILL, GL_LINE, GL_FILL };
+
+	for (size_t i = begin; i < end; i++)
+	{
+		const BatchRun& run = batch.Runs()[i];
+		if (run.bucket == BATCH_POINT_CLOUD) continue;
+		const vector<BatchVertex>& vertices = batch.Vertices(run.bucket);
+		glPolygonMode(GL_FRONT_AND_BACK, polygon_modes[run.bucket]);
+		glVertexPointer(2, GL_FLOAT, sizeof(BatchVertex), &vertices[0].x);
+		glColorPointer(3, GL_FLOAT, sizeof(BatchVertex), &vertices[0].r);
+		glDrawArrays(modes[run.bucket], run.first, run.count);
+	}
+}
+
+void SharedGeometry::Draw(const Scene& scene, const View& view, int w, int h, RenderStats* stats)
+{
+	float pixel_scale = view.LodScale();
+	Rect visible = view.VisibleRect(w, h);
+	Entry* entry = NULL;
+	for (int i = 0; i < SHARED_GEOMETRY_LISTS && entry == NULL; i++)
+	{
+		Entry& e = entries_[i];
+		if (e.version == scene.ShapesVersion() && e.pixel_scale == pixel_scale && RectContains(e.region, visible))
+			entry = &e;
+	}
+	if (entry == NULL)
+	{
+		chrono::steady_clock::time_point start;
+		if (stats != NULL)
+			start = chrono::steady_clock::now();
+		entry = Compile(scene, pixel_scale, visible);
+		if (stats != NULL)
+			stats->fit_ms += Milliseconds(start);
+	}
+	entry->used = ++clock_;
+	anchor_x_ = entry->anchor_x;
+	anchor_y_ = entry->anchor_y;
+	points_.Update(scene);
+	const PointStyle& style = scene.GetPointStyle();
+	for (size_t i = 0; i < entry->steps.size(); i++)
+	{
+		const BatchRun& step = entry->steps[i];
+		if (step.bucket == BATCH_POINT_CLOUD)
+		{
+			points_.Draw(view, w, h, style, step.first, step.count, stats);
+			continue;
+		}
+		LoadView(view, w, h, entry->anchor_x, entry->anchor_y);
+		glCallList(entry->list + step.first);
+		LoadView(view, w, h);
+	}
+	// points added since the lists were compiled are the top shapes
+	points_.Draw(view, w, h, style, entry->points, points_.Count(), stats);
+	if (stats != NULL)
+	{
+		stats->draw_calls += entry->counts.draw_calls;
+		stats->state_changes += entry->counts.state_changes + 2 * entry->list_count; // the views loaded around the lists
+		stats->vertices += entry->counts.vertices;
+	}
+}
+
+void SharedGeometry::Reset()
+{
+	for (int i = 0; i < SHARED_GEOMETRY_LISTS; i++)
+	{
+		if (entries_[i].list != 0 && !glIsList(entries_[i].list))
+		{
+			entries_[i].list = 0;
+			entries_[i].list_count = 0;
+			entries_[i].version = -1;
+		}
+	}
+}
+
+// pack the view and half a window more on every side, small pans then reuse the list
+SharedGeometry::Entry* SharedGeometry::Compile(const Scene& scene, float pixel_scale, const Rect& visible)
+{
+	// a list of an older scene is of no use to any view, else the least recently drawn goes
+	Entry* entry = &entries_[0];
+	for (int i = 1; i < SHARED_GEOMETRY_LISTS; i++)
+	{
+		Entry& e = entries_[i];
+		bool stale = e.version != scene.ShapesVersion();
+		bool entry_stale = entry->version != scene.ShapesVersion();
+		if ((stale && !entry_stale) || (stale == entry_stale && e.used < entry->used))
+			entry = &e;
+	}
+	float margin_x = (visible.right - visible.left) / 2;
+	float margin_y = (visible.bottom - visible.top) / 2;
+	Rect region = { visible.left - margin_x, visible.top - margin_y, visible.right + margin_x, visible.bottom + margin_y };
+	batch_.Build(scene, pixel_scale, region);
+
+	// a list for the runs between two point runs, the point runs are drawn between the lists
+	const vector<BatchRun>& runs = batch_.Runs();
+	entry->steps.clear();
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		if (runs[i].bucket == BATCH_POINT_CLOUD)
+			entry->steps.push_back(runs[i]);
+		else if (entry->steps.empty() || entry->steps.back().bucket != BATCH_LIST)
+		{
+			BatchRun step = { BATCH_LIST, 0, 0 };
+			entry->steps.push_back(step);
+		}
+	}
+	int list_count = 0;
+	for (size_t i = 0; i < entry->steps.size(); i++)
+		if (entry->steps[i].bucket == BATCH_LIST)
+			entry->steps[i].first = list_count++;
+	if (entry->list_count != list_count)
+	{
+		if (entry->list != 0)
+			glDeleteLists(entry->list, entry->list_count);
+		entry->list = list_count == 0 ? 0 : glGenLists(list_count);
+		entry->list_count = list_count;
+	}
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	GLuint list = entry->list;
+	for (size_t begin = 0; begin < runs.size(); )
+	{
+		size_t end = begin;
+		while (end < runs.size() && runs[end].bucket != BATCH_POINT_CLOUD)
+			end++;
+		if (end > begin)
+		{
+			glNewList(list++, GL_COMPILE);
+			DrawRuns(batch_, begin, end);
+			glEndList();
+		}
+		begin = end < runs.size() ? end + 1 : end;
+	}
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	entry->points = (unsigned int)scene.Points().Count();
+	entry->version = scene.ShapesVersion();
+	entry->pixel_scale = pixel_scale;
+	entry->region = region;
+	entry->anchor_x = batch_.AnchorX();
+	entry->anchor_y = batch_.AnchorY();
+	entry->counts.Clear();
+	CountRuns(batch_, 0, runs.size(), &entry->counts);
+	compiles_++;
+	return entry;
+}
+
+BatchRenderer::BatchRenderer(SharedGeometry* geometry)
+{
+	geometry_ = geometry != NULL ? geometry : &own_;
+	anchor_x_ = 0;
+	anchor_y_ = 0;
+}
+
+void BatchRenderer::DrawShape(const Scene& scene, size_t z, const View& view, int w, int h, const Vector2& offset, RenderStats* stats)
+{
+	shape_batch_.BuildShape(scene, z, view.LodScale());
+	LoadView(view, w, h, shape_batch_.AnchorX() + offset.x, shape_batch_.AnchorY() + offset.y);
+	glPointSize(scene.GetPointStyle().size);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	DrawRuns(shape_batch_, 0, shape_batch_.Runs().size());
+	glPointSize(1);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	LoadView(view, w, h);
+	if (stats != NULL)
+	{
+		CountRuns(shape_batch_, 0, shape_batch_.Runs().size(), stats);
+		stats->state_changes += 6; // client arrays on and off, the views
+	}
+}
+
+// smallest power of two not less than n, old OpenGL needs power of two textures
+static int TextureSize(int n)
+{
+	int size = 1;
+	while (size < n)
+		size <<= 1;
+	return size;
+}
+
+LayerCache::LayerCache()
+{
+	Reset();
+}
+
+bool LayerCache::Valid(int scene_version, int view_version, int w, int h) const
+{
+	return valid_ && version_ == scene_version && view_version_ == view_version && w_ == w && h_ == h;
+}
+
+void LayerCache::Capture(int scene_version, int view_version, int w, int h, RenderStats* stats)
+{
+	if (texture_ == 0)
+		glGenTextures(1, &texture_);
+	glBindTexture(GL_TEXTURE_2D, texture_);
+	if (texture_w_ < w || texture_h_ < h)
+	{
+		texture_w_ = TextureSize(w);
+		texture_h_ = TextureSize(h);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texture_w_, texture_h_, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	}
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, w, h);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (stats != NULL)
+	{
+		stats->draw_calls++; // the copy
+		stats->state_changes += 2;
+	}
+	version_ = scene_version;
+	view_version_ = view_version;
+	w_ = w;
+	h_ = h;
+	valid_ = true;
+}
+
+void LayerCache::Draw(RenderStats* stats)
+{
+	float s = (float)w_ / texture_w_;
+	float t = (float)h_ / texture_h_;
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, texture_);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glBegin(GL_QUADS);
+	glTexCoord2f(0, 0);
+	glVertex2f(-1, -1);
+	glTexCoord2f(s, 0);
+	glVertex2f(1, -1);
+	glTexCoord2f(s, t);
+	glVertex2f(1, 1);
+	glTexCoord2f(0, t);
+	glVertex2f(-1, 1);
+	glEnd();
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDisable(GL_TEXTURE_2D);
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	if (stats != NULL)
+	{
+		stats->draw_calls++;
+		stats->state_changes += 6; // polygon mode, texturing on and off, texture bound and unbound, texture mode
+		stats->vertices += 4;
+	}
+}
+
+void LayerCache::Reset()
+{
+	texture_ = 0;
+	texture_w_ = 0;
+	texture_h_ = 0;
+	version_ = -1;
+	view_version_ = -1;
+	w_ = 0;
+	h_ = 0;
+	valid_ = false;
+}
+
+bool SoftwareDriver()
+{
+	// the generic windows driver, mesa's llvmpipe and softpipe and other named software renderers
+	const char* names[] = { "GDI Generic", "llvmpipe", "softpipe", "Software" };
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	if (renderer == NULL) return false;
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		if (strstr(renderer, names[i]) != NULL)
+			return true;
+	return false;
+}
+
+void PaintTextures::Draw(const PaintLayer& layer, const View& view, int w, int h, RenderStats* stats)
+{
+	if (entries_.size() > layer.TileCount())
+		Prune(layer);
+	visible_.clear();
+	layer.Query(view.VisibleRect(w, h), &visible_);
+	if (visible_.empty()) return;
+	// tiles relative to the tile corner next to the view origin, precise far from the world origin
+	double anchor_x = floor(view.OriginX() / PAINT_TILE_SIZE) * PAINT_TILE_SIZE;
+	double anchor_y = floor(view.OriginY() / PAINT_TILE_SIZE) * PAINT_TILE_SIZE;
+	LoadView(view, w, h, anchor_x, anchor_y);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glEnable(GL_TEXTURE_2D);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glEnable(GL_ALPHA_TEST);
+	glAlphaFunc(GL_GREATER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	int uploads = 0;
+	for (size_t v = 0; v < visible_.size(); v++)
+	{
+		const PaintTile& tile = layer.Tile(visible_[v]);
+		Entry& entry = entries_[PaintLayer::Key(tile.x, tile.y)];
+		if (entry.texture == 0)
+		{
+			glGenTextures(1, &entry.texture);
+			glBindTexture(GL_TEXTURE_2D, entry.texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, PAINT_TILE_SIZE, PAINT_TILE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, tile.pixels);
+			entry.version = tile.version;
+			uploads++;
+		}
+		else
+		{
+			glBindTexture(GL_TEXTURE_2D, entry.texture);
+			if (entry.version != tile.version)
+			{
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, PAINT_TILE_SIZE, PAINT_TILE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, tile.pixels);
+				entry.version = tile.version;
+				uploads++;
+			}
+		}
+		float left = (float)((double)tile.x * PAINT_TILE_SIZE - anchor_x);
+		float top = (float)((double)tile.y * PAINT_TILE_SIZE - anchor_y);
+		float right = left + PAINT_TILE_SIZE;
+		float bottom = top + PAINT_TILE_SIZE;
+		// texture rows are the tile rows from the top
+		glBegin(GL_QUADS);
+		glTexCoord2f(0, 0);
+		glVertex2f(left, top);
+		glTexCoord2f(1, 0);
+		glVertex2f(right, top);
+		glTexCoord2f(1, 1);
+		glVertex2f(right, bottom);
+		glTexCoord2f(0, 1);
+		glVertex2f(left, bottom);
+		glEnd();
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDisable(GL_ALPHA_TEST);
+	glDisable(GL_TEXTURE_2D);
+	LoadView(view, w, h);
+	uploads_ += uploads;
+	if (stats != NULL)
+	{
+		stats->draw_calls += (int)visible_.size();
+		stats->state_changes += 9 + (int)visible_.size() + uploads; // views, fill, texturing, alpha test, a bind per tile and the uploads
+		stats->vertices += 4 * visible_.size();
+	}
+}
+
+// delete the textures of tiles the layer no longer has
+void PaintTextures::Prune(const PaintLayer& layer)
+{
+	unordered_map<unsigned long long, Entry>::iterator it = entries_.begin();
+	while (it != entries_.end())
+	{
+		int x = (int)(unsigned int)(it->first & 0xffffffff);
+		int y = (int)(unsigned int)(it->first >> 32);
+		if (layer.Find(x, y) < 0)
+		{
+			if (it->second.texture != 0)
+				glDeleteTextures(1, &it->second.texture);
+			it = entries_.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+void PaintTextures::Reset()
+{
+	unordered_map<unsigned long long, Entry>::iterator it = entries_.begin();
+	while (it != entries_.end())
+	{
+		if (!glIsTexture(it->second.texture))
+			it = entries_.erase(it);
+		else
+			++it;
+	}
+}
+
+SoftwareLayer::SoftwareLayer()
+{
+	version_ = -1;
+	view_version_ = -1;
+	paint_version_ = -1;
+	valid_ = false;
+}
+
+void SoftwareLayer::Draw(const Scene& scene, const PaintLayer& paint, const View& view, int w, int h, RenderStats* stats)
+{
+	if (w <= 0 || h <= 0) return;
+	bool drawn = false;
+	if (!valid_ || version_ != scene.Version() || view_version_ != view.Version() || image_.Width() != w || image_.Height() != h)
+	{
+		image_.Resize(w, h);
+		renderer_.Draw(scene, view, &image_);
+		version_ = scene.Version();
+		view_version_ = view.Version();
+		valid_ = true;
+		drawn = true;
+	}
+	Framebuffer* image = &image_;
+	if (paint.TileCount() != 0)
+	{
+		if (drawn || paint_version_ != paint.Version())
+		{
+			painted_ = image_;
+			paint.Draw(view, &painted_);
+			paint_version_ = paint.Version();
+		}
+		image = &painted_;
+	}
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	// rows are stored from the top, drawn downwards from the top left corner
+	glRasterPos2f(-1, 1);
+	glPixelZoom(1, -1);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glDrawPixels(w, h, GL_RGBA, GL_UNSIGNED_BYTE, image->Row(0));
+	glPixelZoom(1, 1);
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	if (stats != NULL)
+	{
+		stats->draw_calls++;
+		stats->state_changes += 4; // raster position, pixel zoom set and reset, unpack alignment
+	}
+}
@@ -0,0 +1,304 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <FL/gl.h>
+#include <vector>
+#include <unordered_map>
+#include "Scene.h"
+#include "View.h"
+#include "Raster.h"
+#include "PaintLayer.h"
+
+// Load the projection of a w x h window and a modelview of the view for vertices given relative
+// to the anchor. The offset between anchor and origin is computed in double before it reaches GL.
+void LoadView(const View& view, int w, int h, double anchor_x = 0, double anchor_y = 0);
+// anchor of vertices near rect, a whole number near its center
+void RectAnchor(const Rect& rect, double* anchor_x, double* anchor_y);
+// true when the current context is drawn by a software GL driver instead of a GPU
+bool SoftwareDriver();
+
+// GL work of one frame, counted only by renderers that are given one
+struct RenderStats
+{
+	RenderStats() { Clear(); }
+	void Clear()
+	{
+		draw_calls = 0;
+		state_changes = 0;
+		vertices = 0;
+		fit_ms = 0;
+	}
+	int draw_calls;
+	int state_changes;
+	size_t vertices;
+	double fit_ms; // packing vertices for the view, drawing them is not included
+};
+
+// vertex layout of the batch renderer, interleaved position and color
+struct BatchVertex
+{
+	float x;
+	float y;
+	float r;
+	float g;
+	float b;
+};
+// Packed copy of the points of a scene, vertex i is point i of the scene, drawn one range of
+// points per call in the point style of the scene. It follows the log of changed points, so adding, erasing or
+// editing a point costs O(1) instead of packing every point again. Erased and hidden points
+// keep their place with an alpha of 0.
+class PointCloud
+{
+public:
+	PointCloud();
+	// read the points added and changed since the last update
+	void Update(const Scene& scene);
+	// draw points first to first + count - 1 through the view of a w x h window, the view is
+	// loaded again afterwards. The range is cut to the points there are
+	void Draw(const View& view, int w, int h, const PointStyle& style, size_t first, size_t count, RenderStats* stats = NULL);
+	size_t Count() const { return positions_.size(); }
+private:
+	void Read(const Scene& scene, size_t i);
+
+	std::vector<Vector2> positions_; // relative to the anchor
+	std::vector<Pixel> colors_;
+	double anchor_x_;
+	double anchor_y_;
+	int epoch_;
+	size_t changes_read_;
+};
+
+// one bucket per primitive type and fill mode
+enum BatchBucket
+{
+	BATCH_POINTS,
+	BATCH_LINES,
+	BATCH_TRIANGLES_LINE,
+	BATCH_TRIANGLES_FILL,
+	BATCH_QUADS_LINE,
+	BATCH_QUADS_FILL,
+	BATCH_BUCKET_COUNT
+};
+const unsigned char BATCH_POINT_CLOUD = BATCH_BUCKET_COUNT; // run of points left to the PointCloud
+const unsigned char BATCH_LIST = BATCH_BUCKET_COUNT + 1; // step of SharedGeometry calling display list first
+// Shapes next to each other in z-order that go into the same bucket, one draw call. A run of the
+// point cloud holds the points first to first + count - 1, points between them that were not
+// packed lie at z-orders between those that were and are drawn along.
+struct BatchRun
+{
+	unsigned char bucket;
+	unsigned int first; // vertex in the bucket, or point
+	unsigned int count;
+};
+// CPU side vertex arrays of all committed shapes, grouped by bucket, and the runs that draw
+// them in z-order: a new run starts whenever the bucket changes from one shape to the next
+class ShapeBatch
+{
+public:
+	ShapeBatch()
+	{
+		anchor_x_ = 0;
+		anchor_y_ = 0;
+		anchor_fx_ = 0;
+		anchor_fy_ = 0;
+	}
+	void Clear()
+	{
+		for (int i = 0; i < BATCH_BUCKET_COUNT; i++)
+			vertices_[i].clear();
+		runs_.clear();
+	}
+	void Add(BatchBucket bucket, const Vector2& position, const Color& color)
+	{
+		if (runs_.empty() || runs_.back().bucket != bucket)
+		{
+			BatchRun run = { (unsigned char)bucket, (unsigned int)vertices_[bucket].size(), 0 };
+			runs_.push_back(run);
+		}
+		runs_.back().count++;
+		BatchVertex v = { position.x, position.y, color.r, color.g, color.b };
+		vertices_[bucket].push_back(v);
+	}
+	const std::vector<BatchVertex>& Vertices(int bucket) const { return vertices_[bucket]; }
+	const std::vector<BatchRun>& Runs() const { return runs_; } // in z-order
+	// pack the shapes of a scene touching region relative to the anchor, circles tessellated for pixel_scale.
+	// Points are left to the PointCloud, they only get runs in z-order
+	void Build(const Scene& scene, float pixel_scale, const Rect& region);
+	// pack only shape z, hidden or not, relative to its own anchor
+	void BuildShape(const Scene& scene, size_t z, float pixel_scale);
+	double AnchorX() const { return anchor_x_; }
+	double AnchorY() const { return anchor_y_; }
+private:
+	Vector2 Relative(const Vector2& v) const;
+	void SetAnchor(const Rect& center);
+	void AddShape(const Scene& scene, const ShapeRef& ref, float pixel_scale);
+	void AddPoint(const Scene& scene, size_t i);
+	void AddCloudPoint(size_t i);
+	void AddLine(const Scene& scene, size_t i);
+	void AddTriangle(const Scene& scene, size_t i);
+	void AddQuad(const Scene& scene, size_t i);
+	void AddCircle(const Scene& scene, size_t i, float pixel_scale);
+	void AddStroke(const Scene& scene, size_t i);
+
+	std::vector<BatchVertex> vertices_[BATCH_BUCKET_COUNT];
+	std::vector<BatchRun> runs_;
+	std::vector<unsigned int> visible_; // shapes found in the region
+	// world position subtracted from every vertex, keeps float vertices precise far from the world origin
+	double anchor_x_;
+	double anchor_y_;
+	float anchor_fx_;
+	float anchor_fy_;
+};
+
+const int SHARED_GEOMETRY_LISTS = 4; // display lists kept, e.g. one per zoom level of the open views
+
+// Visible part of a scene packed in one draw call per run of z-order and compiled into display
+// lists, so vertex data is only sent to the driver again when the scene changes, the zoom crosses
+// a power of two or the view leaves the region packed. FLTK creates every GL context sharing
+// display lists with the first one, so one SharedGeometry serves any number of windows: a view
+// at the zoom level of an entry whose region holds it calls its lists, other views get an entry of
+// their own in place of a stale or the least recently used one. The points are packed once too,
+// their runs are drawn from the cloud between the lists, points added since on top of them.
+class SharedGeometry
+{
+public:
+	SharedGeometry();
+	// draw through the view of a w x h window, the view is loaded again afterwards
+	void Draw(const Scene& scene, const View& view, int w, int h, RenderStats* stats = NULL);
+	// forget the display lists the current context can not call, call when a GL context was
+	// recreated. Lists outlive a context as long as another one sharing them is left
+	void Reset();
+	int Compiles() const { return compiles_; } // lists compiled so far
+	// anchor of the lists drawn last
+	double AnchorX() const { return anchor_x_; }
+	double AnchorY() const { return anchor_y_; }
+private:
+	struct Entry
+	{
+		GLuint list; // first of list_count lists, the shapes between two point runs each
+		int list_count;
+		std::vector<BatchRun> steps; // point runs and lists, bucket BATCH_LIST, in z-order
+		unsigned int points; // points of the scene when compiled
+		int version;
+		float pixel_scale;
+		Rect region; // world rectangle the list holds the shapes of
+		double anchor_x;
+		double anchor_y;
+		RenderStats counts; // what calling the list draws
+		unsigned int used; // clock_ of the last draw
+	};
+	Entry* Compile(const Scene& scene, float pixel_scale, const Rect& visible);
+
+	Entry entries_[SHARED_GEOMETRY_LISTS];
+	ShapeBatch batch_; // scratch of Compile
+	PointCloud points_;
+	unsigned int clock_;
+	int compiles_;
+	double anchor_x_;
+	double anchor_y_;
+};
+
+// Draws the committed shapes of a scene with geometry of its own or shared with other windows,
+// and single shapes outside of it
+class BatchRenderer
+{
+public:
+	// geometry shared with other renderers, NULL for geometry of its own
+	explicit BatchRenderer(SharedGeometry* geometry = NULL);
+	// draw through the view of a w x h window, the view is loaded again afterwards
+	void Draw(const Scene& scene, const View& view, int w, int h, RenderStats* stats = NULL)
+	{
+		geometry_->Draw(scene, view, w, h, stats);
+		anchor_x_ = geometry_->AnchorX();
+		anchor_y_ = geometry_->AnchorY();
+	}
+	// draw shape z moved by offset, without the display list, e.g. the shape being dragged
+	void DrawShape(const Scene& scene, size_t z, const View& view, int w, int h, const Vector2& offset, RenderStats* stats = NULL);
+	// forget the display lists lost with a GL context, call when it was recreated
+	void Reset() { geometry_->Reset(); }
+	// anchor the committed shapes were drawn relative to by the last Draw, shapes drawn relative
+	// to it over them line up with them to the pixel
+	double AnchorX() const { return anchor_x_; }
+	double AnchorY() const { return anchor_y_; }
+private:
+	SharedGeometry own_;
+	SharedGeometry* geometry_;
+	ShapeBatch shape_batch_;
+	double anchor_x_;
+	double anchor_y_;
+};
+
+// Committed scene rendered once and kept in a texture. Until the scene changes or the
+// window is resized, a frame only draws this texture and the shape being created on top.
+class LayerCache
+{
+public:
+	LayerCache();
+	// true when the cached layer shows this scene version through this view at this window size
+	bool Valid(int scene_version, int view_version, int w, int h) const;
+	// copy the color buffer drawn so far into the cache
+	void Capture(int scene_version, int view_version, int w, int h, RenderStats* stats = NULL);
+	// draw the cached layer over the whole viewport
+	void Draw(RenderStats* stats = NULL);
+	void Invalidate() { valid_ = false; }
+	// forget the texture, call when the GL context was recreated
+	void Reset();
+private:
+	GLuint texture_;
+	int texture_w_;
+	int texture_h_;
+	int version_;
+	int view_version_;
+	int w_;
+	int h_;
+	bool valid_;
+};
+
+// Tiles of a paint layer kept in one texture each and drawn as textured quads over what is drawn
+// before. A tile is uploaded when it first comes into view and again only after its version
+// changed, so a frame costs the visible tiles plus the damaged ones and painting never touches
+// the rest. FLTK contexts share textures like display lists, so one PaintTextures serves every
+// window. Textures of erased tiles are deleted once the layer has fewer tiles than textures.
+class PaintTextures
+{
+public:
+	PaintTextures() { uploads_ = 0; }
+	// draw through the view of a w x h window, the view is loaded again afterwards
+	void Draw(const PaintLayer& layer, const View& view, int w, int h, RenderStats* stats = NULL);
+	// forget the textures the current context can not use, call when a GL context was recreated
+	void Reset();
+	int Uploads() const { return uploads_; } // tiles uploaded so far
+private:
+	struct Entry
+	{
+		GLuint texture;
+		int version; // of the tile uploaded
+	};
+	void Prune(const PaintLayer& layer);
+
+	std::unordered_map<unsigned long long, Entry> entries_; // by tile, key as in PaintLayer
+	std::vector<unsigned int> visible_;
+	int uploads_;
+};
+
+// Committed scene drawn on the CPU by SoftwareRenderer and copied into the window with one
+// glDrawPixels, for machines without a GPU where GL vertices go through a slow software driver.
+// The image is drawn again only when the scene or the view changed or the window was resized,
+// new paint is only composited over it again.
+class SoftwareLayer
+{
+public:
+	SoftwareLayer();
+	// draw through the view of a w x h window with the paint on top, rasterizing counts as draw time
+	void Draw(const Scene& scene, const PaintLayer& paint, const View& view, int w, int h, RenderStats* stats = NULL);
+private:
+	SoftwareRenderer renderer_;
+	Framebuffer image_;
+	Framebuffer painted_; // image_ with the paint over it, painting only copies and paints again
+	int version_;
+	int view_version_;
+	int paint_version_;
+	bool valid_;
+};
+
+#endif
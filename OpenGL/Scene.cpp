@@ -0,0 +1,632 @@
+#include "Scene.h"
+#include <cfloat>
+#include <climits>
+#include <atomic>
+
+using namespace std;
+
+// epochs of all scenes are different, a reader never mistakes one scene's points for another's
+static atomic<int> last_points_epoch(0);
+
+static unsigned char ShapeFlags(bool filled)
+{
+	return filled ? SHAPE_FILLED : 0;
+}
+
+// bounding box of n consecutive vertices
+template <class Vertices>
+static Rect VertexBounds(const Vertices& vertices, size_t first, int n)
+{
+	Rect box = { vertices[first].x, vertices[first].y, vertices[first].x, vertices[first].y };
+	for (int i = 1; i < n; i++)
+	{
+		const Vector2& v = vertices[first + i];
+		if (v.x < box.left) box.left = v.x;
+		if (v.y < box.top) box.top = v.y;
+		if (v.x > box.right) box.right = v.x;
+		if (v.y > box.bottom) box.bottom = v.y;
+	}
+	return box;
+}
+
+// vertices of shape i copied out of its arrays, a shape may straddle two chunks
+template <int N>
+static void CopyVertices(const ShapeArrays<N>& shapes, size_t i, Vector2* out)
+{
+	for (int j = 0; j < N; j++)
+		out[j] = shapes.Vertex(i, j);
+}
+
+template <int N>
+static Rect ShapeVertexBounds(const ShapeArrays<N>& shapes, size_t i)
+{
+	Vector2 vertices[N];
+	CopyVertices(shapes, i, vertices);
+	const Vector2* first = vertices;
+	return VertexBounds(first, 0, N);
+}
+
+template <int N>
+static bool MoveVertices(ShapeArrays<N>& shapes, size_t i, float dx, float dy)
+{
+	Vector2 vertices[N];
+	CopyVertices(shapes, i, vertices);
+	for (int j = 0; j < N; j++)
+	{
+		vertices[j].x += dx;
+		vertices[j].y += dy;
+	}
+	return shapes.SetVertices(i, vertices);
+}
+
+bool EncodeVertices(const Vector2* vertices, int n, ShapeTile* tile, PackedVertex* packed)
+{
+	for (int scale = 0; scale <= COMPACT_MAX_SCALE; scale++)
+	{
+		double quantum = ldexp((double)COMPACT_QUANTUM, scale);
+		double size = quantum * COMPACT_TILE;
+		double tx = floor(vertices[0].x / size);
+		double ty = floor(vertices[0].y / size);
+		if (!(tx >= SHRT_MIN && tx <= SHRT_MAX && ty >= SHRT_MIN && ty <= SHRT_MAX)) continue;
+		int i = 0;
+		for (; i < n; i++)
+		{
+			double x = floor((vertices[i].x - tx * size) / quantum + 0.5);
+			double y = floor((vertices[i].y - ty * size) / quantum + 0.5);
+			if (!(x >= SHRT_MIN && x <= SHRT_MAX && y >= SHRT_MIN && y <= SHRT_MAX)) break;
+			packed[i].x = (short)x;
+			packed[i].y = (short)y;
+		}
+		if (i < n) continue;
+		tile->x = (short)tx;
+		tile->y = (short)ty;
+		tile->scale = (unsigned char)scale;
+		return true;
+	}
+	tile->x = 0;
+	tile->y = 0;
+	tile->scale = 0;
+	for (int i = 0; i < n; i++)
+		packed[i].x = packed[i].y = 0;
+	return false;
+}
+
+Scene::Scene()
+{
+	version_ = 0;
+	shapes_version_ = 0;
+	file_ = NULL;
+	point_style_.size = 1;
+	point_style_.shape = POINT_SQUARE;
+	points_epoch_ = ++last_points_epoch;
+	ResetBounds();
+}
+
+bool Scene::AddPoint(const Vector2& position, const Color& color, bool filled)
+{
+	if (!order_.Reserve(order_.Count() + 1) || !points_.Add(&position, color, ShapeFlags(filled))) return false;
+	return Push(SHAPE_POINT, points_.Count() - 1);
+}
+
+bool Scene::AddLine(const Vector2& start, const Vector2& end, const Color& color, bool filled)
+{
+	Vector2 vertices[2] = { start, end };
+	if (!order_.Reserve(order_.Count() + 1) || !lines_.Add(vertices, color, ShapeFlags(filled))) return false;
+	return Push(SHAPE_LINE, lines_.Count() - 1);
+}
+
+bool Scene::AddTriangle(const Vector2* vertices, const Color& color, bool filled)
+{
+	if (!order_.Reserve(order_.Count() + 1) || !triangles_.Add(vertices, color, ShapeFlags(filled))) return false;
+	return Push(SHAPE_TRIANGLE, triangles_.Count() - 1);
+}
+
+bool Scene::AddQuad(const Vector2* vertices, const Color& color, bool filled)
+{
+	if (!order_.Reserve(order_.Count() + 1) || !quads_.Add(vertices, color, ShapeFlags(filled))) return false;
+	return Push(SHAPE_QUAD, quads_.Count() - 1);
+}
+
+bool Scene::AddCircle(const Vector2& center, float radius, const Color& color, bool filled)
+{
+	if (!order_.Reserve(order_.Count() + 1) || !circles_.Add(center, radius, color, ShapeFlags(filled))) return false;
+	return Push(SHAPE_CIRCLE, circles_.Count() - 1);
+}
+
+bool Scene::AddStroke(const Vector2* points, size_t count, const Color& color)
+{
+	if (!order_.Reserve(order_.Count() + 1) || !strokes_.Add(points, count, color, 0)) return false;
+	return Push(SHAPE_STROKE, strokes_.Count() - 1);
+}
+
+bool Scene::Add(const ShapeData& shape)
+{
+	// order_ has room for the shape first, so nothing fails once its arrays took it
+	if (!order_.Reserve(order_.Count() + 1)) return false;
+	switch (shape.type)
+	{
+	case SHAPE_LINE:
+		if (!lines_.Add(shape.vertices, shape.color, shape.flags)) return false;
+		if (!Push(SHAPE_LINE, lines_.Count() - 1)) return false;
+		break;
+	case SHAPE_TRIANGLE:
+		if (!triangles_.Add(shape.vertices, shape.color, shape.flags)) return false;
+		if (!Push(SHAPE_TRIANGLE, triangles_.Count() - 1)) return false;
+		break;
+	case SHAPE_QUAD:
+		if (!quads_.Add(shape.vertices, shape.color, shape.flags)) return false;
+		if (!Push(SHAPE_QUAD, quads_.Count() - 1)) return false;
+		break;
+	case SHAPE_CIRCLE:
+		if (!circles_.Add(shape.vertices[0], shape.radius, shape.color, shape.flags)) return false;
+		if (!Push(SHAPE_CIRCLE, circles_.Count() - 1)) return false;
+		break;
+	case SHAPE_STROKE:
+		if (!strokes_.Add(shape.points, shape.point_count, shape.color, shape.flags)) return false;
+		if (!Push(SHAPE_STROKE, strokes_.Count() - 1)) return false;
+		break;
+	default:
+		if (!points_.Add(shape.vertices, shape.color, shape.flags)) return false;
+		if (!Push(SHAPE_POINT, points_.Count() - 1)) return false;
+		break;
+	}
+	if (shape.flags & SHAPE_DELETED)
+		index_.Remove((unsigned int)order_.Count() - 1);
+	return true;
+}
+
+ShapeData Scene::Get(size_t z) const
+{
+	const ShapeRef& ref = order_[z];
+	ShapeData shape;
+	shape.type = ref.type;
+	shape.flags = Flags(z);
+	shape.radius = 0;
+	shape.points = NULL;
+	shape.point_count = 0;
+	switch (ref.type)
+	{
+	case SHAPE_LINE:
+		CopyVertices(lines_, ref.index, shape.vertices);
+		shape.color = lines_.ShapeColor(ref.index);
+		break;
+	case SHAPE_TRIANGLE:
+		CopyVertices(triangles_, ref.index, shape.vertices);
+		shape.color = triangles_.ShapeColor(ref.index);
+		break;
+	case SHAPE_QUAD:
+		CopyVertices(quads_, ref.index, shape.vertices);
+		shape.color = quads_.ShapeColor(ref.index);
+		break;
+	case SHAPE_CIRCLE:
+		shape.vertices[0] = circles_.Vertex(ref.index, 0);
+		shape.radius = circles_.radii[ref.index];
+		shape.color = circles_.ShapeColor(ref.index);
+		break;
+	case SHAPE_STROKE:
+		shape.points = strokes_.Points(ref.index);
+		shape.point_count = strokes_.spans[ref.index].count;
+		shape.color = strokes_.colors[ref.index];
+		break;
+	default:
+		shape.vertices[0] = points_.Vertex(ref.index, 0);
+		shape.color = points_.ShapeColor(ref.index);
+		break;
+	}
+	return shape;
+}
+
+void Scene::PopBack()
+{
+	if (order_.Empty()) return;
+	// the top shape is always the last one of its type
+	switch (order_.Back().type)
+	{
+	case SHAPE_POINT:
+		points_.PopBack();
+		PointChanged(points_.Count());
+		break;
+	case SHAPE_LINE: lines_.PopBack(); break;
+	case SHAPE_TRIANGLE: triangles_.PopBack(); break;
+	case SHAPE_QUAD: quads_.PopBack(); break;
+	case SHAPE_CIRCLE: circles_.PopBack(); break;
+	case SHAPE_STROKE: strokes_.PopBack(); break;
+	}
+	if (order_.Back().type != SHAPE_POINT)
+		shapes_version_++;
+	order_.PopBack();
+	index_.Remove((unsigned int)order_.Count());
+	version_++;
+}
+
+void Scene::Clear()
+{
+	points_.Clear();
+	lines_.Clear();
+	triangles_.Clear();
+	quads_.Clear();
+	circles_.Clear();
+	strokes_.Clear();
+	order_.Clear();
+	index_.Clear();
+	packed_.Detach(); // the arrays keep borrowing from the file, it stays open
+	NewPointsEpoch();
+	ResetBounds();
+	version_++;
+	shapes_version_++;
+}
+
+void Scene::Release()
+{
+	points_.Release();
+	lines_.Release();
+	triangles_.Release();
+	quads_.Release();
+	circles_.Release();
+	strokes_.Release();
+	order_.Release();
+	index_.Clear();
+	packed_.Detach();
+	delete file_;
+	file_ = NULL;
+	point_changes_.Release();
+	points_epoch_ = ++last_points_epoch;
+	ResetBounds();
+	version_++;
+	shapes_version_++;
+}
+
+bool Scene::Move(size_t z, float dx, float dy)
+{
+	const ShapeRef& ref = order_[z];
+	bool moved;
+	switch (ref.type)
+	{
+	case SHAPE_LINE: moved = MoveShape(lines_, z, dx, dy); break;
+	case SHAPE_TRIANGLE: moved = MoveShape(triangles_, z, dx, dy); break;
+	case SHAPE_QUAD: moved = MoveShape(quads_, z, dx, dy); break;
+	case SHAPE_CIRCLE: moved = MoveShape(circles_, z, dx, dy); break;
+	case SHAPE_STROKE: moved = MoveStroke(z, dx, dy); break;
+	default: moved = MoveShape(points_, z, dx, dy); break;
+	}
+	if (!moved) return false;
+	Expand(ShapeBounds(z));
+	Changed(z);
+	if (ref.type == SHAPE_POINT)
+		shapes_version_++; // it may move into a region packed without it
+	return true;
+}
+
+// the vertices are put back as they were stored when the index refuses where they went
+template <int N>
+bool Scene::MoveShape(ShapeArrays<N>& shapes, size_t z, float dx, float dy)
+{
+	size_t i = order_[z].index;
+	typename ShapeArrays<N>::Stored before;
+	shapes.Store(i, &before);
+	if (!MoveVertices(shapes, i, dx, dy)) return false;
+	if (Reindex(z)) return true;
+	shapes.Restore(i, before);
+	return false;
+}
+
+bool Scene::MoveStroke(size_t z, float dx, float dy)
+{
+	size_t i = order_[z].index;
+	Vector2* points = strokes_.Points(i);
+	unsigned int count = strokes_.spans[i].count;
+	vector<Vector2> before(points, points + count);
+	for (unsigned int j = 0; j < count; j++)
+	{
+		points[j].x += dx;
+		points[j].y += dy;
+	}
+	if (Reindex(z)) return true;
+	copy(before.begin(), before.end(), points);
+	return false;
+}
+
+// shape z moved, false when the index can not hold its new bounds and kept the old ones
+bool Scene::Reindex(size_t z)
+{
+	if (Deleted(z)) return true;
+	if (!index_.Update((unsigned int)z, ShapeBounds(z))) return false;
+	Flags(z) |= SHAPE_REINDEXED;
+	return true;
+}
+
+void Scene::SetHidden(size_t z, bool hidden)
+{
+	unsigned char& flags = Flags(z);
+	unsigned char changed = hidden ? (flags | SHAPE_HIDDEN) : (flags & ~SHAPE_HIDDEN);
+	if (changed == flags) return;
+	flags = changed;
+	Changed(z);
+}
+
+void Scene::SetColor(size_t z, const Color& color)
+{
+	const ShapeRef& ref = order_[z];
+	switch (ref.type)
+	{
+	case SHAPE_LINE: lines_.SetColor(ref.index, color); break;
+	case SHAPE_TRIANGLE: triangles_.SetColor(ref.index, color); break;
+	case SHAPE_QUAD: quads_.SetColor(ref.index, color); break;
+	case SHAPE_CIRCLE: circles_.SetColor(ref.index, color); break;
+	case SHAPE_STROKE: strokes_.colors[ref.index] = color; break;
+	default: points_.SetColor(ref.index, color); break;
+	}
+	Changed(z);
+}
+
+void Scene::Delete(size_t z)
+{
+	if (Deleted(z)) return;
+	Flags(z) |= SHAPE_DELETED;
+	index_.Remove((unsigned int)z);
+	Changed(z);
+}
+
+bool Scene::Restore(size_t z)
+{
+	if (!Deleted(z)) return true;
+	if (!index_.Insert((unsigned int)z, ShapeBounds(z))) return false;
+	Flags(z) &= ~SHAPE_DELETED;
+	Flags(z) |= SHAPE_REINDEXED;
+	Changed(z);
+	if (order_[z].type == SHAPE_POINT)
+		shapes_version_++; // like a moved point
+	return true;
+}
+
+void Scene::SetPointStyle(const PointStyle& style)
+{
+	point_style_ = style;
+	if (!(point_style_.size >= 1)) point_style_.size = 1;
+	if (point_style_.size > POINT_MAX_SIZE) point_style_.size = POINT_MAX_SIZE;
+	version_++;
+}
+
+void Scene::Swap(Scene& other)
+{
+	points_.Swap(other.points_);
+	lines_.Swap(other.lines_);
+	triangles_.Swap(other.triangles_);
+	quads_.Swap(other.quads_);
+	circles_.Swap(other.circles_);
+	strokes_.Swap(other.strokes_);
+	order_.Swap(other.order_);
+	index_.Swap(other.index_);
+	packed_.Swap(other.packed_);
+	MappedFile* file = file_;
+	file_ = other.file_;
+	other.file_ = file;
+	Rect bounds = bounds_;
+	bounds_ = other.bounds_;
+	other.bounds_ = bounds;
+	PointStyle style = point_style_;
+	point_style_ = other.point_style_;
+	other.point_style_ = style;
+	NewPointsEpoch();
+	other.NewPointsEpoch();
+	version_++;
+	other.version_++;
+	shapes_version_++;
+	other.shapes_version_++;
+}
+
+bool Scene::SetCompact(bool compact)
+{
+	if (compact == Compact()) return true;
+	// all types get their room first, the scene is never left half converted
+	if (!points_.Reserve(points_.Count(), compact) || !lines_.Reserve(lines_.Count(), compact)
+		|| !triangles_.Reserve(triangles_.Count(), compact) || !quads_.Reserve(quads_.Count(), compact)
+		|| !circles_.Reserve(circles_.Count(), compact))
+	{
+		points_.ReleaseUnused();
+		lines_.ReleaseUnused();
+		triangles_.ReleaseUnused();
+		quads_.ReleaseUnused();
+		circles_.ReleaseUnused();
+		return false;
+	}
+	points_.SetCompact(compact);
+	lines_.SetCompact(compact);
+	triangles_.SetCompact(compact);
+	quads_.SetCompact(compact);
+	circles_.SetCompact(compact);
+	// rounded vertices move the bounds a little, the index is built again without the file's
+	packed_.Detach();
+	index_.Clear();
+	ResetBounds();
+	for (size_t z = 0; z < order_.Count(); z++)
+	{
+		Rect box = ShapeBounds(z);
+		// a shape rounded out of what the index can hold is erased, as if it had been deleted
+		if (!Deleted(z) && !index_.Insert((unsigned int)z, box))
+		{
+			Flags(z) |= SHAPE_DELETED;
+			continue;
+		}
+		Expand(box);
+	}
+	NewPointsEpoch();
+	version_++;
+	shapes_version_++;
+	return true;
+}
+
+void Scene::Query(const Rect& rect, vector<unsigned int>* result) const
+{
+	index_.Query(rect, result);
+	if (packed_.Count() == 0) return;
+	size_t first = result->size();
+	packed_.Query(rect, result);
+	// drop packed entries of shapes erased, moved or replaced since the file was opened
+	size_t kept = first;
+	for (size_t i = first; i < result->size(); i++)
+	{
+		unsigned int z = (*result)[i];
+		if (z < order_.Count() && !(Flags(z) & (SHAPE_DELETED | SHAPE_REINDEXED)))
+			(*result)[kept++] = z;
+	}
+	result->resize(kept);
+}
+
+size_t Scene::Pick(const Vector2& p, float tolerance) const
+{
+	Rect around = { p.x - tolerance, p.y - tolerance, p.x + tolerance, p.y + tolerance };
+	picked_.clear();
+	Query(around, &picked_);
+	size_t top = NO_SHAPE;
+	for (size_t i = 0; i < picked_.size(); i++)
+	{
+		size_t z = picked_[i];
+		if ((top == NO_SHAPE || z > top) && HitShape(z, p, tolerance))
+			top = z;
+	}
+	return top;
+}
+
+bool Scene::HitShape(size_t z, const Vector2& p, float tolerance) const
+{
+	const ShapeRef& ref = order_[z];
+	bool filled = (Flags(z) & SHAPE_FILLED) != 0;
+	Vector2 polygon[4];
+	switch (ref.type)
+	{
+	case SHAPE_LINE:
+		CopyVertices(lines_, ref.index, polygon);
+		return SegmentDistance2(p, polygon[0], polygon[1]) <= tolerance * tolerance;
+	case SHAPE_TRIANGLE:
+		CopyVertices(triangles_, ref.index, polygon);
+		return (filled && PolygonContains(polygon, 3, p)) || PolygonEdgeHit(polygon, 3, p, tolerance);
+	case SHAPE_QUAD:
+		CopyVertices(quads_, ref.index, polygon);
+		return (filled && PolygonContains(polygon, 4, p)) || PolygonEdgeHit(polygon, 4, p, tolerance);
+	case SHAPE_CIRCLE:
+	{
+		Vector2 c = circles_.Vertex(ref.index, 0);
+		float r = circles_.radii[ref.index];
+		float d = sqrtf((p.x - c.x) * (p.x - c.x) + (p.y - c.y) * (p.y - c.y));
+		return filled ? d <= r + tolerance : fabsf(d - r) <= tolerance;
+	}
+	case SHAPE_STROKE:
+	{
+		const Vector2* points = strokes_.Points(ref.index);
+		unsigned int n = strokes_.spans[ref.index].count;
+		for (unsigned int i = 1; i < n; i++)
+			if (SegmentDistance2(p, points[i - 1], points[i]) <= tolerance * tolerance)
+				return true;
+		return false;
+	}
+	default:
+	{
+		Vector2 v = points_.Vertex(ref.index, 0);
+		return (p.x - v.x) * (p.x - v.x) + (p.y - v.y) * (p.y - v.y) <= tolerance * tolerance;
+	}
+	}
+}
+
+Rect Scene::ShapeBounds(size_t z) const
+{
+	const ShapeRef& ref = order_[z];
+	switch (ref.type)
+	{
+	case SHAPE_LINE: return ShapeVertexBounds(lines_, ref.index);
+	case SHAPE_TRIANGLE: return ShapeVertexBounds(triangles_, ref.index);
+	case SHAPE_QUAD: return ShapeVertexBounds(quads_, ref.index);
+	case SHAPE_CIRCLE:
+	{
+		Vector2 c = circles_.Vertex(ref.index, 0);
+		float r = circles_.radii[ref.index];
+		Rect box = { c.x - r, c.y - r, c.x + r, c.y + r };
+		return box;
+	}
+	case SHAPE_STROKE: return VertexBounds(strokes_.Points(ref.index), 0, strokes_.spans[ref.index].count);
+	default: return ShapeVertexBounds(points_, ref.index);
+	}
+}
+
+size_t Scene::MemoryUsage() const
+{
+	return points_.MemoryUsage() + lines_.MemoryUsage() + triangles_.MemoryUsage() + quads_.MemoryUsage()
+		+ circles_.MemoryUsage() + strokes_.MemoryUsage() + order_.MemoryUsage() + point_changes_.MemoryUsage() + index_.MemoryUsage();
+}
+
+// the shape just added to its arrays goes on top, false when the index can not hold it and it is
+// taken back
+bool Scene::Push(ShapeType type, size_t index)
+{
+	ShapeRef ref;
+	ref.type = type;
+	ref.index = (unsigned int)index;
+	order_.PushBack(ref);
+	Rect box = ShapeBounds(order_.Count() - 1);
+	if (!index_.Insert((unsigned int)order_.Count() - 1, box))
+	{
+		PopBack();
+		return false;
+	}
+	Expand(box);
+	if (order_.Count() <= packed_.Count())
+		Flags(order_.Count() - 1) |= SHAPE_REINDEXED; // replaces a shape erased since the file was opened
+	if (type != SHAPE_POINT)
+		shapes_version_++;
+	version_++;
+	return true;
+}
+
+const unsigned char& Scene::Flags(size_t z) const
+{
+	const ShapeRef& ref = order_[z];
+	switch (ref.type)
+	{
+	case SHAPE_LINE: return lines_.flags[ref.index];
+	case SHAPE_TRIANGLE: return triangles_.flags[ref.index];
+	case SHAPE_QUAD: return quads_.flags[ref.index];
+	case SHAPE_CIRCLE: return circles_.flags[ref.index];
+	case SHAPE_STROKE: return strokes_.flags[ref.index];
+	default: return points_.flags[ref.index];
+	}
+}
+
+// shape z changed in place, a point is logged for the readers of the points
+void Scene::Changed(size_t z)
+{
+	if (order_[z].type == SHAPE_POINT)
+		PointChanged(order_[z].index);
+	else
+		shapes_version_++;
+	version_++;
+}
+
+void Scene::NewPointsEpoch()
+{
+	point_changes_.Clear();
+	points_epoch_ = ++last_points_epoch;
+}
+
+// log point i for the readers, a full log starts a new epoch instead of growing, and so does a
+// log that can not grow
+void Scene::PointChanged(size_t i)
+{
+	if (point_changes_.Count() >= max(POINT_CHANGES_MIN, points_.Count()) || !point_changes_.PushBack((unsigned int)i))
+		NewPointsEpoch();
+}
+
+void Scene::Expand(const Rect& box)
+{
+	if (box.left < bounds_.left) bounds_.left = box.left;
+	if (box.top < bounds_.top) bounds_.top = box.top;
+	if (box.right > bounds_.right) bounds_.right = box.right;
+	if (box.bottom > bounds_.bottom) bounds_.bottom = box.bottom;
+}
+
+void Scene::ResetBounds()
+{
+	bounds_.left = FLT_MAX;
+	bounds_.top = FLT_MAX;
+	bounds_.right = -FLT_MAX;
+	bounds_.bottom = -FLT_MAX;
+}
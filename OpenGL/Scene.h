@@ -0,0 +1,557 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "Geometry.h"
+#include "Arena.h"
+#include "SpatialIndex.h"
+#include "MappedFile.h"
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+class PaintLayer;
+
+enum ShapeType
+{
+	SHAPE_POINT,
+	SHAPE_LINE,
+	SHAPE_TRIANGLE,
+	SHAPE_QUAD,
+	SHAPE_CIRCLE,
+	SHAPE_STROKE, // freehand polyline of the brush
+	SHAPE_TYPE_COUNT
+};
+// style flags of a stored shape
+const unsigned char SHAPE_FILLED = 0x01;
+const unsigned char SHAPE_HIDDEN = 0x02; // not drawn, e.g. while it is dragged
+const unsigned char SHAPE_DELETED = 0x04; // erased but kept in place so the erase can be undone
+const unsigned char SHAPE_INVISIBLE = SHAPE_HIDDEN | SHAPE_DELETED;
+const unsigned char SHAPE_REINDEXED = 0x08; // its entry in the packed index of an opened file is stale
+const unsigned char SHAPE_TRANSIENT = SHAPE_HIDDEN | SHAPE_REINDEXED; // flags not saved
+// z of no shape
+const size_t NO_SHAPE = (size_t)-1;
+// point changes logged before a new points epoch at least, there may be as many as points
+const size_t POINT_CHANGES_MIN = 1 << 16;
+
+enum PointShape
+{
+	POINT_SQUARE,
+	POINT_ROUND
+};
+// how every point of a scene is drawn, size is the side or diameter in pixels
+struct PointStyle
+{
+	float size;
+	unsigned int shape;
+};
+const float POINT_MAX_SIZE = 64;
+
+// entry of the global z-order, the shape type and its index in the arrays of that type
+struct ShapeRef
+{
+	unsigned char type;
+	unsigned int index;
+};
+
+// Compact storage keeps a shape's vertices as 16 bit offsets from the corner of a tile. The
+// quantum of a shape is COMPACT_QUANTUM times 2^scale, the finest whose tile range holds all
+// of its vertices, so shapes of normal size keep 1/32 unit and huge ones get coarser.
+const float COMPACT_QUANTUM = 1.0f / 32; // world units of a quantum at scale 0
+const int COMPACT_TILE = 1 << 14; // quanta per tile side
+const int COMPACT_MAX_SCALE = 100;
+struct ShapeTile
+{
+	short x; // the corner is (x, y) * COMPACT_TILE quanta
+	short y;
+	unsigned char scale;
+};
+struct PackedVertex
+{
+	short x; // quanta from the tile corner
+	short y;
+};
+// false when the vertices are not finite, they are then all stored at the origin
+bool EncodeVertices(const Vector2* vertices, int n, ShapeTile* tile, PackedVertex* packed);
+inline Vector2 DecodeVertex(const ShapeTile& tile, const PackedVertex& packed)
+{
+	// both products are exact, only the sum is rounded like a float vertex would be
+	float quantum = ldexpf(COMPACT_QUANTUM, tile.scale);
+	float size = quantum * COMPACT_TILE;
+	Vector2 v = { tile.x * size + packed.x * quantum, tile.y * size + packed.y * quantum };
+	return v;
+}
+
+// arrays of one shape type, shape i owns vertices [i * N, i * N + N). In compact storage the
+// vertices and colors live in tiles, packed_vertices and packed_colors instead, all but the first
+// floats shapes, e.g. those of an opened file, which keep the float storage they came in.
+// Compact shape i is entry i - floats of the compact arrays
+template <int N>
+struct ShapeArrays
+{
+	ChunkArray<Vector2> vertices;
+	ChunkArray<Color> colors;
+	ChunkArray<unsigned char> flags;
+	ChunkArray<ShapeTile> tiles;
+	ChunkArray<PackedVertex> packed_vertices;
+	ChunkArray<unsigned int> packed_colors;
+	bool compact;
+	size_t floats; // shapes kept in float storage in compact mode, 0 in float mode
+
+	ShapeArrays() { compact = false; floats = 0; }
+	size_t Count() const { return flags.Count(); }
+	bool Packed(size_t i) const { return compact && i >= floats; } // shape i is in compact storage
+	Vector2 Vertex(size_t i, int j) const
+	{
+		if (Packed(i)) return DecodeVertex(tiles[i - floats], packed_vertices[(i - floats) * N + j]);
+		return vertices[i * N + j];
+	}
+	Color ShapeColor(size_t i) const { return Packed(i) ? UnpackColor(packed_colors[i - floats]) : colors[i]; }
+	unsigned int PackedColor(size_t i) const { return Packed(i) ? packed_colors[i - floats] : PackColor(colors[i]); }
+	// false when compact storage can not hold the vertices, nothing changes then
+	bool SetVertices(size_t i, const Vector2* shape_vertices)
+	{
+		if (Packed(i))
+		{
+			ShapeTile tile;
+			PackedVertex packed[N];
+			if (!EncodeVertices(shape_vertices, N, &tile, packed)) return false;
+			i -= floats;
+			tiles[i] = tile;
+			for (int j = 0; j < N; j++)
+				packed_vertices[i * N + j] = packed[j];
+			return true;
+		}
+		for (int j = 0; j < N; j++)
+			vertices[i * N + j] = shape_vertices[j];
+		return true;
+	}
+	void SetColor(size_t i, const Color& color)
+	{
+		if (Packed(i)) packed_colors[i - floats] = PackColor(color);
+		else colors[i] = color;
+	}
+	// vertices of a shape as they are stored, Restore writes them back exactly
+	struct Stored
+	{
+		Vector2 vertices[N];
+		ShapeTile tile;
+		PackedVertex packed[N];
+	};
+	void Store(size_t i, Stored* stored) const
+	{
+		bool packed = Packed(i);
+		size_t k = packed ? i - floats : i;
+		for (int j = 0; j < N; j++)
+		{
+			if (packed) stored->packed[j] = packed_vertices[k * N + j];
+			else stored->vertices[j] = vertices[k * N + j];
+		}
+		if (packed) stored->tile = tiles[k];
+	}
+	void Restore(size_t i, const Stored& stored)
+	{
+		bool packed = Packed(i);
+		size_t k = packed ? i - floats : i;
+		for (int j = 0; j < N; j++)
+		{
+			if (packed) packed_vertices[k * N + j] = stored.packed[j];
+			else vertices[k * N + j] = stored.vertices[j];
+		}
+		if (packed) tiles[k] = stored.tile;
+	}
+	// room for count shapes in compact or float storage, the float ones kept in compact mode
+	// aside. false when out of memory
+	bool Reserve(size_t count, bool in_compact)
+	{
+		if (!flags.Reserve(count)) return false;
+		if (in_compact)
+		{
+			size_t packed = count - std::min(count, floats);
+			return tiles.Reserve(packed) && packed_vertices.Reserve(packed * N) && packed_colors.Reserve(packed);
+		}
+		return vertices.Reserve(count * N) && colors.Reserve(count);
+	}
+	// store the shapes added from now on compact, those there are stay in float storage and are
+	// not copied. O(1)
+	void CompactFrom()
+	{
+		compact = true;
+		floats = Count();
+	}
+	// free the arrays of the storage not in use, they hold no shape
+	void ReleaseUnused()
+	{
+		if (compact && floats == 0)
+		{
+			vertices.Release();
+			colors.Release();
+		}
+		else
+		{
+			tiles.Release();
+			packed_vertices.Release();
+			packed_colors.Release();
+		}
+	}
+	// false when out of memory or compact storage can not hold the vertices, nothing is added then
+	bool Add(const Vector2* shape_vertices, const Color& color, unsigned char shape_flags)
+	{
+		if (!Reserve(Count() + 1, compact)) return false;
+		if (compact)
+		{
+			ShapeTile tile;
+			PackedVertex packed[N];
+			if (!EncodeVertices(shape_vertices, N, &tile, packed)) return false;
+			tiles.PushBack(tile);
+			for (int i = 0; i < N; i++)
+				packed_vertices.PushBack(packed[i]);
+			packed_colors.PushBack(PackColor(color));
+		}
+		else
+		{
+			for (int i = 0; i < N; i++)
+				vertices.PushBack(shape_vertices[i]);
+			colors.PushBack(color);
+		}
+		flags.PushBack(shape_flags);
+		return true;
+	}
+	void PopBack()
+	{
+		if (Packed(Count() - 1))
+		{
+			tiles.PopBack();
+			packed_vertices.PopBack(N);
+			packed_colors.PopBack();
+		}
+		else
+		{
+			vertices.PopBack(N);
+			colors.PopBack();
+			if (compact)
+				floats--;
+		}
+		flags.PopBack();
+	}
+	void Clear()
+	{
+		vertices.Clear();
+		colors.Clear();
+		flags.Clear();
+		tiles.Clear();
+		packed_vertices.Clear();
+		packed_colors.Clear();
+		floats = 0;
+	}
+	void Release()
+	{
+		vertices.Release();
+		colors.Release();
+		flags.Release();
+		tiles.Release();
+		packed_vertices.Release();
+		packed_colors.Release();
+		floats = 0;
+	}
+	void Swap(ShapeArrays& other)
+	{
+		vertices.Swap(other.vertices);
+		colors.Swap(other.colors);
+		flags.Swap(other.flags);
+		tiles.Swap(other.tiles);
+		packed_vertices.Swap(other.packed_vertices);
+		packed_colors.Swap(other.packed_colors);
+		std::swap(compact, other.compact);
+		std::swap(floats, other.floats);
+	}
+	// convert every shape to compact or float storage, vertices are rounded to their quantum.
+	// false when out of memory, the storage is unchanged then
+	bool SetCompact(bool on)
+	{
+		if (on == compact) return true;
+		size_t count = Count();
+		if (!Reserve(count, on))
+		{
+			ReleaseUnused();
+			return false;
+		}
+		if (on)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				Vector2 shape_vertices[N];
+				for (int j = 0; j < N; j++)
+					shape_vertices[j] = vertices[i * N + j];
+				ShapeTile tile;
+				PackedVertex packed[N];
+				EncodeVertices(shape_vertices, N, &tile, packed);
+				tiles.PushBack(tile);
+				for (int j = 0; j < N; j++)
+					packed_vertices.PushBack(packed[j]);
+				packed_colors.PushBack(PackColor(colors[i]));
+			}
+			vertices.Release();
+			colors.Release();
+		}
+		else
+		{
+			// the shapes kept in float storage are where they belong already
+			for (size_t i = 0; i < count - floats; i++)
+			{
+				for (int j = 0; j < N; j++)
+					vertices.PushBack(DecodeVertex(tiles[i], packed_vertices[i * N + j]));
+				colors.PushBack(UnpackColor(packed_colors[i]));
+			}
+			tiles.Release();
+			packed_vertices.Release();
+			packed_colors.Release();
+			floats = 0;
+		}
+		compact = on;
+		return true;
+	}
+	size_t MemoryUsage() const
+	{
+		return vertices.MemoryUsage() + colors.MemoryUsage() + flags.MemoryUsage() +
+			tiles.MemoryUsage() + packed_vertices.MemoryUsage() + packed_colors.MemoryUsage();
+	}
+};
+// circles only need a center and a radius
+struct CircleArrays : public ShapeArrays<1>
+{
+	ChunkArray<float> radii;
+
+	bool Add(const Vector2& center, float radius, const Color& color, unsigned char shape_flags)
+	{
+		if (!radii.Reserve(radii.Count() + 1) || !ShapeArrays<1>::Add(&center, color, shape_flags))
+			return false;
+		radii.PushBack(radius);
+		return true;
+	}
+	void PopBack()
+	{
+		ShapeArrays<1>::PopBack();
+		radii.PopBack();
+	}
+	void Clear()
+	{
+		ShapeArrays<1>::Clear();
+		radii.Clear();
+	}
+	void Release()
+	{
+		ShapeArrays<1>::Release();
+		radii.Release();
+	}
+	void Swap(CircleArrays& other)
+	{
+		ShapeArrays<1>::Swap(other);
+		radii.Swap(other.radii);
+	}
+	size_t MemoryUsage() const { return ShapeArrays<1>::MemoryUsage() + radii.MemoryUsage(); }
+};
+// points of a stroke, a chunk of the point array at most
+const size_t STROKE_MAX_POINTS = ChunkArray<Vector2>::CHUNK_SIZE;
+// where the points of a stroke start and how many it has
+struct StrokeSpan
+{
+	unsigned int first;
+	unsigned int count;
+};
+// Freehand strokes, stroke i owns points [spans[i].first, spans[i].first + spans[i].count).
+// A stroke never crosses into another chunk of points, so its points lie next to each other
+// in memory and are used in place by the renderers.
+struct StrokeArrays
+{
+	ChunkArray<Vector2> points;
+	ChunkArray<StrokeSpan> spans;
+	ChunkArray<Color> colors;
+	ChunkArray<unsigned char> flags;
+
+	size_t Count() const { return flags.Count(); }
+	const Vector2* Points(size_t i) const { return &points[spans[i].first]; }
+	Vector2* Points(size_t i) { return &points[spans[i].first]; }
+	// count must be 2 to STROKE_MAX_POINTS, false when out of memory and nothing is added
+	bool Add(const Vector2* stroke_points, size_t count, const Color& color, unsigned char shape_flags)
+	{
+		// the rest of a chunk too small for the stroke is left unused
+		size_t room = STROKE_MAX_POINTS - (points.Count() & ChunkArray<Vector2>::CHUNK_MASK);
+		size_t end = points.Count() + (count > room ? room : 0) + count;
+		if (!points.Reserve(end) || !spans.Reserve(Count() + 1) || !colors.Reserve(Count() + 1) || !flags.Reserve(Count() + 1))
+			return false;
+		if (count > room)
+		{
+			Vector2 unused = { 0, 0 };
+			for (size_t i = 0; i < room; i++)
+				points.PushBack(unused);
+		}
+		StrokeSpan span = { (unsigned int)points.Count(), (unsigned int)count };
+		for (size_t i = 0; i < count; i++)
+			points.PushBack(stroke_points[i]);
+		spans.PushBack(span);
+		colors.PushBack(color);
+		flags.PushBack(shape_flags);
+		return true;
+	}
+	void PopBack()
+	{
+		points.PopBack(points.Count() - spans.Back().first);
+		spans.PopBack();
+		colors.PopBack();
+		flags.PopBack();
+	}
+	void Clear()
+	{
+		points.Clear();
+		spans.Clear();
+		colors.Clear();
+		flags.Clear();
+	}
+	void Release()
+	{
+		points.Release();
+		spans.Release();
+		colors.Release();
+		flags.Release();
+	}
+	void Swap(StrokeArrays& other)
+	{
+		points.Swap(other.points);
+		spans.Swap(other.spans);
+		colors.Swap(other.colors);
+		flags.Swap(other.flags);
+	}
+	size_t MemoryUsage() const { return points.MemoryUsage() + spans.MemoryUsage() + colors.MemoryUsage() + flags.MemoryUsage(); }
+};
+// copy of one shape of any type, used where shapes leave or reenter the scene
+struct ShapeData
+{
+	unsigned char type;
+	unsigned char flags;
+	Vector2 vertices[4]; // the center of a circle
+	float radius;
+	Color color;
+	// points of a stroke, not copied: they stay where they are until the scene changes
+	const Vector2* points;
+	unsigned int point_count;
+};
+
+// All committed shapes. Each type is stored in its own chunked arrays in world cordinate,
+// order_ keeps the drawing order over all types and index_ finds shapes by position.
+class Scene
+{
+public:
+	Scene();
+	~Scene() { Release(); }
+	// the Add functions return false when out of memory or when the shape is not finite or too far
+	// out for the index, the scene is unchanged then
+	bool AddPoint(const Vector2& position, const Color& color, bool filled);
+	bool AddLine(const Vector2& start, const Vector2& end, const Color& color, bool filled);
+	bool AddTriangle(const Vector2* vertices, const Color& color, bool filled);
+	bool AddQuad(const Vector2* vertices, const Color& color, bool filled);
+	bool AddCircle(const Vector2& center, float radius, const Color& color, bool filled);
+	bool AddStroke(const Vector2* points, size_t count, const Color& color); // 2 to STROKE_MAX_POINTS points
+	bool Add(const ShapeData& shape); // add a copy on top, flags included
+	ShapeData Get(size_t z) const;
+	void PopBack(); // erase the top shape
+	void Clear(); // erase all shapes in O(1), memory is kept for new shapes
+	void Release(); // erase all shapes and free their memory
+	// translate a shape, its index entry is updated in place. false when the index can not hold it
+	// where it would go, it stays where it was then
+	bool Move(size_t z, float dx, float dy);
+	void SetHidden(size_t z, bool hidden);
+	bool Hidden(size_t z) const { return (Flags(z) & SHAPE_HIDDEN) != 0; }
+	void SetColor(size_t z, const Color& color);
+	void SetPointStyle(const PointStyle& style);
+	const PointStyle& GetPointStyle() const { return point_style_; }
+	// Keep the vertices of points, lines, triangles, quads and circles as 16 bit offsets in tiles
+	// and their colors in 4 bytes, decoded when they are read. Vertices are rounded to
+	// COMPACT_QUANTUM at normal sizes. Radii and strokes stay float, strokes are drawn in place.
+	// The mode goes along with the shapes on Swap, files are always written in float.
+	// false when out of memory, the mode is unchanged then
+	bool SetCompact(bool compact);
+	bool Compact() const { return points_.compact; }
+	// erase shape z in O(log n) without moving the shapes above it, Restore brings it back
+	void Delete(size_t z);
+	bool Restore(size_t z); // false when the index can not hold it, it stays erased then
+	bool Deleted(size_t z) const { return (Flags(z) & SHAPE_DELETED) != 0; }
+	// exchange all shapes with another scene in O(1), both versions change
+	void Swap(Scene& other);
+	// write the shapes to a scene file, erased shapes are left out unless keep_erased, then every
+	// shape keeps its z and can be restored. with_index embeds the spatial index, paint is saved
+	// along when given
+	bool Save(const char* path, bool with_index, bool keep_erased = false, const PaintLayer* paint = NULL) const;
+	// replace the shapes with those of a scene file. The file is mapped and its arrays used in place,
+	// nothing is read up front and pages are loaded when shapes are first touched. paint, when
+	// given, is replaced by the paint of the file, which is copied. In compact mode the shapes of
+	// the file stay in float storage and only new shapes are stored compact. Both stay as they
+	// were when the file is refused
+	bool Open(const char* path, PaintLayer* paint = NULL);
+	// topmost shape under p, edges within tolerance hit and so does the inside of filled shapes.
+	// Only the shapes the index finds near p are tested. NO_SHAPE when nothing is hit
+	size_t Pick(const Vector2& p, float tolerance) const;
+	bool HitShape(size_t z, const Vector2& p, float tolerance) const;
+
+	size_t Count() const { return order_.Count(); }
+	const ShapeRef& At(size_t z) const { return order_[z]; }
+	const ShapeArrays<1>& Points() const { return points_; }
+	const ShapeArrays<2>& Lines() const { return lines_; }
+	const ShapeArrays<3>& Triangles() const { return triangles_; }
+	const ShapeArrays<4>& Quads() const { return quads_; }
+	const CircleArrays& Circles() const { return circles_; }
+	const StrokeArrays& Strokes() const { return strokes_; }
+	int Version() const { return version_; } // increase on every change
+	// increase on every change but those of points only, points moved or restored count as well:
+	// renderers that packed the shapes of a region must see them come into it
+	int ShapesVersion() const { return shapes_version_; }
+	// Indices of the points changed in place, in the order they changed: moved, recolored,
+	// erased, restored, hidden or shown, and the top point dropped. Added points are not logged,
+	// they are the ones past the count a reader saw. A new epoch starts when the points are
+	// cleared, swapped or opened, it empties the log and the points have to be read again.
+	// One starts too when the log is full, at POINT_CHANGES_MIN or as many changes as points:
+	// reading all points again costs no more than the changes logged, and the log stays bounded
+	// however long the readers keep up.
+	const ChunkArray<unsigned int>& PointChanges() const { return point_changes_; }
+	int PointsEpoch() const { return points_epoch_; }
+	// box containing every shape, it does not shrink when shapes are erased one by one
+	const Rect& Bounds() const { return bounds_; }
+	Rect ShapeBounds(size_t z) const;
+	// spatial index over the shape bounds, ids are positions in the z-order
+	const SpatialIndex& Index() const { return index_; }
+	// append the shapes whose bounds intersect rect, from the index and the packed index of an opened file
+	void Query(const Rect& rect, std::vector<unsigned int>* result) const;
+	size_t MemoryUsage() const;
+private:
+	bool Push(ShapeType type, size_t index);
+	template <int N>
+	bool MoveShape(ShapeArrays<N>& shapes, size_t z, float dx, float dy);
+	bool MoveStroke(size_t z, float dx, float dy);
+	bool Reindex(size_t z);
+	const unsigned char& Flags(size_t z) const;
+	unsigned char& Flags(size_t z) { return const_cast<unsigned char&>(static_cast<const Scene*>(this)->Flags(z)); }
+	void Expand(const Rect& box);
+	void ResetBounds();
+	void Changed(size_t z);
+	void NewPointsEpoch();
+	void PointChanged(size_t i);
+
+	ShapeArrays<1> points_;
+	ShapeArrays<2> lines_;
+	ShapeArrays<3> triangles_;
+	ShapeArrays<4> quads_;
+	CircleArrays circles_;
+	StrokeArrays strokes_;
+	ChunkArray<ShapeRef> order_;
+	SpatialIndex index_;
+	PackedIndex packed_; // index embedded in the opened file, entries of edited shapes are skipped
+	MappedFile* file_; // opened file the arrays borrow their first chunks from
+	mutable std::vector<unsigned int> picked_; // candidates of the last Pick
+	ChunkArray<unsigned int> point_changes_;
+	PointStyle point_style_;
+	Rect bounds_;
+	int version_;
+	int shapes_version_;
+	int points_epoch_;
+};
+
+#endif
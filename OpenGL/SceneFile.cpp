@@ -0,0 +1,446 @@
+#include "Scene.h"
+#include "SceneFile.h"
+#include "PaintLayer.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+// buffered output that counts its position, ftell is 32 bits on some platforms
+class FileWriter
+{
+public:
+	FileWriter(FILE* file) { file_ = file; position_ = 0; ok_ = true; }
+	void Write(const void* data, size_t size)
+	{
+		if (size > 0 && fwrite(data, 1, size, file_) != size)
+			ok_ = false;
+		position_ += size;
+	}
+	void Zeros(unsigned long long size)
+	{
+		static const char zeros[SCENE_FILE_ALIGNMENT] = { 0 };
+		while (size > 0)
+		{
+			size_t n = size < sizeof(zeros) ? (size_t)size : sizeof(zeros);
+			Write(zeros, n);
+			size -= n;
+		}
+	}
+	void Align() { Zeros((SCENE_FILE_ALIGNMENT - position_ % SCENE_FILE_ALIGNMENT) % SCENE_FILE_ALIGNMENT); }
+	unsigned long long Position() const { return position_; }
+	bool Ok() const { return ok_; }
+private:
+	FILE* file_;
+	unsigned long long position_;
+	bool ok_;
+};
+
+// start a section on a page boundary
+template <class T>
+static void BeginSection(FileWriter& writer, SceneFileRange* range)
+{
+	writer.Align();
+	range->offset = writer.Position();
+	range->count = 0;
+	range->element_size = sizeof(T);
+	range->reserved = 0;
+}
+// pad a section of chunked array elements to a whole chunk
+template <class T>
+static void EndSection(FileWriter& writer, SceneFileRange* range)
+{
+	const size_t chunk = ChunkArray<T>::CHUNK_SIZE;
+	writer.Zeros((chunk - range->count % chunk) % chunk * sizeof(T));
+}
+
+// elements of the shapes still on the canvas, n per shape
+template <class T>
+static void WriteArray(FileWriter& writer, const ChunkArray<T>& values, int n, const ChunkArray<unsigned char>& flags, bool compact, SceneFileRange* range)
+{
+	const size_t chunk = ChunkArray<T>::CHUNK_SIZE;
+	BeginSection<T>(writer, range);
+	if (!compact)
+	{
+		// nothing erased, whole chunks are written as they are
+		for (size_t first = 0; first < values.Count(); first += chunk)
+			writer.Write(&values[first], (values.Count() - first < chunk ? values.Count() - first : chunk) * sizeof(T));
+		range->count = values.Count();
+	}
+	else
+	{
+		for (size_t i = 0; i < flags.Count(); i++)
+		{
+			if (flags[i] & SHAPE_DELETED) continue;
+			for (int j = 0; j < n; j++)
+				writer.Write(&values[i * n + j], sizeof(T));
+			range->count += n;
+		}
+	}
+	EndSection<T>(writer, range);
+}
+
+static void WriteFlags(FileWriter& writer, const ChunkArray<unsigned char>& flags, bool compact, SceneFileRange* range)
+{
+	unsigned char buffer[SCENE_FILE_ALIGNMENT];
+	size_t used = 0;
+	BeginSection<unsigned char>(writer, range);
+	for (size_t i = 0; i < flags.Count(); i++)
+	{
+		if (compact && (flags[i] & SHAPE_DELETED)) continue;
+		buffer[used++] = flags[i] & ~SHAPE_TRANSIENT;
+		if (used == sizeof(buffer))
+		{
+			writer.Write(buffer, used);
+			used = 0;
+		}
+		range->count++;
+	}
+	writer.Write(buffer, used);
+	EndSection<unsigned char>(writer, range);
+}
+
+// shapes in compact storage are decoded and written as float like the others
+template <int N>
+static void WriteDecoded(FileWriter& writer, const ShapeArrays<N>& shapes, bool compact, SceneFileRange* ranges)
+{
+	BeginSection<Vector2>(writer, &ranges[0]);
+	for (size_t i = 0; i < shapes.Count(); i++)
+	{
+		if (compact && (shapes.flags[i] & SHAPE_DELETED)) continue;
+		Vector2 vertices[N];
+		for (int j = 0; j < N; j++)
+			vertices[j] = shapes.Vertex(i, j);
+		writer.Write(vertices, sizeof(vertices));
+		ranges[0].count += N;
+	}
+	EndSection<Vector2>(writer, &ranges[0]);
+	BeginSection<Color>(writer, &ranges[1]);
+	for (size_t i = 0; i < shapes.Count(); i++)
+	{
+		if (compact && (shapes.flags[i] & SHAPE_DELETED)) continue;
+		Color color = shapes.ShapeColor(i);
+		writer.Write(&color, sizeof(color));
+		ranges[1].count++;
+	}
+	EndSection<Color>(writer, &ranges[1]);
+}
+
+template <int N>
+static void WriteShapes(FileWriter& writer, const ShapeArrays<N>& shapes, bool compact, SceneFileRange* ranges)
+{
+	if (shapes.compact)
+	{
+		WriteDecoded(writer, shapes, compact, ranges);
+	}
+	else
+	{
+		WriteArray(writer, shapes.vertices, N, shapes.flags, compact, &ranges[0]);
+		WriteArray(writer, shapes.colors, 1, shapes.flags, compact, &ranges[1]);
+	}
+	WriteFlags(writer, shapes.flags, compact, &ranges[2]);
+}
+
+// points of the strokes still on the canvas placed as StrokeArrays::Add places them,
+// a stroke moves to the next chunk when the rest of a chunk is too small
+static void WriteStrokes(FileWriter& writer, const StrokeArrays& strokes, bool compact, SceneFileRange* ranges)
+{
+	SceneFileRange* points = &ranges[0];
+	SceneFileRange* spans = &ranges[1];
+	vector<StrokeSpan> kept;
+	BeginSection<Vector2>(writer, points);
+	for (size_t i = 0; i < strokes.Count(); i++)
+	{
+		if (compact && (strokes.flags[i] & SHAPE_DELETED)) continue;
+		StrokeSpan span = strokes.spans[i];
+		unsigned long long first = span.first;
+		if (compact)
+		{
+			unsigned long long room = STROKE_MAX_POINTS - (points->count & ChunkArray<Vector2>::CHUNK_MASK);
+			first = span.count > room ? points->count + room : points->count;
+		}
+		writer.Zeros((first - points->count) * sizeof(Vector2)); // unused rest of a chunk
+		writer.Write(strokes.Points(i), span.count * sizeof(Vector2));
+		span.first = (unsigned int)first;
+		points->count = first + span.count;
+		kept.push_back(span);
+	}
+	EndSection<Vector2>(writer, points);
+	BeginSection<StrokeSpan>(writer, spans);
+	if (!kept.empty())
+		writer.Write(&kept[0], kept.size() * sizeof(StrokeSpan));
+	spans->count = kept.size();
+	EndSection<StrokeSpan>(writer, spans);
+	WriteArray(writer, strokes.colors, 1, strokes.flags, compact, &ranges[2]);
+	WriteFlags(writer, strokes.flags, compact, &ranges[3]);
+}
+
+bool Scene::Save(const char* path, bool with_index, bool keep_erased, const PaintLayer* paint) const
+{
+	// written next to the target and moved over it at the end, the target may be the mapped file
+	string temp = string(path) + ".tmp";
+	FILE* file = OpenFile(temp.c_str(), "wb");
+	if (file == NULL) return false;
+	setvbuf(file, NULL, _IOFBF, 1 << 20);
+	FileWriter writer(file);
+
+	size_t erased = 0;
+	for (size_t z = 0; z < order_.Count(); z++)
+		if (Deleted(z)) erased++;
+	bool compact = erased > 0 && !keep_erased;
+
+	SceneFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic));
+	header.version = SCENE_FILE_VERSION;
+	header.header_size = sizeof(header);
+	header.bounds = bounds_;
+	header.point_style = point_style_;
+	writer.Write(&header, sizeof(header));
+
+	WriteShapes(writer, points_, compact, &header.sections[SECTION_POINT_VERTICES]);
+	WriteShapes(writer, lines_, compact, &header.sections[SECTION_LINE_VERTICES]);
+	WriteShapes(writer, triangles_, compact, &header.sections[SECTION_TRIANGLE_VERTICES]);
+	WriteShapes(writer, quads_, compact, &header.sections[SECTION_QUAD_VERTICES]);
+	WriteShapes(writer, circles_, compact, &header.sections[SECTION_CIRCLE_VERTICES]);
+	WriteArray(writer, circles_.radii, 1, circles_.flags, compact, &header.sections[SECTION_CIRCLE_RADII]);
+	WriteStrokes(writer, strokes_, compact, &header.sections[SECTION_STROKE_POINTS]);
+
+	// z-order with the type indices renumbered past the erased shapes
+	SceneFileRange* order = &header.sections[SECTION_ORDER];
+	BeginSection<ShapeRef>(writer, order);
+	unsigned int next_index[SHAPE_TYPE_COUNT] = { 0 };
+	for (size_t z = 0; z < order_.Count(); z++)
+	{
+		if (compact && Deleted(z)) continue;
+		ShapeRef ref;
+		memset(&ref, 0, sizeof(ref));
+		ref.type = order_[z].type;
+		ref.index = next_index[ref.type]++;
+		writer.Write(&ref, sizeof(ref));
+		order->count++;
+	}
+	EndSection<ShapeRef>(writer, order);
+
+	vector<PackedIndexNode> packed_nodes;
+	vector<PackedIndexItem> packed_items;
+	if (with_index)
+	{
+		if (erased == 0 && packed_.Count() == 0)
+		{
+			index_.Pack(&packed_nodes, &packed_items);
+		}
+		else
+		{
+			// ids change with the erased shapes, or part of the index is still packed in the opened file.
+			// Erased shapes kept in the file are indexed too, queries skip them by their flag
+			SpatialIndex index;
+			unsigned int id = 0;
+			for (size_t z = 0; z < order_.Count(); z++)
+				if (!compact || !Deleted(z))
+					index.Insert(id++, ShapeBounds(z));
+			index.Pack(&packed_nodes, &packed_items);
+		}
+	}
+	SceneFileRange* nodes = &header.sections[SECTION_INDEX_NODES];
+	BeginSection<PackedIndexNode>(writer, nodes);
+	if (!packed_nodes.empty())
+		writer.Write(&packed_nodes[0], packed_nodes.size() * sizeof(PackedIndexNode));
+	nodes->count = packed_nodes.size();
+	SceneFileRange* items = &header.sections[SECTION_INDEX_ITEMS];
+	BeginSection<PackedIndexItem>(writer, items);
+	if (!packed_items.empty())
+		writer.Write(&packed_items[0], packed_items.size() * sizeof(PackedIndexItem));
+	items->count = packed_items.size();
+
+	size_t tile_count = paint != NULL ? paint->TileCount() : 0;
+	SceneFileRange* tiles = &header.sections[SECTION_PAINT_TILES];
+	BeginSection<SceneFileTile>(writer, tiles);
+	for (size_t i = 0; i < tile_count; i++)
+	{
+		SceneFileTile tile = { paint->Tile(i).x, paint->Tile(i).y };
+		writer.Write(&tile, sizeof(tile));
+	}
+	tiles->count = tile_count;
+	SceneFileRange* pixels = &header.sections[SECTION_PAINT_PIXELS];
+	BeginSection<Pixel>(writer, pixels);
+	for (size_t i = 0; i < tile_count; i++)
+		writer.Write(paint->Tile(i).pixels, PAINT_TILE_BYTES);
+	pixels->count = (unsigned long long)tile_count * PAINT_TILE_SIZE * PAINT_TILE_SIZE;
+
+	bool ok = writer.Ok() && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = fclose(file) == 0 && ok;
+	if (!ok || !MoveFileOver(temp.c_str(), path))
+	{
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+// section of count elements of T that lies inside the file, padded to whole chunks when chunked
+template <class T>
+static T* SectionData(MappedFile& file, const SceneFileRange& range, bool chunked)
+{
+	if (range.element_size != sizeof(T) || range.offset % SCENE_FILE_ALIGNMENT != 0) return NULL;
+	unsigned long long count = range.count;
+	if (chunked)
+		count = (count + ChunkArray<T>::CHUNK_MASK) & ~(unsigned long long)ChunkArray<T>::CHUNK_MASK;
+	if (range.offset > file.Size() || count > (file.Size() - range.offset) / sizeof(T)) return NULL;
+	return (T*)(file.Data() + range.offset);
+}
+
+template <int N>
+static bool BorrowShapes(MappedFile& file, const SceneFileRange* ranges, ShapeArrays<N>* shapes)
+{
+	Vector2* vertices = SectionData<Vector2>(file, ranges[0], true);
+	Color* colors = SectionData<Color>(file, ranges[1], true);
+	unsigned char* flags = SectionData<unsigned char>(file, ranges[2], true);
+	if (vertices == NULL || colors == NULL || flags == NULL) return false;
+	if (ranges[0].count != ranges[2].count * N || ranges[1].count != ranges[2].count) return false;
+	shapes->vertices.Borrow(vertices, (size_t)ranges[0].count);
+	shapes->colors.Borrow(colors, (size_t)ranges[1].count);
+	shapes->flags.Borrow(flags, (size_t)ranges[2].count);
+	return true;
+}
+
+static bool BorrowStrokes(MappedFile& file, const SceneFileRange* ranges, StrokeArrays* strokes)
+{
+	Vector2* points = SectionData<Vector2>(file, ranges[0], true);
+	StrokeSpan* spans = SectionData<StrokeSpan>(file, ranges[1], true);
+	Color* colors = SectionData<Color>(file, ranges[2], true);
+	unsigned char* flags = SectionData<unsigned char>(file, ranges[3], true);
+	if (points == NULL || spans == NULL || colors == NULL || flags == NULL) return false;
+	if (ranges[1].count != ranges[3].count || ranges[2].count != ranges[3].count) return false;
+	// every stroke inside one chunk of the points
+	for (unsigned long long i = 0; i < ranges[1].count; i++)
+	{
+		const StrokeSpan& span = spans[i];
+		if (span.count < 2 || span.count > STROKE_MAX_POINTS || span.first + (unsigned long long)span.count > ranges[0].count
+			|| (span.first & ChunkArray<Vector2>::CHUNK_MASK) + span.count > STROKE_MAX_POINTS)
+			return false;
+	}
+	strokes->points.Borrow(points, (size_t)ranges[0].count);
+	strokes->spans.Borrow(spans, (size_t)ranges[1].count);
+	strokes->colors.Borrow(colors, (size_t)ranges[2].count);
+	strokes->flags.Borrow(flags, (size_t)ranges[3].count);
+	return true;
+}
+
+// every shape of the z-order one of the shapes read, in the order Save numbers them
+static bool CheckOrder(const ShapeRef* order, unsigned long long count, const size_t* type_counts)
+{
+	size_t next_index[SHAPE_TYPE_COUNT] = { 0 };
+	for (unsigned long long z = 0; z < count; z++)
+	{
+		const ShapeRef& ref = order[z];
+		if (ref.type >= SHAPE_TYPE_COUNT || ref.index >= type_counts[ref.type] || ref.index != next_index[ref.type])
+			return false;
+		next_index[ref.type]++;
+	}
+	return true;
+}
+
+// tiles of the file inside the paint limit, each followed by its pixels
+static bool ReadPaint(MappedFile& file, const SceneFileRange* ranges, PaintLayer* paint)
+{
+	const unsigned long long tile_pixels = (unsigned long long)PAINT_TILE_SIZE * PAINT_TILE_SIZE;
+	SceneFileTile* tiles = SectionData<SceneFileTile>(file, ranges[0], false);
+	Pixel* pixels = SectionData<Pixel>(file, ranges[1], false);
+	if (tiles == NULL || pixels == NULL || ranges[1].count % tile_pixels != 0 || ranges[1].count / tile_pixels != ranges[0].count)
+		return false;
+	for (unsigned long long i = 0; i < ranges[0].count; i++)
+	{
+		const SceneFileTile& tile = tiles[i];
+		if (tile.x < -PAINT_MAX_TILE || tile.x >= PAINT_MAX_TILE || tile.y < -PAINT_MAX_TILE || tile.y >= PAINT_MAX_TILE
+			|| !paint->SetTile(tile.x, tile.y, pixels + i * tile_pixels))
+			return false;
+	}
+	return true;
+}
+
+bool Scene::Open(const char* path, PaintLayer* paint)
+{
+	MappedFile* file = new MappedFile();
+	SceneFileHeader header;
+	if (!file->Open(path) || file->Size() < sizeof(header))
+	{
+		delete file;
+		return false;
+	}
+	memcpy(&header, file->Data(), sizeof(header));
+	const SceneFileRange* sections = header.sections;
+	if (memcmp(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != SCENE_FILE_VERSION
+		|| header.header_size != sizeof(header))
+	{
+		delete file;
+		return false;
+	}
+
+	// filled in a scene of its own, this one is left as it was when the file is refused
+	Scene opened;
+	PackedIndexNode* nodes = SectionData<PackedIndexNode>(*file, sections[SECTION_INDEX_NODES], false);
+	PackedIndexItem* items = SectionData<PackedIndexItem>(*file, sections[SECTION_INDEX_ITEMS], false);
+	ShapeRef* order = SectionData<ShapeRef>(*file, sections[SECTION_ORDER], true);
+	float* radii = SectionData<float>(*file, sections[SECTION_CIRCLE_RADII], true);
+	bool ok = nodes != NULL && items != NULL && order != NULL && radii != NULL
+		&& BorrowShapes(*file, &sections[SECTION_POINT_VERTICES], &opened.points_)
+		&& BorrowShapes(*file, &sections[SECTION_LINE_VERTICES], &opened.lines_)
+		&& BorrowShapes(*file, &sections[SECTION_TRIANGLE_VERTICES], &opened.triangles_)
+		&& BorrowShapes(*file, &sections[SECTION_QUAD_VERTICES], &opened.quads_)
+		&& BorrowShapes(*file, &sections[SECTION_CIRCLE_VERTICES], &opened.circles_)
+		&& BorrowStrokes(*file, &sections[SECTION_STROKE_POINTS], &opened.strokes_)
+		&& sections[SECTION_CIRCLE_RADII].count == opened.circles_.Count()
+		&& sections[SECTION_ORDER].count == opened.points_.Count() + opened.lines_.Count() + opened.triangles_.Count()
+			+ opened.quads_.Count() + opened.circles_.Count() + opened.strokes_.Count();
+	if (ok)
+	{
+		size_t type_counts[SHAPE_TYPE_COUNT];
+		type_counts[SHAPE_POINT] = opened.points_.Count();
+		type_counts[SHAPE_LINE] = opened.lines_.Count();
+		type_counts[SHAPE_TRIANGLE] = opened.triangles_.Count();
+		type_counts[SHAPE_QUAD] = opened.quads_.Count();
+		type_counts[SHAPE_CIRCLE] = opened.circles_.Count();
+		type_counts[SHAPE_STROKE] = opened.strokes_.Count();
+		ok = CheckOrder(order, sections[SECTION_ORDER].count, type_counts);
+	}
+	if (ok && sections[SECTION_INDEX_NODES].count > 0)
+	{
+		ok = sections[SECTION_INDEX_ITEMS].count == sections[SECTION_ORDER].count;
+		if (ok)
+			opened.packed_.Attach(nodes, (size_t)sections[SECTION_INDEX_NODES].count, items, (size_t)sections[SECTION_INDEX_ITEMS].count);
+	}
+	opened.file_ = file; // freed with the opened scene if it is refused
+	// paint is read only when asked for, it is copied out of the file
+	PaintLayer opened_paint;
+	if (ok && paint != NULL)
+		ok = ReadPaint(*file, &sections[SECTION_PAINT_TILES], &opened_paint);
+	if (!ok) return false;
+	opened.circles_.radii.Borrow(radii, opened.circles_.Count());
+	opened.order_.Borrow(order, (size_t)sections[SECTION_ORDER].count);
+	opened.bounds_ = header.bounds;
+	opened.SetPointStyle(header.point_style);
+	// without an embedded index every shape is read once to build one, a shape it can not hold,
+	// e.g. one that is not finite, refuses the file
+	if (opened.packed_.Count() == 0)
+	{
+		for (size_t z = 0; z < opened.order_.Count(); z++)
+			if (!opened.Deleted(z) && !opened.index_.Insert((unsigned int)z, opened.ShapeBounds(z)))
+				return false;
+	}
+	// in compact mode the shapes of the file stay in the float storage they are mapped in, with
+	// the file's index, only those added from now on are stored compact
+	if (Compact())
+	{
+		opened.points_.CompactFrom();
+		opened.lines_.CompactFrom();
+		opened.triangles_.CompactFrom();
+		opened.quads_.CompactFrom();
+		opened.circles_.CompactFrom();
+	}
+	Swap(opened);
+	if (paint != NULL)
+		paint->Swap(opened_paint);
+	return true;
+}
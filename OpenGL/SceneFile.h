@@ -0,0 +1,66 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "Geometry.h"
+#include "Scene.h"
+
+// Binary scene file, native byte order and struct layout.
+// Every array of the scene is one section. Sections start on a page boundary and are
+// padded to whole ChunkArray chunks, so the arrays of a mapped file are used in place.
+const char SCENE_FILE_MAGIC[8] = { 'S', 'P', 'S', 'C', 'E', 'N', 'E', 0 };
+const unsigned int SCENE_FILE_VERSION = 4; // 2: strokes, 3: point style, 4: paint
+const unsigned int SCENE_FILE_ALIGNMENT = 4096;
+
+enum SceneFileSection
+{
+	SECTION_POINT_VERTICES,
+	SECTION_POINT_COLORS,
+	SECTION_POINT_FLAGS,
+	SECTION_LINE_VERTICES,
+	SECTION_LINE_COLORS,
+	SECTION_LINE_FLAGS,
+	SECTION_TRIANGLE_VERTICES,
+	SECTION_TRIANGLE_COLORS,
+	SECTION_TRIANGLE_FLAGS,
+	SECTION_QUAD_VERTICES,
+	SECTION_QUAD_COLORS,
+	SECTION_QUAD_FLAGS,
+	SECTION_CIRCLE_VERTICES,
+	SECTION_CIRCLE_COLORS,
+	SECTION_CIRCLE_FLAGS,
+	SECTION_CIRCLE_RADII,
+	SECTION_STROKE_POINTS,
+	SECTION_STROKE_SPANS,
+	SECTION_STROKE_COLORS,
+	SECTION_STROKE_FLAGS,
+	SECTION_ORDER, // ShapeRef z-order
+	SECTION_INDEX_NODES, // optional PackedIndexNode array, count 0 when there is no index
+	SECTION_INDEX_ITEMS, // PackedIndexItem array
+	SECTION_PAINT_TILES, // SceneFileTile of every painted tile
+	SECTION_PAINT_PIXELS, // PAINT_TILE_SIZE rows of PAINT_TILE_SIZE pixels per tile, in the order of the tiles
+	SECTION_COUNT
+};
+struct SceneFileRange
+{
+	unsigned long long offset; // from the start of the file
+	unsigned long long count; // elements
+	unsigned int element_size; // checked on open, a file of another layout is refused
+	unsigned int reserved;
+};
+// position of a paint tile, see PaintTile
+struct SceneFileTile
+{
+	int x;
+	int y;
+};
+struct SceneFileHeader
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int header_size;
+	Rect bounds;
+	PointStyle point_style;
+	SceneFileRange sections[SECTION_COUNT];
+};
+
+#endif
@@ -0,0 +1,359 @@
+#include "SpatialIndex.h"
+#include <cmath>
+#include <new>
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+static inline float BoxCenterX(const Rect& box) { return (box.left + box.right) * 0.5f; }
+static inline float BoxCenterY(const Rect& box) { return (box.top + box.bottom) * 0.5f; }
+static inline float BoxExtent(const Rect& box)
+{
+	float w = box.right - box.left;
+	float h = box.bottom - box.top;
+	return (w > h ? w : h) * 0.5f;
+}
+// quadrant of (x, y) around (cx, cy): bit 0 right, bit 1 bottom
+static inline int Quadrant(float cx, float cy, float x, float y)
+{
+	return (x >= cx ? 1 : 0) | (y >= cy ? 2 : 0);
+}
+
+// half size of the first root around a box of extent
+static inline float FirstRootHalf(float extent)
+{
+	return extent > 256 ? extent * 2 : 256;
+}
+static inline bool RootHolds(float cx, float cy, float half, float x, float y, float extent)
+{
+	return x >= cx - half && x < cx + half && y >= cy - half && y < cy + half && extent <= half;
+}
+
+bool SpatialIndex::Fits(const Rect& box) const
+{
+	float x = BoxCenterX(box);
+	float y = BoxCenterY(box);
+	float extent = BoxExtent(box);
+	if (!(isfinite(x) && isfinite(y) && isfinite(extent))) return false;
+	float cx = x;
+	float cy = y;
+	float half = FirstRootHalf(extent);
+	if (root_ >= 0)
+	{
+		cx = nodes_[root_].cx;
+		cy = nodes_[root_].cy;
+		half = nodes_[root_].half;
+	}
+	while (!RootHolds(cx, cy, half, x, y, extent))
+		if (!GrownRoot(x, y, &cx, &cy, &half)) return false;
+	return isfinite(half);
+}
+
+bool SpatialIndex::Insert(unsigned int id, const Rect& box)
+{
+	if (!Fits(box)) return false;
+	float x = BoxCenterX(box);
+	float y = BoxCenterY(box);
+	float extent = BoxExtent(box);
+	Item item;
+	item.id = id;
+	item.box = box;
+	// out of memory the box is left out, a grown root or longer locations hold nothing yet
+	try
+	{
+		if (locations_.size() <= id)
+		{
+			Location none = { -1, 0 };
+			locations_.resize(id + 1, none);
+		}
+		if (root_ < 0)
+			root_ = NewNode(x, y, FirstRootHalf(extent));
+		while (!RootHolds(nodes_[root_].cx, nodes_[root_].cy, nodes_[root_].half, x, y, extent))
+			GrowRoot(box);
+		Place(root_, item);
+	}
+	catch (const bad_alloc&)
+	{
+		return false;
+	}
+	count_++;
+	return true;
+}
+
+bool SpatialIndex::Update(unsigned int id, const Rect& box)
+{
+	if (!Fits(box)) return false;
+	if (id >= locations_.size() || locations_[id].node < 0) return Insert(id, box);
+	Location location = locations_[id];
+	Rect old = nodes_[location.node].items[location.slot].box;
+	Remove(id);
+	if (Insert(id, box)) return true;
+	// the old box goes back to the node it left, which has room for it
+	Insert(id, old);
+	return false;
+}
+
+void SpatialIndex::Remove(unsigned int id)
+{
+	if (id >= locations_.size() || locations_[id].node < 0) return;
+	Location location = locations_[id];
+	vector<Item>& items = nodes_[location.node].items;
+	items[location.slot] = items.back();
+	locations_[items[location.slot].id].slot = location.slot;
+	items.pop_back();
+	locations_[id].node = -1;
+	count_--;
+}
+
+void SpatialIndex::Clear()
+{
+	nodes_.clear();
+	locations_.clear();
+	root_ = -1;
+	count_ = 0;
+}
+
+void SpatialIndex::Swap(SpatialIndex& other)
+{
+	nodes_.swap(other.nodes_);
+	locations_.swap(other.locations_);
+	swap(root_, other.root_);
+	swap(count_, other.count_);
+}
+
+void SpatialIndex::Query(const Rect& rect, vector<unsigned int>* result) const
+{
+	if (root_ < 0) return;
+	int stack[512]; // three pending siblings per level, float sizes allow about 150 levels
+	int top = 0;
+	stack[top++] = root_;
+	while (top > 0)
+	{
+		const Node& node = nodes_[stack[--top]];
+		float loose = node.half * 2;
+		Rect bounds = { node.cx - loose, node.cy - loose, node.cx + loose, node.cy + loose };
+		if (!RectIntersects(bounds, rect)) continue;
+		for (size_t i = 0; i < node.items.size(); i++)
+			if (RectIntersects(node.items[i].box, rect))
+				result->push_back(node.items[i].id);
+		if (node.children[0] >= 0)
+			for (int i = 0; i < 4; i++)
+				stack[top++] = node.children[i];
+	}
+}
+
+void SpatialIndex::Pack(vector<PackedIndexNode>* nodes, vector<PackedIndexItem>* items) const
+{
+	nodes->clear();
+	items->clear();
+	if (root_ < 0) return;
+	// breadth first, so the root is node 0 and every child comes after its parent
+	vector<int> order(1, root_);
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const Node& node = nodes_[order[i]];
+		PackedIndexNode packed;
+		packed.cx = node.cx;
+		packed.cy = node.cy;
+		packed.half = node.half;
+		for (int j = 0; j < 4; j++)
+		{
+			packed.children[j] = -1;
+			if (node.children[j] >= 0)
+			{
+				packed.children[j] = (int)order.size();
+				order.push_back(node.children[j]);
+			}
+		}
+		packed.first = (unsigned int)items->size();
+		packed.count = (unsigned int)node.items.size();
+		for (size_t j = 0; j < node.items.size(); j++)
+		{
+			PackedIndexItem item = { node.items[j].id, node.items[j].box };
+			items->push_back(item);
+		}
+		nodes->push_back(packed);
+	}
+}
+
+size_t SpatialIndex::MemoryUsage() const
+{
+	size_t size = nodes_.capacity() * sizeof(Node) + locations_.capacity() * sizeof(Location);
+	for (size_t i = 0; i < nodes_.size(); i++)
+		size += nodes_[i].items.capacity() * sizeof(Item);
+	return size;
+}
+
+int SpatialIndex::NewNode(float cx, float cy, float half)
+{
+	Node node;
+	node.cx = cx;
+	node.cy = cy;
+	node.half = half;
+	for (int i = 0; i < 4; i++)
+		node.children[i] = -1;
+	nodes_.push_back(node);
+	return (int)nodes_.size() - 1;
+}
+
+// room for count more nodes, so adding them can not fail halfway
+void SpatialIndex::ReserveNodes(size_t count)
+{
+	if (nodes_.size() + count > nodes_.capacity())
+		nodes_.reserve(max(nodes_.size() + count, nodes_.capacity() * 2));
+}
+
+bool SpatialIndex::GrownRoot(float x, float y, float* cx, float* cy, float* half)
+{
+	*cx += x >= *cx ? *half : -*half;
+	*cy += y >= *cy ? *half : -*half;
+	*half *= 2;
+	// the centers of its quadrants lie within that
+	return isfinite(fabsf(*cx) + *half) && isfinite(fabsf(*cy) + *half);
+}
+
+// double the root toward the box, the old root becomes one quadrant of the new one. Fits said
+// the grown root is finite
+void SpatialIndex::GrowRoot(const Rect& box)
+{
+	ReserveNodes(4);
+	int old_index = root_;
+	float old_cx = nodes_[old_index].cx;
+	float old_cy = nodes_[old_index].cy;
+	float half = nodes_[old_index].half;
+	float cx = old_cx;
+	float cy = old_cy;
+	float new_half = half;
+	GrownRoot(BoxCenterX(box), BoxCenterY(box), &cx, &cy, &new_half);
+	int new_root = NewNode(cx, cy, new_half);
+	int old_quadrant = Quadrant(cx, cy, old_cx, old_cy);
+	for (int i = 0; i < 4; i++)
+	{
+		int child = old_index;
+		if (i != old_quadrant)
+			child = NewNode(cx + (i & 1 ? half : -half), cy + (i & 2 ? half : -half), half);
+		nodes_[new_root].children[i] = child;
+	}
+	root_ = new_root;
+}
+
+// Everything the split needs is allocated before anything moves, out of memory the node just
+// stays a crowded leaf. Crowded children split in turn
+void SpatialIndex::Split(int node)
+{
+	float half = nodes_[node].half * 0.5f;
+	float cx = nodes_[node].cx;
+	float cy = nodes_[node].cy;
+	vector<Item> items;
+	vector<Item> reserved[4];
+	try
+	{
+		ReserveNodes(4);
+		items = nodes_[node].items;
+		size_t counts[4] = { 0, 0, 0, 0 };
+		for (size_t i = 0; i < items.size(); i++)
+			if (BoxExtent(items[i].box) <= half)
+				counts[Quadrant(cx, cy, BoxCenterX(items[i].box), BoxCenterY(items[i].box))]++;
+		for (int i = 0; i < 4; i++)
+			reserved[i].reserve(counts[i]);
+	}
+	catch (const bad_alloc&)
+	{
+		return;
+	}
+	int children[4];
+	for (int i = 0; i < 4; i++)
+	{
+		children[i] = NewNode(cx + (i & 1 ? half : -half), cy + (i & 2 ? half : -half), half);
+		nodes_[children[i]].items.swap(reserved[i]);
+		nodes_[node].children[i] = children[i];
+	}
+	// push down the boxes small enough for a child, the rest stays here
+	nodes_[node].items.clear();
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		int to = node;
+		if (BoxExtent(items[i].box) <= half)
+			to = children[Quadrant(cx, cy, BoxCenterX(items[i].box), BoxCenterY(items[i].box))];
+		nodes_[to].items.push_back(items[i]);
+		locations_[items[i].id].node = to;
+		locations_[items[i].id].slot = (unsigned int)nodes_[to].items.size() - 1;
+	}
+	if (nodes_[node].items.empty())
+		vector<Item>().swap(nodes_[node].items);
+	for (int i = 0; i < 4; i++)
+		if (nodes_[children[i]].items.size() > INDEX_NODE_CAPACITY && half > INDEX_MIN_HALF)
+			Split(children[i]);
+}
+
+void SpatialIndex::Place(int node, const Item& item)
+{
+	float x = BoxCenterX(item.box);
+	float y = BoxCenterY(item.box);
+	float extent = BoxExtent(item.box);
+	while (nodes_[node].children[0] >= 0)
+	{
+		const Node& current = nodes_[node];
+		int child = current.children[Quadrant(current.cx, current.cy, x, y)];
+		if (extent > nodes_[child].half) break;
+		node = child;
+	}
+	vector<Item>& items = nodes_[node].items;
+	items.push_back(item);
+	locations_[item.id].node = node;
+	locations_[item.id].slot = (unsigned int)items.size() - 1;
+	if (nodes_[node].children[0] < 0 && items.size() > INDEX_NODE_CAPACITY && nodes_[node].half > INDEX_MIN_HALF)
+		Split(node);
+}
+
+void PackedIndex::Attach(const PackedIndexNode* nodes, size_t node_count, const PackedIndexItem* items, size_t item_count)
+{
+	nodes_ = nodes;
+	node_count_ = node_count;
+	items_ = items;
+	item_count_ = item_count;
+}
+
+void PackedIndex::Detach()
+{
+	nodes_ = NULL;
+	items_ = NULL;
+	node_count_ = 0;
+	item_count_ = 0;
+}
+
+void PackedIndex::Query(const Rect& rect, vector<unsigned int>* result) const
+{
+	if (node_count_ == 0) return;
+	int stack[512];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		int index = stack[--top];
+		const PackedIndexNode& node = nodes_[index];
+		float loose = node.half * 2;
+		Rect bounds = { node.cx - loose, node.cy - loose, node.cx + loose, node.cy + loose };
+		if (!RectIntersects(bounds, rect)) continue;
+		// the nodes come from a file, they are checked where they are used instead of all on attach
+		if (node.first <= item_count_ && node.count <= item_count_ - node.first)
+		{
+			const PackedIndexItem* items = items_ + node.first;
+			for (unsigned int i = 0; i < node.count; i++)
+				if (RectIntersects(items[i].box, rect))
+					result->push_back(items[i].id);
+		}
+		for (int i = 0; i < 4 && top < 512; i++)
+			if (node.children[i] > index && (size_t)node.children[i] < node_count_)
+				stack[top++] = node.children[i];
+	}
+}
+
+void PackedIndex::Swap(PackedIndex& other)
+{
+	swap(nodes_, other.nodes_);
+	swap(items_, other.items_);
+	swap(node_count_, other.node_count_);
+	swap(item_count_, other.item_count_);
+}
@@ -0,0 +1,106 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include "Geometry.h"
+#include <vector>
+#include <cstddef>
+
+const int INDEX_NODE_CAPACITY = 32; // boxes a leaf holds before it splits
+const float INDEX_MIN_HALF = 0.5f; // nodes smaller than this never split
+
+// node of a packed index, node 0 is the root and children come after their parent,
+// the boxes of the node are items [first, first + count)
+struct PackedIndexNode
+{
+	float cx;
+	float cy;
+	float half;
+	int children[4]; // -1 for a leaf
+	unsigned int first;
+	unsigned int count;
+};
+struct PackedIndexItem
+{
+	unsigned int id;
+	Rect box;
+};
+
+// Loose quadtree over shape bounding boxes, keyed by shape id.
+// A box is kept in the smallest node whose quadrant holds its center and whose size is not smaller
+// than the box, node bounds are loosened to twice the quadrant so the box never sticks out of them.
+// Leaves split when they get crowded and the root grows when a box lands outside of it,
+// so insert, remove and update are O(log n) and need no rebuild.
+// Node sizes are floats and double as the root grows, so boxes far out near the float range, or
+// not finite, can not be held.
+class SpatialIndex
+{
+public:
+	SpatialIndex() { root_ = -1; count_ = 0; }
+	// false when the box can not be held or memory runs out, nothing is inserted then
+	bool Insert(unsigned int id, const Rect& box);
+	void Remove(unsigned int id);
+	// false when the new box can not be held, the old one stays then
+	bool Update(unsigned int id, const Rect& box);
+	// whether Insert would take box, the root grown as far as it needs. O(levels it grows)
+	bool Fits(const Rect& box) const;
+	void Clear();
+	void Swap(SpatialIndex& other);
+	// append the ids of all boxes intersecting rect to result, in no particular order
+	void Query(const Rect& rect, std::vector<unsigned int>* result) const;
+	size_t Count() const { return count_; }
+	size_t MemoryUsage() const;
+	// flatten the tree into the layout of PackedIndex
+	void Pack(std::vector<PackedIndexNode>* nodes, std::vector<PackedIndexItem>* items) const;
+private:
+	struct Item
+	{
+		unsigned int id;
+		Rect box;
+	};
+	struct Node
+	{
+		float cx;
+		float cy;
+		float half;
+		int children[4]; // -1 for a leaf
+		std::vector<Item> items;
+	};
+	struct Location
+	{
+		int node; // -1 when the id is not in the index
+		unsigned int slot;
+	};
+	int NewNode(float cx, float cy, float half);
+	void ReserveNodes(size_t count);
+	// center and half size of the root grown once toward (x, y), false when they are not finite
+	static bool GrownRoot(float x, float y, float* cx, float* cy, float* half);
+	void GrowRoot(const Rect& box);
+	void Split(int node);
+	void Place(int node, const Item& item);
+
+	std::vector<Node> nodes_;
+	std::vector<Location> locations_;
+	int root_;
+	size_t count_;
+};
+
+// Read only quadtree packed by SpatialIndex::Pack, queried in place
+// from memory owned elsewhere, e.g. a mapped file.
+class PackedIndex
+{
+public:
+	PackedIndex() { Detach(); }
+	// nodes out of range are skipped by queries, so the arrays are not read here
+	void Attach(const PackedIndexNode* nodes, size_t node_count, const PackedIndexItem* items, size_t item_count);
+	void Detach();
+	void Query(const Rect& rect, std::vector<unsigned int>* result) const;
+	size_t Count() const { return item_count_; }
+	void Swap(PackedIndex& other);
+private:
+	const PackedIndexNode* nodes_;
+	const PackedIndexItem* items_;
+	size_t node_count_;
+	size_t item_count_;
+};
+
+#endif
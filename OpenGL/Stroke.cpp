@@ -0,0 +1,161 @@
+#include "Stroke.h"
+#include <algorithm>
+#include <cfloat>
+
+using namespace std;
+
+void StrokeSimplifier::Reset(float tolerance, float smoothing, size_t max_points)
+{
+	points_.clear();
+	pending_.clear();
+	fixed_ = 0;
+	samples_ = 0;
+	tolerance_ = tolerance;
+	smoothing_ = smoothing;
+	max_points_ = max(max_points, (size_t)3); // the ends and the newest sample
+}
+
+void StrokeSimplifier::Add(const Vector2& sample)
+{
+	samples_++;
+	if (samples_ == 1)
+	{
+		smoothed_ = sample;
+		points_.push_back(sample);
+		fixed_ = 1;
+		return;
+	}
+	smoothed_.x += (sample.x - smoothed_.x) * (1 - smoothing_);
+	smoothed_.y += (sample.y - smoothed_.y) * (1 - smoothing_);
+	const Vector2& last = pending_.empty() ? points_[fixed_ - 1] : pending_.back();
+	if (smoothed_.x == last.x && smoothed_.y == last.y) return;
+	pending_.push_back(smoothed_);
+
+	// split the run until it fits the chord to the newest sample
+	float tolerance2 = tolerance_ * tolerance_;
+	for (;;)
+	{
+		const Vector2& anchor = points_[fixed_ - 1];
+		size_t n = pending_.size();
+		size_t farthest = n;
+		float worst = tolerance2;
+		for (size_t i = 0; i + 1 < n; i++)
+		{
+			float d = SegmentDistance2(pending_[i], anchor, pending_[n - 1]);
+			if (d > worst)
+			{
+				worst = d;
+				farthest = i;
+			}
+		}
+		if (farthest == n) break;
+		Fix(farthest);
+	}
+	if (pending_.size() >= STROKE_MAX_PENDING)
+		Fix(pending_.size() - 2);
+
+	points_.resize(fixed_);
+	points_.push_back(pending_.back());
+	if (fixed_ >= max_points_)
+		Coarsen();
+}
+
+void StrokeSimplifier::Finish()
+{
+	if (pending_.empty()) return;
+	// the run fits the chord to the newest sample, only the sample itself is fixed
+	points_.resize(fixed_);
+	points_.push_back(pending_.back());
+	fixed_++;
+	pending_.clear();
+	if (fixed_ > max_points_)
+		Coarsen();
+}
+
+// Fix pending_[index] and drop the samples before it. Those samples fitted the chord to a later
+// sample, the chord to this one may need some of them, found by splitting at the farthest
+void StrokeSimplifier::Fix(size_t index)
+{
+	float tolerance2 = tolerance_ * tolerance_;
+	size_t first = 0;
+	points_.resize(fixed_);
+	stack_.clear();
+	stack_.push_back(index);
+	while (!stack_.empty())
+	{
+		size_t end = stack_.back();
+		const Vector2& anchor = points_[fixed_ - 1];
+		size_t farthest = end;
+		float worst = tolerance2;
+		for (size_t i = first; i < end; i++)
+		{
+			float d = SegmentDistance2(pending_[i], anchor, pending_[end]);
+			if (d > worst)
+			{
+				worst = d;
+				farthest = i;
+			}
+		}
+		if (farthest != end)
+		{
+			stack_.push_back(farthest);
+			continue;
+		}
+		points_.push_back(pending_[end]);
+		fixed_++;
+		first = end + 1;
+		stack_.pop_back();
+	}
+	pending_.erase(pending_.begin(), pending_.begin() + index + 1);
+}
+
+// Douglas-Peucker over the fixed points with twice the tolerance until they leave room for the newest sample
+void StrokeSimplifier::Coarsen()
+{
+	bool tail = points_.size() > fixed_;
+	Vector2 newest = points_.back();
+	points_.resize(fixed_);
+	vector<unsigned char> keep;
+	while (fixed_ + (tail ? 1 : 0) > max_points_)
+	{
+		tolerance_ = max(tolerance_ * 2, FLT_MIN);
+		float tolerance2 = tolerance_ * tolerance_;
+		keep.assign(fixed_, 0);
+		keep[0] = 1;
+		keep[fixed_ - 1] = 1;
+		stack_.clear();
+		stack_.push_back(0);
+		stack_.push_back(fixed_ - 1);
+		while (!stack_.empty())
+		{
+			size_t last = stack_.back();
+			stack_.pop_back();
+			size_t first = stack_.back();
+			stack_.pop_back();
+			size_t farthest = last;
+			float worst = tolerance2;
+			for (size_t i = first + 1; i < last; i++)
+			{
+				float d = SegmentDistance2(points_[i], points_[first], points_[last]);
+				if (d > worst)
+				{
+					worst = d;
+					farthest = i;
+				}
+			}
+			if (farthest == last) continue;
+			keep[farthest] = 1;
+			stack_.push_back(first);
+			stack_.push_back(farthest);
+			stack_.push_back(farthest);
+			stack_.push_back(last);
+		}
+		simplified_.clear();
+		for (size_t i = 0; i < fixed_; i++)
+			if (keep[i]) simplified_.push_back(points_[i]);
+		points_.swap(simplified_);
+		fixed_ = points_.size();
+	}
+	if (tail)
+		points_.push_back(newest);
+}
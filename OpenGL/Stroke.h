@@ -0,0 +1,46 @@
+#ifndef STROKE_H
+#define STROKE_H
+
+#include "Geometry.h"
+#include <vector>
+#include <cstddef>
+
+const size_t STROKE_MAX_PENDING = 256; // samples tested against a chord at most, bounds the work per sample
+
+// Simplifies a freehand polyline while its samples arrive. Samples after the last fixed point
+// stay pending while they all lie within tolerance of the chord from that point to the newest
+// sample. When one does not, the run is split at its farthest sample like a Douglas-Peucker step
+// and the points up to there are fixed. A sample costs at most STROKE_MAX_PENDING distance tests
+// however long the stroke grows. Strokes that reach max_points are simplified again with twice
+// the tolerance, so they always fit, and may then stray up to the sum of the tolerances used.
+class StrokeSimplifier
+{
+public:
+	StrokeSimplifier() { Reset(0, 0, 2); }
+	// tolerance in the units of the samples, smoothing 0 to keep samples as they are up to
+	// almost 1 to average most of their jitter away
+	void Reset(float tolerance, float smoothing, size_t max_points);
+	void Add(const Vector2& sample);
+	// fix the newest sample as the last point
+	void Finish();
+	// the fixed points followed by the newest sample, what the stroke looks like so far
+	const std::vector<Vector2>& Points() const { return points_; }
+	size_t SampleCount() const { return samples_; }
+	float Tolerance() const { return tolerance_; }
+private:
+	void Fix(size_t pending_index);
+	void Coarsen();
+
+	std::vector<Vector2> points_;
+	std::vector<Vector2> pending_; // samples after the last fixed point, the newest last
+	std::vector<Vector2> simplified_; // scratch of Coarsen
+	std::vector<size_t> stack_;
+	size_t fixed_; // points_[0, fixed_) are final
+	size_t max_points_;
+	size_t samples_;
+	float tolerance_;
+	float smoothing_;
+	Vector2 smoothed_;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include "Geometry.h"
+
+const double VIEW_MIN_SCALE = 1e-4;
+const double VIEW_MAX_SCALE = 1e6;
+
+// Camera of a window, maps world to window pixel cordinate by pixel = (world - origin) * scale.
+// The origin is kept in double so far away panning and deep zoom keep their precision,
+// changing the view is O(1) and never touches the shapes.
+class View
+{
+public:
+	View() { version_ = 0; Reset(); }
+	void Reset() { Set(0, 0, 1); }
+	void Set(double origin_x, double origin_y, double scale)
+	{
+		origin_x_ = origin_x;
+		origin_y_ = origin_y;
+		scale_ = scale;
+		version_++;
+	}
+	// show rect as large as it fits, centered in a w x h window
+	void Fit(const Rect& rect, int w, int h)
+	{
+		double rect_w = rect.right - rect.left;
+		double rect_h = rect.bottom - rect.top;
+		double scale = 1;
+		if (rect_w > 0 && rect_h > 0)
+			scale = w / rect_w < h / rect_h ? w / rect_w : h / rect_h;
+		else if (rect_w > 0)
+			scale = w / rect_w;
+		else if (rect_h > 0)
+			scale = h / rect_h;
+		if (scale < VIEW_MIN_SCALE) scale = VIEW_MIN_SCALE;
+		if (scale > VIEW_MAX_SCALE) scale = VIEW_MAX_SCALE;
+		double center_x = (rect.left + (double)rect.right) / 2;
+		double center_y = (rect.top + (double)rect.bottom) / 2;
+		Set(center_x - w / (2 * scale), center_y - h / (2 * scale), scale);
+	}
+	// move the view by a mouse offset in pixels
+	void Pan(double dx, double dy)
+	{
+		origin_x_ -= dx / scale_;
+		origin_y_ -= dy / scale_;
+		version_++;
+	}
+	// zoom by factor and keep the world point under pixel (x, y) in place
+	void ZoomAt(double factor, double x, double y)
+	{
+		double world_x = origin_x_ + x / scale_;
+		double world_y = origin_y_ + y / scale_;
+		scale_ *= factor;
+		if (scale_ < VIEW_MIN_SCALE) scale_ = VIEW_MIN_SCALE;
+		if (scale_ > VIEW_MAX_SCALE) scale_ = VIEW_MAX_SCALE;
+		origin_x_ = world_x - x / scale_;
+		origin_y_ = world_y - y / scale_;
+		version_++;
+	}
+	Vector2 ToWorld(double x, double y) const
+	{
+		Vector2 v;
+		v.x = (float)(origin_x_ + x / scale_);
+		v.y = (float)(origin_y_ + y / scale_);
+		return v;
+	}
+	// world rectangle shown in a w x h window
+	Rect VisibleRect(int w, int h) const
+	{
+		Rect r;
+		r.left = (float)origin_x_;
+		r.top = (float)origin_y_;
+		r.right = (float)(origin_x_ + w / scale_);
+		r.bottom = (float)(origin_y_ + h / scale_);
+		return r;
+	}
+	double OriginX() const { return origin_x_; }
+	double OriginY() const { return origin_y_; }
+	double Scale() const { return scale_; }
+	// scale rounded up to a power of two, circle tessellation only changes when it crosses one
+	float LodScale() const { return (float)pow(2.0, ceil(log(scale_) / log(2.0))); }
+	int Version() const { return version_; } // increase on every change
+private:
+	double origin_x_;
+	double origin_y_;
+	double scale_;
+	int version_;
+};
+
+#endif
@@ -3,40 +3,43 @@
 #include <FL/Fl_Gl_Window.H>
 #include <FL/Fl_Button.H>
 #include <FL/Fl_Color_Chooser.H>
+#include <FL/Fl_File_Chooser.H>
+#include <FL/fl_ask.H>
+#include <FL/filename.H>
 #include <cstdio>
-#define _USE_MATH_DEFINES
-#include <cmath>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include "Geometry.h"
+#include "Scene.h"
+#include "Renderer.h"
+#include "View.h"
+#include "PaintLayer.h"
+#include "History.h"
+#include "Export.h"
+#include "Import.h"
+#include "Hud.h"
+#include "InputRecording.h"
+#include "Stroke.h"
+#include "Journal.h"
 
 
 using namespace std;
 // not built-in define, use to specify creating object type
 #define MY_CIRCLES 0x000a
 #define MY_ZOOMRECT 0x000b
+#define MY_SELECT 0x000c
+#define MY_BRUSH 0x000d
+#define MY_PAINT 0x000e
+#define MY_BUCKET 0x000f
 
-// constant
-// static int xpp = 0;
-const int MAX_SHAPE_COUNT = 30000;
-const int CIRCLE_SIDES = 100;
+const float SELECT_TOLERANCE = 4.0f; // pixels between the cursor and an edge that still picks it
+const float BRUSH_TOLERANCE = 0.5f; // pixels a brush stroke may stray from the mouse path
+const float PAINT_BRUSH_RADIUS = 3.0f; // paint pixels, the paint brush keeps its size at any zoom
+const float BRUSH_SMOOTHING = 0.3f; // share of the jitter of the mouse the brush averages away
 
-struct Vector2
-{
-	float x;
-	float y;
-};
-struct Color {
-	Color() { r = 0; g = 0; b = 0; }
-	Color(float R, float G, float B)
-	{
-		r = R;
-		g = G;
-		b = B;
-	}
-	float r;
-	float g;
-	float b;
-};
-const Color white(1, 1, 1);
-const Color red(1, 0, 0);
 Color current_color(1, 1, 1);
 
 class Shape
@@ -46,20 +49,25 @@ private:
 	bool filled_;
 public:
 	Shape(Color color = white, bool filled = false) { color_ = color; filled_ = filled; }
-	virtual void PreviewSet(int x, int y) {}; // call when mouse move or drag
+	virtual ~Shape() {}
+	virtual void PreviewSet(float x, float y) {}; // call when mouse move or drag
 	virtual bool SetComplete() { return false; }; // return if the shape set is finish
-	virtual void Draw() { 
+	// vertices are drawn relative to anchor, a whole number near them, through a view anchored there
+	virtual void Draw(const Vector2& anchor) { 
 		glColor3f(color_.r, color_.g, color_.b); 
 		if (filled_)
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); 
 		else 
 			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 	} // vertex draw function
-	virtual void FitWidget(int w, int h) {}; // transform mouse position to OpenGL cordinate, call between Set(PreviewSet) and Draw
-	virtual void Set(int x, int y) {}; // set shape vertex iteratively
+	virtual void Set(float x, float y) {}; // set shape vertex iteratively, in world cordinate
 	virtual void Reset() {}; // reset all shape vertext
+	virtual bool Commit(Scene& scene) { return true; }; // add the completed shape to the scene, false when out of memory
+	virtual bool SetOnRelease() { return false; } // true when releasing the button sets the next vertex
 	void SetColor(Color color) { color_ = color; }
 	void SetFilled(bool filled) { filled_ = filled; }
+	Color GetColor() const { return color_; }
+	bool GetFilled() const { return filled_; }
 };
 class Line : public Shape
 {
@@ -73,7 +81,7 @@ public:
 	{
 		return set_step_ == 2;
 	}
-	void Set(int x, int y)
+	void Set(float x, float y)
 	{
 		if (set_step_ == 0)
 		{
@@ -90,7 +98,7 @@ public:
 			set_step_++;
 		}
 	}
-	void PreviewSet(int x, int y)
+	void PreviewSet(float x, float y)
 	{
 		if (set_step_ >= 1)
 		{
@@ -105,31 +113,20 @@ public:
 		origin_start_.y = 0;
 		origin_end_.x = 0;
 		origin_end_.y = 0;
-		start_.x = 0;
-		start_.y = 0;
-		end_.x = 0;
-		end_.y = 0;
 	}
-	inline void Draw()
+	inline void Draw(const Vector2& anchor)
 	{
-		Shape::Draw();
+		Shape::Draw(anchor);
 		glBegin(GL_LINES);
-		glVertex2f(start_.x, start_.y);
-		glVertex2f(end_.x, end_.y);
+		glVertex2f(origin_start_.x - anchor.x, origin_start_.y - anchor.y);
+		glVertex2f(origin_end_.x - anchor.x, origin_end_.y - anchor.y);
 		glEnd();
 	}
-	void FitWidget(int w, int h)
+	bool Commit(Scene& scene)
 	{
-		float half_w = w / 2;
-		float half_h = h / 2;
-		start_.x = (origin_start_.x - half_w) / half_w;
-		start_.y = (-origin_start_.y + half_h) / half_h;
-		end_.x = (origin_end_.x - half_w) / half_w;
-		end_.y = (-origin_end_.y + half_h) / half_h;
+		return scene.AddLine(origin_start_, origin_end_, GetColor(), GetFilled());
 	}
 private:
-	Vector2 start_;
-	Vector2 end_;
 	Vector2 origin_start_;
 	Vector2 origin_end_;
 	int set_step_;
@@ -146,12 +143,12 @@ public:
 	{
 		return true;
 	}
-	void Set(int x, int y)
+	void Set(float x, float y)
 	{
 		origin_position_.x = x;
 		origin_position_.y = y;
 	}
-	void PreviewSet(int x, int y)
+	void PreviewSet(float x, float y)
 	{
 		origin_position_.x = x;
 		origin_position_.y = y;
@@ -161,22 +158,18 @@ public:
 		origin_position_.x = 0;
 		origin_position_.y = 0;
 	}
-	inline void Draw()
+	inline void Draw(const Vector2& anchor)
 	{
-		Shape::Draw();
+		Shape::Draw(anchor);
 		glBegin(GL_POINTS);
-		glVertex2f(position_.x, position_.y);
+		glVertex2f(origin_position_.x - anchor.x, origin_position_.y - anchor.y);
 		glEnd();
 	}
-	void FitWidget(int w, int h)
+	bool Commit(Scene& scene)
 	{
-		float half_w = w / 2;
-		float half_h = h / 2;
-		position_.x = (origin_position_.x - half_w) / half_w;
-		position_.y = (-origin_position_.y + half_h) / half_h;
+		return scene.AddPoint(origin_position_, GetColor(), GetFilled());
 	}
 private:
-	Vector2 position_;
 	Vector2 origin_position_;
 };
 class Triangle : public Shape
@@ -191,7 +184,7 @@ public:
 	{
 		return set_step_ == 3;
 	}
-	void Set(int x, int y)
+	void Set(float x, float y)
 	{
 		if (set_step_ == 0) // first and third side start
 		{
@@ -218,7 +211,7 @@ public:
 			set_step_++;
 		}
 	}
-	void PreviewSet(int x, int y)
+	void PreviewSet(float x, float y)
 	{
 		if (set_step_ == 1) // first side started, preview first side
 			base_.PreviewSet(x, y);
@@ -233,37 +226,28 @@ public:
 		set_step_ = 0;
 		base_.Reset();
 	}
-	inline void Draw()
+	inline void Draw(const Vector2& anchor)
 	{
-		Shape::Draw();
+		Shape::Draw(anchor);
 		if (set_step_ >= 2) 
 		{
 			glBegin(GL_TRIANGLES);
-			glVertex2f(vertex_[0].x, vertex_[0].y);
-			glVertex2f(vertex_[1].x, vertex_[1].y);
-			glVertex2f(vertex_[2].x, vertex_[2].y);
+			glVertex2f(origin_vertex_[0].x - anchor.x, origin_vertex_[0].y - anchor.y);
+			glVertex2f(origin_vertex_[1].x - anchor.x, origin_vertex_[1].y - anchor.y);
+			glVertex2f(origin_vertex_[2].x - anchor.x, origin_vertex_[2].y - anchor.y);
 			glEnd();
 		}
 		else 
 		{
-			base_.Draw();
+			base_.Draw(anchor);
 		}
 	}
-	void FitWidget(int w, int h)
+	bool Commit(Scene& scene)
 	{
-		float half_w = w / 2;
-		float half_h = h / 2;
-		for (int i = 0; i < 3; i++)
-		{
-			vertex_[i].x = (origin_vertex_[i].x - half_w) / half_w;
-			vertex_[i].y = (-origin_vertex_[i].y + half_h) / half_h;
-		}
-		base_.FitWidget(w, h);
-
+		return scene.AddTriangle(origin_vertex_, GetColor(), GetFilled());
 	}
 private:
 	Line base_;
-	Vector2 vertex_[3];
 	Vector2 origin_vertex_[3];
 	int set_step_;
 };
@@ -281,7 +265,7 @@ public:
 	{
 		return set_step_ == 4;
 	}
-	void Set(int x, int y)
+	void Set(float x, float y)
 	{
 		if (set_step_ == 0) // first and fourth side start
 		{
@@ -317,7 +301,7 @@ public:
 			set_step_++;
 		}
 	}
-	void PreviewSet(int x, int y)
+	void PreviewSet(float x, float y)
 	{
 		if (set_step_ == 1) // first side started, preview first side
 			sides_[0].PreviewSet(x, y);
@@ -335,154 +319,187 @@ public:
 		sides_[0].Reset();
 		sides_[1].Reset();
 	}
-	inline void Draw()
+	inline void Draw(const Vector2& anchor)
 	{
-		Shape::Draw();
+		Shape::Draw(anchor);
 		if (set_step_ >= 3)
 		{
 			glBegin(GL_QUADS);
-			glVertex2f(vertex_[0].x, vertex_[0].y);
-			glVertex2f(vertex_[1].x, vertex_[1].y);
-			glVertex2f(vertex_[2].x, vertex_[2].y);
-			glVertex2f(vertex_[3].x, vertex_[3].y);
+			glVertex2f(origin_vertex_[0].x - anchor.x, origin_vertex_[0].y - anchor.y);
+			glVertex2f(origin_vertex_[1].x - anchor.x, origin_vertex_[1].y - anchor.y);
+			glVertex2f(origin_vertex_[2].x - anchor.x, origin_vertex_[2].y - anchor.y);
+			glVertex2f(origin_vertex_[3].x - anchor.x, origin_vertex_[3].y - anchor.y);
 			glEnd();
 		}
 		else
 		{
-			sides_[0].Draw();
-			sides_[1].Draw();
+			sides_[0].Draw(anchor);
+			sides_[1].Draw(anchor);
 		}
 	}
-	void FitWidget(int w, int h)
+	bool Commit(Scene& scene)
 	{
-		float half_w = w / 2;
-		float half_h = h / 2;
-		for (int i = 0; i < 4; i++)
-		{
-			vertex_[i].x = (origin_vertex_[i].x - half_w) / half_w;
-			vertex_[i].y = (-origin_vertex_[i].y + half_h) / half_h;
-		}
-		sides_[0].FitWidget(w, h);
-		sides_[1].FitWidget(w, h);
+		return scene.AddQuad(origin_vertex_, GetColor(), GetFilled());
 	}
 private:
 	Line sides_[2];
-	Vector2 vertex_[4];
 	Vector2 origin_vertex_[4];
 	int set_step_;
 };
+// pixels on screen per world unit of the window being drawn, set before drawing
+float lod_pixel_scale = 1.0;
+
+// Circle stored as center and radius, vertices are generated from UnitCircle when drawn
 class Circle : public Shape
 {
 public:
 	Circle(Color color = white, bool filled = false)
 		:Shape(color, filled)
 	{
-		filled_ = filled;
-		for (int i = 0; i < CIRCLE_SIDES; i++) {
-			sides_[i].SetColor(color);
-			filled_sides_[i].SetColor(color);
-			filled_sides_[i].SetFilled(filled);
-		}
 		Reset();
 	}
 	bool SetComplete()
 	{
 		return set_step_ == 2;
 	}
-	void Set(int x, int y)
+	void Set(float x, float y)
 	{
 		if (set_step_ == 0) // circle center set
 		{
 			origin_center_.x = x;
 			origin_center_.y = y;
-			SetSides(0);
+			origin_radius_ = 0;
 			set_step_++;
 		}
 		else if (set_step_ == 1) // circle radius set
 		{
-			radius = sqrtf(powf(x - origin_center_.x, 2) + powf(y - origin_center_.y, 2));
-			SetSides(radius);
+			origin_radius_ = sqrtf(powf(x - origin_center_.x, 2) + powf(y - origin_center_.y, 2));
 			set_step_++;
 		}
 	}
-	void PreviewSet(int x, int y)
+	void PreviewSet(float x, float y)
 	{
 		if (set_step_ >= 1) // center set, preview whole circle
-		{
-			float r = sqrtf(powf(x - origin_center_.x, 2) + powf(y - origin_center_.y, 2));
-			SetSides(r);
-		}
+			origin_radius_ = sqrtf(powf(x - origin_center_.x, 2) + powf(y - origin_center_.y, 2));
 	}
 	void Reset()
 	{
-		for (int i = 0; i < CIRCLE_SIDES; i++)
-		{
-			sides_[i].Reset();
-			filled_sides_[i].Reset();
-		}
 		set_step_ = 0;
-		center_.x = 0;
-		center_.y = 0;
 		origin_center_.x = 0;
 		origin_center_.y = 0;
-		radius = 0;
+		origin_radius_ = 0;
 	}
-	inline void Draw()
+	inline void Draw(const Vector2& anchor)
 	{
-		Shape::Draw();
+		Shape::Draw(anchor);
 		if (set_step_ >= 1)
 		{
-			if (filled_)
-				for (int i = 0; i < CIRCLE_SIDES; i++)
-					filled_sides_[i].Draw();
-			else 
-				for (int i = 0; i < CIRCLE_SIDES; i++)
-					sides_[i].Draw();
+			Vector2 center = { origin_center_.x - anchor.x, origin_center_.y - anchor.y };
+			int sides;
+			const Vector2* unit = UnitCircle(CircleLodLevel(origin_radius_ * lod_pixel_scale), &sides);
+			if (GetFilled())
+			{
+				glBegin(GL_TRIANGLE_FAN);
+				glVertex2f(center.x, center.y);
+				for (int i = 0; i <= sides; i++)
+					glVertex2f(center.x + origin_radius_ * unit[i].x, center.y + origin_radius_ * unit[i].y);
+				glEnd();
+			}
+			else
+			{
+				glBegin(GL_LINE_LOOP);
+				for (int i = 0; i < sides; i++)
+					glVertex2f(center.x + origin_radius_ * unit[i].x, center.y + origin_radius_ * unit[i].y);
+				glEnd();
+			}
 		}
 	}
-	void FitWidget(int w, int h)
+	bool Commit(Scene& scene)
 	{
-		float half_w = w / 2;
-		float half_h = h / 2;
-		if (filled_)
-			for (int i = 0; i < CIRCLE_SIDES; i++)
-				filled_sides_[i].FitWidget(w, h);
-		else 
-			for (int i = 0; i < CIRCLE_SIDES; i++)
-				sides_[i].FitWidget(w, h);
-		center_.x = (origin_center_.x - half_w) / half_w;
-		center_.y = (-origin_center_.y + half_h) / half_h;
+		return scene.AddCircle(origin_center_, origin_radius_, GetColor(), GetFilled());
 	}
 private:
-	// Set all sides by radius and center
-	void SetSides(float r)
+	Vector2 origin_center_;
+	float origin_radius_;
+	int set_step_;
+};
+// Freehand stroke following the mouse from press to release. Drag samples are simplified as
+// they arrive, so drawing and committing the stroke cost the same however long it was dragged
+class Brush : public Shape
+{
+public:
+	Brush(Color color = white, bool filled = false)
+		:Shape(color, false)
 	{
-		if (filled_) {
-			for (int i = 0; i < CIRCLE_SIDES; i++)
-			{
-				filled_sides_[i].Reset();
-				filled_sides_[i].Set(origin_center_.x, origin_center_.y);
-				filled_sides_[i].Set(origin_center_.x + r * cosf(2 * M_PI * i / CIRCLE_SIDES), origin_center_.y + r * sinf(2 * M_PI * i / CIRCLE_SIDES));
-				filled_sides_[i].Set(origin_center_.x + r * cosf(2 * M_PI * (i + 1) / CIRCLE_SIDES), origin_center_.y + r * sinf(2 * M_PI * (i + 1) / CIRCLE_SIDES));
-			}
+		Reset();
+	}
+	// tolerance in world units, the pixel tolerance over the scale of the window drawn in
+	void SetTolerance(float tolerance)
+	{
+		simplifier_.Reset(tolerance, BRUSH_SMOOTHING, STROKE_MAX_POINTS);
+	}
+	bool SetComplete()
+	{
+		return set_step_ == 2;
+	}
+	bool SetOnRelease()
+	{
+		return true;
+	}
+	void Set(float x, float y)
+	{
+		Vector2 sample = { x, y };
+		if (set_step_ == 0) // button pressed
+		{
+			simplifier_.Add(sample);
+			set_step_++;
 		}
-		else
+		else if (set_step_ == 1) // button released
 		{
-			for (int i = 0; i < CIRCLE_SIDES; i++)
-			{
-				sides_[i].Reset();
-				sides_[i].Set(origin_center_.x + r * cosf(2 * M_PI * i / CIRCLE_SIDES), origin_center_.y + r * sinf(2 * M_PI * i / CIRCLE_SIDES));
-				sides_[i].Set(origin_center_.x + r * cosf(2 * M_PI * (i + 1) / CIRCLE_SIDES), origin_center_.y + r * sinf(2 * M_PI * (i + 1) / CIRCLE_SIDES));
-			}
+			simplifier_.Add(sample);
+			simplifier_.Finish();
+			set_step_++;
 		}
 	}
-	Line sides_[CIRCLE_SIDES];
-	Triangle filled_sides_[CIRCLE_SIDES];
-	Vector2 origin_center_;
-	Vector2 center_;
-	float radius;
+	void PreviewSet(float x, float y)
+	{
+		Vector2 sample = { x, y };
+		if (set_step_ == 1)
+			simplifier_.Add(sample);
+	}
+	void Reset()
+	{
+		set_step_ = 0;
+		simplifier_.Reset(BRUSH_TOLERANCE, BRUSH_SMOOTHING, STROKE_MAX_POINTS);
+	}
+	inline void Draw(const Vector2& anchor)
+	{
+		Shape::Draw(anchor);
+		const vector<Vector2>& points = simplifier_.Points();
+		if (points.size() < 2) return;
+		relative_.resize(points.size());
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			relative_[i].x = points[i].x - anchor.x;
+			relative_[i].y = points[i].y - anchor.y;
+		}
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glVertexPointer(2, GL_FLOAT, sizeof(Vector2), &relative_[0].x);
+		glDrawArrays(GL_LINE_STRIP, 0, (GLsizei)relative_.size());
+		glDisableClientState(GL_VERTEX_ARRAY);
+	}
+	bool Commit(Scene& scene)
+	{
+		// a click without a drag leaves a dot
+		const vector<Vector2>& points = simplifier_.Points();
+		if (points.size() < 2)
+			return scene.AddPoint(points[0], GetColor(), true);
+		return scene.AddStroke(&points[0], points.size(), GetColor());
+	}
+private:
+	StrokeSimplifier simplifier_;
+	vector<Vector2> relative_; // points relative to the anchor of the last Draw
 	int set_step_;
-	bool filled_;
 };
 class ZoomRectangle : public Shape
 {
@@ -496,15 +513,15 @@ public:
 		current_end_.y = 0;
 		Reset(frame);
 	}
-	inline void Draw()
+	inline void Draw(const Vector2& anchor)
 	{
-		quad.Draw();
+		quad.Draw(anchor);
 	}
 	bool SetComplete()
 	{
 		return set_step_ == 2;
 	}
-	void Set(int x, int y)
+	void Set(float x, float y)
 	{
 		if (set_step_ == 0) // set start point
 		{
@@ -527,7 +544,7 @@ public:
 			set_step_++;
 		}
 	}
-	void PreviewSet(int x, int y)
+	void PreviewSet(float x, float y)
 	{
 		if (set_step_ >= 1) // start set, preview whole rectangle
 		{
@@ -549,72 +566,18 @@ public:
 		set_step_ = 0;
 		origin_start_.x = 0;
 		origin_start_.y = 0;
-		start_.x = 0;
-		start_.y = 0;
 		origin_end_.x = 0;
 		origin_end_.y = 0;
-		end_.x = 0;
-		end_.y = 0;
 	}
-	void FitWidget(int w, int h)
+	// world rectangle shown in the zoom window
+	Rect GetZoomRect()
 	{
-		quad.FitWidget(w, h);
-		float half_w = w / 2;
-		float half_h = h / 2;
-		
-		start_.x = (origin_start_.x - half_w) / half_w;
-		start_.y = (-origin_start_.y + half_h) / half_h;
-		end_.x = (origin_end_.x - half_w) / half_w;
-		end_.y = (-origin_end_.y + half_h) / half_h;
-	}
-	void SetZoomView()
-	{
-		if (!SetComplete()) return;
-		float left, right, top, bottom;
-		if (start_.x > end_.x)
-		{
-			left = end_.x;
-			right = start_.x;
-			//*w = origin_start_.x - origin_end_.x;
-		}
-		else
-		{
-			left = start_.x;
-			right = end_.x;
-			//*w = origin_end_.x - origin_start_.x;
-		}
-		if (start_.y > end_.y)
-		{
-			top = start_.y;
-			bottom = end_.y;
-			//*h = origin_end_.y - origin_start_.y;
-		}
-		else
-		{
-			top = end_.y;
-			bottom = start_.y;
-			//*h = origin_start_.y - origin_end_.y;
-		}
-		glOrtho(left, right, bottom, top, -1, 1);
-	}
-	void ZoomPositionMapping(float* x, float* y)
-	{
-		if (current_start_.x > current_end_.x)
-		{
-			*x = *x + current_end_.x;
-		}
-		else
-		{
-			*x = *x + current_start_.x;
-		}
-		if (current_start_.y > current_end_.y)
-		{
-			*y = *y + current_end_.y;
-		}
-		else
-		{
-			*y = *y + current_start_.y;
-		}
+		Rect r;
+		r.left = fminf(current_start_.x, current_end_.x);
+		r.top = fminf(current_start_.y, current_end_.y);
+		r.right = fmaxf(current_start_.x, current_end_.x);
+		r.bottom = fmaxf(current_start_.y, current_end_.y);
+		return r;
 	}
 	float GetWidth() { return fabsf(current_start_.x - current_end_.x); }
 	float GetHeight() { return fabsf(current_start_.y - current_end_.y); }
@@ -626,24 +589,101 @@ private:
 	int set_step_;
 	Vector2 origin_start_;
 	Vector2	origin_end_;
-	Vector2 start_;
-	Vector2 end_;
 	Vector2 current_start_;
 	Vector2 current_end_;
 };
+// Memory of the shape being created. Only one shape is created at a time, so every
+// click constructs it here by placement new instead of allocating from the heap.
+class BuilderSlot
+{
+public:
+	BuilderSlot() { shape_ = NULL; }
+	~BuilderSlot() { Release(); }
+	template <class T>
+	T* New(Color color, bool filled)
+	{
+		Release();
+		T* shape = new (&storage_) T(color, filled);
+		shape_ = shape;
+		return shape;
+	}
+	void Release()
+	{
+		if (shape_ != NULL)
+			shape_->~Shape();
+		shape_ = NULL;
+	}
+private:
+	union Storage
+	{
+		char point[sizeof(Point)];
+		char line[sizeof(Line)];
+		char triangle[sizeof(Triangle)];
+		char quadrilater[sizeof(Quadrilater)];
+		char circle[sizeof(Circle)];
+		char brush[sizeof(Brush)];
+		double align;
+		void* align_pointer;
+	};
+	Storage storage_;
+	Shape* shape_;
+};
+
 // global setting and state variable
 int creating_object_type = GL_POINTS;
 bool is_creating_object = false;
-Shape* shapes[MAX_SHAPE_COUNT];
+Scene scene;
+History history(scene); // every edit of the scene after the shape is built goes through it
+Shape* creating_shape = NULL; // shape being created, added to scene when complete
+BuilderSlot builder; // memory of creating_shape unless it is zoom_rect
 ZoomRectangle zoom_rect(0);
-int shape_count = 0;
 float zoom_multiple = 2.0;
-float current_zoom_multiple = 2.0;
 bool current_filled = true;
+bool software_rendering = false; // committed shapes drawn on the CPU and copied into the window, Ctrl+B toggles
+bool rendering_chosen = false; // the first GL context picks the backend from its driver
+bool show_hud = false; // performance overlay of the windows, Ctrl+H toggles
+InputRecorder recorder; // input of the session when started with -record
+InputReplay replay; // recorded session fed back when started with -replay
+bool replay_fast = false; // replay events back to back instead of at recorded speed
+bool compact_storage = false; // -compact, the scene keeps its vertices in compact storage
+bool replay_dispatching = false; // a replayed event is being handled, not the user's
+const char* record_path = NULL;
+const char* replay_path = NULL;
+const char* report_path = NULL; // latency report of the replay, stdout without it
+const char* journal_path = "SimplePainter.journal"; // -journal file
+Journal journal; // autosave of the canvas, off while input is replayed
+vector<Fl_Callback*> toolbar_callbacks; // callbacks of the toolbar buttons called through RecordButton, by child index
+size_t selected_shape = NO_SHAPE; // z of the shape picked by the select tool
+bool dragging_selection = false;
+Vector2 drag_start; // world position where the drag started
+Vector2 drag_offset; // translation of the dragged shape so far, applied to the scene on release
+SharedGeometry shared_geometry; // display lists of the scene called by every window
+PaintLayer paint; // raster paint over the shapes, saved and journaled with the scene
+PaintTextures paint_textures; // tiles of the paint uploaded for every window
+bool painting = false; // the left button is down with the paint tool
+Vector2 paint_last; // world position the paint reached so far
+
+// selection box around a shape, a few pixels larger than its bounds, relative to anchor
+void DrawSelection(const Rect& box, const Vector2& offset, float scale, const Vector2& anchor)
+{
+	float margin = 3 / scale;
+	float left = box.left - anchor.x + offset.x - margin;
+	float top = box.top - anchor.y + offset.y - margin;
+	float right = box.right - anchor.x + offset.x + margin;
+	float bottom = box.bottom - anchor.y + offset.y + margin;
+	glColor3f(1, 1, 0);
+	glBegin(GL_LINE_LOOP);
+	glVertex2f(left, top);
+	glVertex2f(right, top);
+	glVertex2f(right, bottom);
+	glVertex2f(left, bottom);
+	glEnd();
+}
 
 class openGL_window : public Fl_Gl_Window { // Create a OpenGL class in FLTK 
 	void draw();            // Draw function. 
 	void draw_overlay();    // Draw overlay function. 
+	void flush();           // draw and swap, timed for the HUD
 	virtual int handle(int event);
 
 	static void Timer_CB(void *userdata) {
@@ -654,49 +694,175 @@ class openGL_window : public Fl_Gl_Window { // Create a OpenGL class in FLTK
 
 public:
 	openGL_window(int x, int y, int w, int h, const char *l = 0);  // Class constructor 
+	int HandleInput(const InputEvent& input); // what handle() does with an event, replayed input comes here too
 	int frame;
 	openGL_window* zoom_window;
 	openGL_window* main_window;
+	View view; // camera of this window, shapes are kept in world cordinate
+	bool overview; // shows the whole scene, fitted again as it grows, and takes no input
+private:
+	void FitScene();
+	Vector2 LoadAnchoredView();
+
+	BatchRenderer renderer_;
+	LayerCache layer_;
+	SoftwareLayer software_layer_;
+	Hud hud_;
+	int pan_x_; // last mouse position of a right or middle button pan
+	int pan_y_;
+	Rect fitted_bounds_; // scene bounds of the last FitScene
+	int fitted_w_;
+	int fitted_h_;
 };
 
+openGL_window* input_windows[2]; // main and zoom window, by the window of an event
+openGL_window* overview_window = NULL; // Ctrl+E shows and hides it
+int recorded_w[2] = { -1, -1 }; // size of the main and zoom window as the recording has it
+int recorded_h[2] = { -1, -1 };
+
+// the windows that changed size since the last recorded event, so recorded pixels mean the same on replay
+void RecordSizes(double time)
+{
+	if (!recorder.Recording()) return;
+	for (int i = 0; i < 2; i++)
+	{
+		openGL_window* window = input_windows[i];
+		if (window->w() == recorded_w[i] && window->h() == recorded_h[i]) continue;
+		InputEvent input = InputEvent();
+		input.time = time;
+		input.kind = INPUT_RESIZE;
+		input.window = i;
+		input.x = recorded_w[i] = window->w();
+		input.y = recorded_h[i] = window->h();
+		recorder.Record(input);
+	}
+}
+
 openGL_window::openGL_window(int x, int y, int w, int h, const char *l) :
-	Fl_Gl_Window(x, y, w, h, l)
+	Fl_Gl_Window(x, y, w, h, l), renderer_(&shared_geometry)
 {
 	mode(FL_RGB | FL_ALPHA | FL_DOUBLE | FL_STENCIL);
 	Fl::add_timeout(3.0, Timer_CB, (void*)this);
 	frame = 0;
 	zoom_window = NULL;
 	main_window = NULL;
+	pan_x_ = 0;
+	pan_y_ = 0;
+	overview = false;
+	fitted_w_ = 0;
+	fitted_h_ = 0;
+}
+
+// view of the whole scene, changed only when the scene grew or the window was resized
+void openGL_window::FitScene()
+{
+	const Rect& bounds = scene.Bounds();
+	if (bounds.left > bounds.right) return; // nothing drawn yet
+	if (fitted_w_ == w() && fitted_h_ == h() && memcmp(&fitted_bounds_, &bounds, sizeof(Rect)) == 0) return;
+	view.Fit(bounds, w(), h());
+	fitted_bounds_ = bounds;
+	fitted_w_ = w();
+	fitted_h_ = h();
+}
+
+// load the view anchored where the committed shapes were drawn relative to, shapes drawn over
+// them relative to the anchor returned line up with them to the pixel. The software layer has
+// no anchor, it anchors at the view
+Vector2 openGL_window::LoadAnchoredView()
+{
+	double x, y;
+	if (software_rendering)
+		RectAnchor(view.VisibleRect(w(), h()), &x, &y);
+	else
+	{
+		x = renderer_.AnchorX();
+		y = renderer_.AnchorY();
+	}
+	LoadView(view, w(), h(), x, y);
+	Vector2 anchor = { (float)x, (float)y };
+	return anchor;
+}
+
+void openGL_window::flush() {
+	if (hud_.Visible() != show_hud)
+		hud_.SetVisible(show_hud);
+	hud_.BeginFrame();
+	Fl_Gl_Window::flush();
+	hud_.EndFrame(scene, history);
+	replay.FrameDone();
 }
 
 void openGL_window::draw() {
+	hud_.BeginDraw();
+	RenderStats* stats = hud_.Stats(); // NULL while the HUD is hidden
+	if (!context_valid())
+	{
+		renderer_.Reset();
+		layer_.Reset();
+		paint_textures.Reset();
+	}
 	// the valid() property may be used to avoid reinitializing your
 	// GL transformation for each redraw:
 	if (!valid()) 
 	{
 		valid(1);
-		glLoadIdentity();
-		if (this == zoom_window)
-		{
-			zoom_rect.SetZoomView();
-		}
-		else
-		{
-			for (int i = 0; i < shape_count; i++)
-				shapes[i]->FitWidget(w(), h());
-			zoom_rect.FitWidget(w(), h());
-			zoom_window->valid(0);
-		}
-
 		glViewport(0, 0, w(), h());
 		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		layer_.Invalidate();
 	}
-	// draw an amazing but slow graphic:--------------
+	if (overview)
+		FitScene();
+	if (!rendering_chosen)
+	{
+		software_rendering = SoftwareDriver();
+		rendering_chosen = true;
+	}
+	LoadView(view, w(), h()); // O(1) on resize, pan and zoom
+	// draw committed shapes from the cached layer, the one being created immediately:--------------
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	for (int i = 0; i < shape_count; i++)
+	lod_pixel_scale = view.Scale();
+	if (software_rendering)
+	{
+		software_layer_.Draw(scene, paint, view, w(), h(), stats);
+	}
+	else if (layer_.Valid(scene.Version(), view.Version(), w(), h()))
 	{
-		shapes[i]->Draw();
+		layer_.Draw(stats);
 	}
+	else
+	{
+		renderer_.Draw(scene, view, w(), h(), stats);
+		layer_.Capture(scene.Version(), view.Version(), w(), h(), stats);
+	}
+	// paint goes over the cached layer, painting uploads only the tiles it changed
+	if (!software_rendering)
+		paint_textures.Draw(paint, view, w(), h(), stats);
+	if (is_creating_object)
+	{
+		creating_shape->Draw(LoadAnchoredView());
+		LoadView(view, w(), h());
+		if (stats != NULL)
+		{
+			stats->draw_calls++;
+			stats->state_changes += 2; // the views
+		}
+	}
+	if (creating_object_type == MY_SELECT && selected_shape != NO_SHAPE)
+	{
+		// the dragged shape is hidden in the layer and drawn alone at its new position
+		if (scene.Hidden(selected_shape))
+			renderer_.DrawShape(scene, selected_shape, view, w(), h(), drag_offset, stats);
+		DrawSelection(scene.ShapeBounds(selected_shape), drag_offset, view.Scale(), LoadAnchoredView());
+		LoadView(view, w(), h());
+		if (stats != NULL)
+		{
+			stats->draw_calls++;
+			stats->state_changes += 2; // the views
+			stats->vertices += 4;
+		}
+	}
+	hud_.Draw(w(), h());
+	hud_.EndDraw();
 
 	//--------------------------------------------------
 	++frame;
@@ -708,65 +874,162 @@ void openGL_window::draw_overlay() {
 	if (!valid()) 
 	{
 		valid(1);
-		glLoadIdentity();
 		glViewport(0, 0, w(), h());
 	}
-	
 	// draw an amazing graphic:-------------
-	zoom_rect.Draw();
+	zoom_rect.Draw(LoadAnchoredView());
 	//---------------------------------------
 }
 
+// add the completed creating_shape to the scene
+void CommitCreatingShape()
+{
+	if (creating_shape->Commit(scene))
+		history.Added();
+	else
+		fl_alert("Can not add the shape, out of memory");
+	builder.Release();
+	creating_shape = NULL;
+	is_creating_object = false;
+}
+// forget the selection, call before shapes are erased
+void ClearSelection()
+{
+	if (selected_shape != NO_SHAPE && scene.Hidden(selected_shape))
+		scene.SetHidden(selected_shape, false);
+	selected_shape = NO_SHAPE;
+	dragging_selection = false;
+	drag_offset.x = 0;
+	drag_offset.y = 0;
+}
+// drop the shape being created, if any. Paint being painted is kept as a step of its own
+void CancelCreatingShape()
+{
+	if (painting)
+	{
+		painting = false;
+		history.Painted();
+	}
+	if (!is_creating_object) return;
+	if (creating_shape == &zoom_rect)
+		zoom_rect.Reset();
+	else
+		builder.Release();
+	creating_shape = NULL;
+	is_creating_object = false;
+}
+
 int openGL_window::handle(int event)
 {
-	float x, y;
+	if (overview)
+		return Fl_Gl_Window::handle(event);
+	InputEvent input = InputEvent();
 	switch (event)
 	{
-	case FL_PUSH: // mouse click
-		if (Fl::event_button() == FL_LEFT_MOUSE)
+	case FL_PUSH: input.kind = INPUT_PUSH; break;
+	case FL_DRAG: input.kind = INPUT_DRAG; break;
+	case FL_MOVE: input.kind = INPUT_MOVE; break;
+	case FL_RELEASE: input.kind = INPUT_RELEASE; break;
+	case FL_MOUSEWHEEL: input.kind = INPUT_WHEEL; break;
+	case FL_SHORTCUT: input.kind = INPUT_SHORTCUT; break;
+	case FL_KEYBOARD:
+		return 0; // keys go on to the shortcuts
+	default:
+		return 1;
+	}
+	// the user's input would change the session being replayed
+	if (!replay.Finished())
+		return 1;
+	input.time = recorder.Time();
+	input.window = this == main_window ? 0 : 1;
+	input.button = Fl::event_button();
+	input.x = Fl::event_x();
+	input.y = Fl::event_y();
+	input.dy = Fl::event_dy();
+	input.key = Fl::event_key();
+	input.state = Fl::event_state() & (FL_SHIFT | FL_CTRL | FL_ALT);
+	RecordSizes(input.time); // before the event may resize the zoom window
+	int used = HandleInput(input);
+	if (used)
+		recorder.Record(input);
+	return used;
+}
+
+int openGL_window::HandleInput(const InputEvent& input)
+{
+	float x, y;
+	Vector2 world;
+	switch (input.kind)
+	{
+	case INPUT_PUSH: // mouse click
+		if (input.button == FL_LEFT_MOUSE)
 		{
-			x = Fl::event_x();
-			y = Fl::event_y();
-			if (this == zoom_window) {
-				x /= current_zoom_multiple;
-				y /= current_zoom_multiple;
-				zoom_rect.ZoomPositionMapping(&x, &y);
+			world = view.ToWorld(input.x, input.y);
+			x = world.x;
+			y = world.y;
+			if (creating_object_type == MY_SELECT)
+			{
+				CancelCreatingShape();
+				ClearSelection();
+				selected_shape = scene.Pick(world, SELECT_TOLERANCE / view.Scale());
+				dragging_selection = selected_shape != NO_SHAPE;
+				drag_start = world;
+				redraw();
+			}
+			else if (creating_object_type == MY_PAINT)
+			{
+				CancelCreatingShape();
+				paint.BeginEdit();
+				paint.PaintLine(world, world, PAINT_BRUSH_RADIUS, current_color);
+				painting = true;
+				paint_last = world;
+				redraw();
+			}
+			else if (creating_object_type == MY_BUCKET)
+			{
+				// fills what this window shows around the click, one step of its own
+				CancelCreatingShape();
+				paint.BeginEdit();
+				paint.Fill(scene, world, view.VisibleRect(w(), h()), current_color);
+				history.Painted();
+				redraw();
 			}
-			if (!is_creating_object)
+			else if (!is_creating_object)
 			{
 				Shape* shape = NULL;
 				if (creating_object_type == GL_POINTS)
-					shape = new Point(current_color, current_filled);
+					shape = builder.New<Point>(current_color, current_filled);
 				else if (creating_object_type == GL_TRIANGLES)
-					shape = new Triangle(current_color, current_filled);
+					shape = builder.New<Triangle>(current_color, current_filled);
 				else if (creating_object_type == GL_LINES)
-					shape = new Line(current_color, current_filled);
+					shape = builder.New<Line>(current_color, current_filled);
 				else if (creating_object_type == GL_QUADS)
-					shape = new Quadrilater(current_color, current_filled);
+					shape = builder.New<Quadrilater>(current_color, current_filled);
 				else if (creating_object_type == MY_CIRCLES)
-					shape = new Circle(current_color, current_filled);
+					shape = builder.New<Circle>(current_color, current_filled);
+				else if (creating_object_type == MY_BRUSH) {
+					Brush* brush = builder.New<Brush>(current_color, current_filled);
+					brush->SetTolerance(BRUSH_TOLERANCE / view.Scale());
+					shape = brush;
+				}
 				else if (creating_object_type == MY_ZOOMRECT) {
 					zoom_rect.Reset(&main_window->frame);
 					shape = &zoom_rect;
 				}
 
 				shape->Set(x, y);
-				shapes[shape_count++] = shape;
+				creating_shape = shape;
 				is_creating_object = true;
-				if (shapes[shape_count - 1]->SetComplete())
-				{
-					is_creating_object = false;
-					shapes[shape_count - 1]->FitWidget(main_window->w(), main_window->h());
-				}
+				if (creating_shape->SetComplete())
+					CommitCreatingShape();
 			}
 			else
 			{
-				shapes[shape_count - 1]->Set(x, y);
-				shapes[shape_count - 1]->FitWidget(main_window->w(), main_window->h());
-				if (shapes[shape_count - 1]->SetComplete())
+				creating_shape->Set(x, y);
+				if (creating_shape->SetComplete())
 				{
-					if (shapes[shape_count - 1] == &zoom_rect) {
-						shapes[--shape_count] = NULL; // ZoomRectangle are independently draw in draw_overlay, no need to add to shapes
+					if (creating_shape == &zoom_rect) {
+						creating_shape = NULL; // ZoomRectangle are independently draw in draw_overlay, no need to add to scene
 
 						if (this == zoom_window) {
 							zoom_multiple *= 2;
@@ -774,34 +1037,132 @@ int openGL_window::handle(int event)
 							sprintf_s(s, 64, "%dX Zoom Reset", (int)zoom_multiple);
 							main_window->parent()->child(9)->copy_label(s);
 						}
+						// zoom_multiple is relative to the main window, whatever its own zoom is
+						double scale = main_window->view.Scale() * zoom_multiple;
+						Rect rect = zoom_rect.GetZoomRect();
+						zoom_window->view.Set(rect.left, rect.top, scale);
 						zoom_window->parent()->show();
 						zoom_window->show();
 						zoom_window->parent()->resize(zoom_window->parent()->x(), zoom_window->parent()->y(),
-							zoom_rect.GetWidth() * zoom_multiple, zoom_rect.GetHeight() * zoom_multiple);
+							zoom_rect.GetWidth() * scale, zoom_rect.GetHeight() * scale);
 						zoom_window->resize(zoom_window->x(), zoom_window->y(), 
-							zoom_rect.GetWidth() * zoom_multiple, zoom_rect.GetHeight() * zoom_multiple);
-						current_zoom_multiple = zoom_multiple;
+							zoom_rect.GetWidth() * scale, zoom_rect.GetHeight() * scale);
 						zoom_window->valid(0);
+						is_creating_object = false;
+					}
+					else
+					{
+						CommitCreatingShape();
 					}
-					is_creating_object = false;
 				}
 			}
 		}
+		else // right or middle button drag pans the view
+		{
+			pan_x_ = input.x;
+			pan_y_ = input.y;
+		}
 		break;
-	case FL_DRAG: case FL_MOVE:
-		x = Fl::event_x();
-		y = Fl::event_y();
-		if (this == zoom_window) {
-			x /= current_zoom_multiple;
-			y /= current_zoom_multiple;
-			zoom_rect.ZoomPositionMapping(&x, &y);
+	case INPUT_DRAG: case INPUT_MOVE:
+		if (input.kind == INPUT_DRAG && input.button != FL_LEFT_MOUSE)
+		{
+			view.Pan(input.x - pan_x_, input.y - pan_y_);
+			pan_x_ = input.x;
+			pan_y_ = input.y;
+			redraw();
+			break;
 		}
-		if (is_creating_object)
+		world = view.ToWorld(input.x, input.y);
+		if (input.kind == INPUT_DRAG && dragging_selection)
 		{
-			shapes[shape_count - 1]->PreviewSet(x, y);
-			shapes[shape_count - 1]->FitWidget(main_window->w(), main_window->h());
+			// hidden from the first move only, a plain click does not rebuild the batch
+			scene.SetHidden(selected_shape, true);
+			drag_offset.x = world.x - drag_start.x;
+			drag_offset.y = world.y - drag_start.y;
+			redraw();
+		}
+		else if (input.kind == INPUT_DRAG && painting)
+		{
+			paint.PaintLine(paint_last, world, PAINT_BRUSH_RADIUS, current_color);
+			paint_last = world;
+			redraw();
+		}
+		else if (is_creating_object)
+		{
+			creating_shape->PreviewSet(world.x, world.y);
+			redraw(); // only the preview changed, the scene is drawn from the cached layer
 		}
 		break;
+	case INPUT_RELEASE:
+		if (input.button == FL_LEFT_MOUSE && is_creating_object && creating_shape->SetOnRelease())
+		{
+			world = view.ToWorld(input.x, input.y);
+			creating_shape->Set(world.x, world.y);
+			if (creating_shape->SetComplete())
+				CommitCreatingShape();
+			redraw();
+		}
+		else if (input.button == FL_LEFT_MOUSE && dragging_selection)
+		{
+			dragging_selection = false;
+			if (scene.Hidden(selected_shape))
+			{
+				scene.SetHidden(selected_shape, false);
+				history.Move(selected_shape, drag_offset.x, drag_offset.y);
+			}
+			drag_offset.x = 0;
+			drag_offset.y = 0;
+			redraw();
+		}
+		else if (input.button == FL_LEFT_MOUSE && painting)
+		{
+			painting = false;
+			history.Painted();
+			redraw();
+		}
+		break;
+	case INPUT_WHEEL: // zoom around the mouse
+		view.ZoomAt(pow(1.25, -input.dy), input.x, input.y);
+		redraw();
+		break;
+	case INPUT_SHORTCUT: // Ctrl+B switches between GL and software drawing, Ctrl+H shows the HUD
+		if ((input.state & FL_CTRL) && (input.key == 'b' || input.key == 'h'))
+		{
+			if (input.key == 'b')
+				software_rendering = !software_rendering;
+			else
+				show_hud = !show_hud;
+			main_window->redraw();
+			zoom_window->redraw();
+			return 1;
+		}
+		// Ctrl+] and Ctrl+[ make points larger and smaller, Ctrl+P switches square and round points
+		if ((input.state & FL_CTRL) && (input.key == ']' || input.key == '[' || input.key == 'p'))
+		{
+			PointStyle style = scene.GetPointStyle();
+			if (input.key == ']')
+				style.size += 1;
+			else if (input.key == '[')
+				style.size -= 1;
+			else
+				style.shape = style.shape == POINT_ROUND ? POINT_SQUARE : POINT_ROUND;
+			scene.SetPointStyle(style);
+			journal.PointStyleChanged(scene.GetPointStyle());
+			main_window->redraw();
+			zoom_window->redraw();
+			return 1;
+		}
+		// Ctrl+E opens a view of the whole scene, it calls the display lists of the other windows
+		if ((input.state & FL_CTRL) && input.key == 'e')
+		{
+			Fl_Window* window = overview_window->window();
+			if (window->shown())
+				window->hide();
+			else
+				window->show();
+			return 1;
+		}
+		return 0;
 	default:
 		break;
 	}
@@ -823,9 +1184,21 @@ void DrawQuadrilateral(Fl_Widget *, void *) {
 void DrawCircle(Fl_Widget *, void *) {
 	creating_object_type = MY_CIRCLES;
 }
+void DrawBrush(Fl_Widget *, void *) {
+	creating_object_type = MY_BRUSH;
+}
+void Paint(Fl_Widget *, void *) {
+	creating_object_type = MY_PAINT;
+}
+void Bucket(Fl_Widget *, void *) {
+	creating_object_type = MY_BUCKET;
+}
 void DrawZoom(Fl_Widget *, void *) {
 	creating_object_type = MY_ZOOMRECT;
 }
+void Select(Fl_Widget *, void *) {
+	creating_object_type = MY_SELECT;
+}
 void ZoomUp(Fl_Widget *w, void *) {
 	zoom_multiple *= 2;
 	char s[64];
@@ -854,16 +1227,95 @@ void ZoomClear(Fl_Widget *w, void *) {
 	zoom_rect.Reset();
 	window->zoom_window->parent()->hide();
 }
-void ChangeColor(Fl_Widget *w, void *)
+void ApplyColor(Fl_Widget *w, const Color& color)
 {
-	double r, g, b;
-	fl_color_chooser("Choose a color", r, g, b);
-	current_color.r = r;
-	current_color.g = g;
-	current_color.b = b;
+	current_color = color;
+	if (creating_object_type == MY_SELECT && selected_shape != NO_SHAPE)
+		history.Recolor(selected_shape, current_color);
 	w->color(fl_rgb_color(current_color.r * 255, current_color.g * 255, current_color.b * 255));
 	w->redraw();
 }
+void ChangeColor(Fl_Widget *w, void *)
+{
+	if (!replay.Finished()) return;
+	double r = current_color.r, g = current_color.g, b = current_color.b;
+	if (!fl_color_chooser("Choose a color", r, g, b)) return;
+	InputEvent input = InputEvent();
+	input.time = recorder.Time();
+	input.kind = INPUT_COLOR;
+	input.color = Color((float)r, (float)g, (float)b);
+	RecordSizes(input.time);
+	recorder.Record(input);
+	ApplyColor(w, input.color);
+}
+void Undo(Fl_Widget *w, void *)
+{
+	CancelCreatingShape();
+	ClearSelection();
+	if (history.UndoCount() > 0 && !history.Undo())
+		fl_alert("Can not undo this step");
+}
+void Redo(Fl_Widget *w, void *)
+{
+	CancelCreatingShape();
+	ClearSelection();
+	if (history.RedoCount() > 0 && !history.Redo())
+		fl_alert("Can not redo this step");
+}
+void SaveScene(Fl_Widget *w, void *)
+{
+	const char* path = fl_file_chooser("Save scene", "Scene (*.scene)\tSVG (*.svg)\tPostScript (*.ps)", NULL);
+	if (path == NULL) return;
+	// svg and ps files are exported for other tools, anything else is a scene file
+	const char* extension = fl_filename_ext(path);
+	bool saved;
+	if (strcmp(extension, ".svg") == 0)
+		saved = ExportScene(scene, path, EXPORT_SVG, &paint);
+	else if (strcmp(extension, ".ps") == 0)
+		saved = ExportScene(scene, path, EXPORT_POSTSCRIPT, &paint);
+	else
+		saved = scene.Save(path, true, false, &paint);
+	if (!saved)
+		fl_alert("Can not save %s", path);
+}
+// the canvas replaced by a scene file, false when it can not be read and the canvas is kept
+bool OpenCanvas(const char* path)
+{
+	CancelCreatingShape();
+	ClearSelection();
+	// svg files from other tools are imported, anything else is a scene file
+	bool svg = strcmp(fl_filename_ext(path), ".svg") == 0;
+	if (!(svg ? ImportSvg(path, &scene) : scene.Open(path, &paint)))
+		return false;
+	history.Reset(); // steps refer to the shapes of the old scene
+	if (svg)
+		paint.Release(); // the paint belonged to the old canvas
+	journal.Opened(path, svg);
+	return true;
+}
+// the replay opens the same path, so the file has to stay where it is
+void RecordOpen(double time, const char* path)
+{
+	InputEvent input = InputEvent();
+	input.time = time;
+	input.kind = INPUT_OPEN;
+	input.path = path;
+	RecordSizes(time);
+	recorder.Record(input);
+}
+void OpenScene(Fl_Widget *w, void *)
+{
+	if (!replay.Finished()) return;
+	const char* path = fl_file_chooser("Open scene", "Scene (*.scene)\tSVG (*.svg)", NULL);
+	if (path == NULL) return;
+	double time = recorder.Time();
+	if (!OpenCanvas(path))
+	{
+		fl_alert("Can not open %s", path);
+		return;
+	}
+	RecordOpen(time, path);
+}
 void CloseZoom(Fl_Widget *w, void *)
 {
 	zoom_rect.Reset();
@@ -871,46 +1323,42 @@ void CloseZoom(Fl_Widget *w, void *)
 }
 void Erase(Fl_Widget *w, void *)
 {
-	if (shape_count > 0)
+	if (is_creating_object)
 	{
-		if (shapes[shape_count - 1] == &zoom_rect) {
-			--shape_count;
-			zoom_rect.Reset();
-		}
-		else
-		{
-			delete shapes[--shape_count];
-			shapes[shape_count] = NULL;
-		}
-		is_creating_object = false;
+		CancelCreatingShape();
+		return;
 	}
+	// the selected shape, else the topmost one still on the canvas
+	size_t z = creating_object_type == MY_SELECT ? selected_shape : NO_SHAPE;
+	ClearSelection();
+	if (z == NO_SHAPE)
+	{
+		z = scene.Count();
+		while (z > 0 && scene.Deleted(z - 1))
+			z--;
+		if (z == 0) return;
+		z--;
+	}
+	history.Delete(z);
 }
 void Clear(Fl_Widget *w, void *)
 {
-	if (shapes[shape_count - 1] == &zoom_rect) --shape_count;
-	for (int i = 0; i < shape_count; i++) {
-		delete shapes[i];
-		shapes[i] = NULL;
-	}
-	shape_count = 0;
-	is_creating_object = false;
+	CancelCreatingShape();
+	ClearSelection();
+	history.Clear();
 	zoom_rect.Reset();
 }
 
 void Idle(Fl_Widget *w, void *)
 {
-	w->parent()->resize(100, 100, 1162, 532);
+	w->parent()->resize(100, 100, 1162, 554);
 
-	if (shapes[shape_count - 1] == &zoom_rect) --shape_count;
-	for (int i = 0; i < shape_count; i++) 
-	{
-		delete shapes[i];
-		shapes[i] = NULL;
-	}
-	shape_count = 0;
-	is_creating_object = false;
+	CancelCreatingShape();
+	ClearSelection();
+	history.Clear();
 	zoom_rect.Reset();
 	openGL_window* draw_win = (openGL_window*)w->parent()->child(0); // 0: draw window
+	draw_win->view.Reset();
 	draw_win->zoom_window->parent()->hide();
 	current_color.r = 1;
 	current_color.g = 1;
@@ -921,6 +1369,7 @@ void Idle(Fl_Widget *w, void *)
 }
 void Exit(Fl_Widget *w, void *)
 {
+	journal.Stop(); // the last edits reach the journal
 	exit(0);
 }
 void SetFill(Fl_Widget *w, void *)
@@ -933,10 +1382,142 @@ void SetLine(Fl_Widget *w, void *)
 }
 
 
+// toolbar click, recorded and passed on to the button's own callback
+void RecordButton(Fl_Widget *w, void *)
+{
+	if (!replay.Finished() && !replay_dispatching) return; // the user's click would change the replayed session
+	int index = w->parent()->find(w);
+	InputEvent input = InputEvent();
+	input.time = recorder.Time();
+	input.kind = INPUT_BUTTON;
+	input.button = index;
+	RecordSizes(input.time);
+	recorder.Record(input);
+	toolbar_callbacks[index](w, NULL);
+}
+// route the buttons through RecordButton. The color and open dialogs record what was picked
+// themselves, saving and ending the program change nothing a replay would draw
+void RecordToolbar(Fl_Group *window)
+{
+	toolbar_callbacks.assign(window->children(), NULL);
+	for (int i = 0; i < window->children(); i++)
+	{
+		Fl_Widget* child = window->child(i);
+		Fl_Callback* callback = child->callback();
+		if (child->as_window() != NULL || callback == ChangeColor || callback == SaveScene || callback == OpenScene || callback == Exit)
+			continue;
+		toolbar_callbacks[i] = callback;
+		child->callback(RecordButton);
+	}
+}
+
+// the window gets the recorded size, its top window grows or shrinks along
+void ResizeInputWindow(openGL_window* window, int w, int h)
+{
+	Fl_Window* top = window->top_window();
+	top->size(top->w() + w - window->w(), top->h() + h - window->h());
+	if (window->w() != w || window->h() != h) // not the resizable child of its top window
+		window->size(w, h);
+}
+
+// feed the next recorded event and draw its frames, then wait for the one after it
+void ReplayNext(void *)
+{
+	if (replay.Finished())
+	{
+		FILE* report = report_path != NULL ? OpenFile(report_path, "w") : stdout;
+		if (report == NULL)
+			Fl::fatal("Can not write %s", report_path);
+		replay.WriteReport(report);
+		if (report != stdout)
+			fclose(report);
+		exit(0);
+	}
+	const InputEvent& input = replay.Next();
+	openGL_window* window = input_windows[0];
+	Fl_Group* toolbar = window->parent();
+	replay.Dispatch();
+	replay_dispatching = true;
+	if (input.kind == INPUT_BUTTON)
+	{
+		if (input.button >= 0 && input.button < toolbar->children())
+			toolbar->child(input.button)->do_callback();
+	}
+	else if (input.kind == INPUT_COLOR)
+		ApplyColor(toolbar->child(10), input.color); // 10: the color button
+	else if (input.kind == INPUT_OPEN)
+	{
+		// the session after it would differ from the recorded one
+		if (!OpenCanvas(input.path.c_str()))
+			Fl::fatal("Can not open %s", input.path.c_str());
+	}
+	else if (input.kind == INPUT_RESIZE)
+		ResizeInputWindow(input_windows[input.window], input.x, input.y);
+	else
+		input_windows[input.window]->HandleInput(input);
+	replay_dispatching = false;
+	// the windows draw now instead of when the loop is idle, so the frame is the event's own
+	window->redraw();
+	if (input_windows[1]->visible())
+		input_windows[1]->redraw();
+	Fl::flush();
+	replay.Settle();
+	Fl::add_timeout(replay_fast ? 0 : replay.Delay(), ReplayNext);
+}
+
+// -record file, -replay file, -fast, -report file, -compact and -journal file next to the FLTK options
+int ParseArgument(int argc, char **argv, int &i)
+{
+	if (strcmp(argv[i], "-fast") == 0)
+	{
+		replay_fast = true;
+		i++;
+		return 1;
+	}
+	if (strcmp(argv[i], "-compact") == 0)
+	{
+		compact_storage = true;
+		i++;
+		return 1;
+	}
+	if (i + 1 >= argc) return 0;
+	if (strcmp(argv[i], "-record") == 0)
+		record_path = argv[i + 1];
+	else if (strcmp(argv[i], "-replay") == 0)
+		replay_path = argv[i + 1];
+	else if (strcmp(argv[i], "-report") == 0)
+		report_path = argv[i + 1];
+	else if (strcmp(argv[i], "-journal") == 0)
+		journal_path = argv[i + 1];
+	else
+		return 0;
+	i += 2;
+	return 2;
+}
+
 
 //  main function
 int main(int argc, char **argv) {
-	Fl_Window window(100, 100, 640, 532, "H.W.One");
+	int first_argument = 0;
+	if (Fl::args(argc, argv, first_argument, ParseArgument) == 0 || first_argument < argc)
+		Fl::fatal("usage: %s [-record file | -replay file [-fast] [-report file]] [-compact] [-journal file] [FLTK options]", argv[0]);
+	if (record_path != NULL && replay_path != NULL)
+		Fl::fatal("-record and -replay can not be used together");
+	scene.SetCompact(compact_storage);
+	history.SetPaintLayer(&paint);
+	// a replay starts from an empty canvas and leaves the autosave of the user's canvas alone
+	bool recovered = false;
+	if (replay_path == NULL)
+	{
+		// the canvas as the last session left it, also after a crash
+		recovered = Journal::Recover(journal_path, &scene, &paint);
+		if (journal.Start(journal_path, compact_storage))
+			history.SetJournal(&journal);
+		else
+			fprintf(stderr, "Can not write %s, the canvas is not autosaved\n", journal_path);
+	}
+
+	Fl_Window window(100, 100, 640, 554, "H.W.One");
 	
 	openGL_window gl_win(10, 10, 620, 400);
 	window.resizable(gl_win);
@@ -998,7 +1579,7 @@ int main(int argc, char **argv) {
 
 
 	Fl_Widget *idle;
-	idle = new Fl_Button(12, 505, 407, 20, "Idle");
+	idle = new Fl_Button(12, 505, 242, 20, "Idle");
 	idle->callback(Idle);
 
 	Fl_Widget *exit;
@@ -1014,8 +1595,50 @@ int main(int argc, char **argv) {
 	line = new Fl_Button(320, 442, 306, 17, "Line");
 	line->callback(SetLine);
 
+	Fl_Widget *select;
+	select = new Fl_Button(12, 527, 120, 20, "Select");
+	select->callback(Select);
+
+	Fl_Button *undo;
+	undo = new Fl_Button(134, 527, 120, 20, "Undo");
+	undo->callback(Undo);
+	undo->shortcut(FL_CTRL + 'z');
+
+	Fl_Button *redo;
+	redo = new Fl_Button(258, 527, 120, 20, "Redo");
+	redo->callback(Redo);
+	redo->shortcut(FL_CTRL + 'y');
+
+	Fl_Button *save;
+	save = new Fl_Button(382, 527, 120, 20, "Save");
+	save->callback(SaveScene);
+	save->shortcut(FL_CTRL + 's');
+
+	Fl_Button *open;
+	open = new Fl_Button(506, 527, 120, 20, "Open");
+	open->callback(OpenScene);
+	open->shortcut(FL_CTRL + 'o');
+
+	Fl_Widget *brush;
+	brush = new Fl_Button(258, 505, 53, 20, "Brush");
+	brush->callback(DrawBrush);
+
+	Fl_Widget *paint_button;
+	paint_button = new Fl_Button(312, 505, 53, 20, "Paint");
+	paint_button->callback(Paint);
+
+	Fl_Widget *bucket;
+	bucket = new Fl_Button(366, 505, 53, 20, "Bucket");
+	bucket->callback(Bucket);
+	// the fill sees the canvas at one pixel per world unit whatever the zoom, say so where it is picked
+	bucket->tooltip("Fill the paint around the click up to another color.\n"
+		"Edges are found at one pixel per world unit, not at the zoom shown:\n"
+		"shapes thinner than a unit may let the fill through when zoomed in,\n"
+		"and it stops at the window or 2048 units from the click.");
+
 
 	window.end();                  // End of FLTK windows setting. 
+	RecordToolbar(&window);
 	window.show(argc, argv);        // Show the FLTK window
 
 	Fl_Window zoom_window(0, 0, 320, 240, "Zoom Window");
@@ -1029,9 +1652,41 @@ int main(int argc, char **argv) {
 
 	zoom_window.end();
 
+	Fl_Window overview(660, 100, 320, 240, "Overview");
+	openGL_window gl_win_overview(0, 0, 320, 240);
+	gl_win_overview.overview = true;
+	gl_win_overview.main_window = &gl_win;
+	gl_win_overview.zoom_window = &gl_win_zoom;
+	overview.resizable(gl_win_overview);
+	overview.end();
+	overview_window = &gl_win_overview;
+
 	gl_win.show();                 // Show the openGL window
 	gl_win.redraw_overlay();       // redraw 
-	
+
+	input_windows[0] = &gl_win;
+	input_windows[1] = &gl_win_zoom;
+	if (record_path != NULL)
+	{
+		if (!recorder.Start(record_path))
+			Fl::fatal("Can not write %s", record_path);
+		// the recovered canvas is saved next to the recording, the replay opens it first
+		if (recovered)
+		{
+			string start = string(record_path) + ".scene";
+			if (!scene.Save(start.c_str(), true, false, &paint))
+				Fl::fatal("Can not write %s", start.c_str());
+			RecordOpen(0, start.c_str());
+		}
+		RecordSizes(0);
+	}
+	if (replay_path != NULL)
+	{
+		if (!replay.Load(replay_path))
+			Fl::fatal("Can not read %s", replay_path);
+		Fl::add_timeout(replay.Delay(), ReplayNext);
+	}
+
 
 	return Fl::run();
 }
\ No newline at end of file
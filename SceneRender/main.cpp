@@ -0,0 +1,182 @@
+// Headless scene renderer: rasterizes scene and SVG files to PNG on the CPU, no display or GPU needed.
+// usage: SceneRender [-size WxH] [-view left,top,right,bottom] [-out dir] [-threads n] scene...
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "../OpenGL/Scene.h"
+#include "../OpenGL/Import.h"
+#include "../OpenGL/View.h"
+#include "../OpenGL/Raster.h"
+#include "../OpenGL/PaintLayer.h"
+#include "../OpenGL/Png.h"
+
+using namespace std;
+
+struct RenderOptions
+{
+	int w;
+	int h;
+	bool has_view;
+	Rect view; // world rectangle fit into the image, the scene bounds when not given
+	string out_dir;
+	int threads;
+	vector<string> files;
+};
+
+static void Usage()
+{
+	fprintf(stderr,
+		"usage: SceneRender [-size WxH] [-view left,top,right,bottom] [-out dir] [-threads n] scene...\n"
+		"  -size     image size in pixels, 640x480 by default\n"
+		"  -view     world rectangle shown, centered, the whole scene by default\n"
+		"  -out      directory of the images, next to each scene by default\n"
+		"  -threads  scenes rendered at once, one per core by default\n");
+}
+
+// count numbers separated by separator, nothing else in the text
+static bool ParseNumbers(const char* text, char separator, double* values, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		char* end;
+		values[i] = strtod(text, &end);
+		if (end == text || *end != (i + 1 < count ? separator : '\0')) return false;
+		text = end + 1;
+	}
+	return true;
+}
+
+static bool ParseOptions(int argc, char** argv, RenderOptions* options)
+{
+	options->w = 640;
+	options->h = 480;
+	options->has_view = false;
+	options->threads = (int)thread::hardware_concurrency();
+	if (options->threads < 1) options->threads = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "-size") == 0 && has_value)
+		{
+			double size[2];
+			if (!ParseNumbers(argv[++i], 'x', size, 2) || size[0] < 1 || size[1] < 1 || size[0] > 16384 || size[1] > 16384) return false;
+			options->w = (int)size[0];
+			options->h = (int)size[1];
+		}
+		else if (strcmp(argv[i], "-view") == 0 && has_value)
+		{
+			double r[4];
+			if (!ParseNumbers(argv[++i], ',', r, 4)) return false;
+			Rect view = { (float)r[0], (float)r[1], (float)r[2], (float)r[3] };
+			options->view = view;
+			options->has_view = true;
+		}
+		else if (strcmp(argv[i], "-out") == 0 && has_value)
+		{
+			options->out_dir = argv[++i];
+		}
+		else if (strcmp(argv[i], "-threads") == 0 && has_value)
+		{
+			options->threads = atoi(argv[++i]);
+			if (options->threads < 1) return false;
+		}
+		else if (argv[i][0] == '-')
+		{
+			return false;
+		}
+		else
+		{
+			options->files.push_back(argv[i]);
+		}
+	}
+	return !options->files.empty();
+}
+
+// image path of a scene, its name with a png extension in the output directory
+static string ImagePath(const string& scene_path, const string& out_dir)
+{
+	size_t slash = scene_path.find_last_of("/\\");
+	size_t name_start = slash == string::npos ? 0 : slash + 1;
+	size_t dot = scene_path.find_last_of('.');
+	size_t name_end = dot == string::npos || dot < name_start ? scene_path.size() : dot;
+	string name = scene_path.substr(name_start, name_end - name_start) + ".png";
+	if (out_dir.empty())
+		return scene_path.substr(0, name_start) + name;
+	char last = out_dir[out_dir.size() - 1];
+	return out_dir + (last == '/' || last == '\\' ? "" : "/") + name;
+}
+
+int main(int argc, char** argv)
+{
+	RenderOptions options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		Usage();
+		return 2;
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	atomic<size_t> next(0);
+	atomic<int> failed(0);
+	mutex output;
+	// every worker keeps its scene, image and renderer for all the files it takes
+	vector<thread> workers;
+	int threads = min(options.threads, (int)options.files.size());
+	for (int t = 0; t < threads; t++)
+	{
+		workers.push_back(thread([&]()
+		{
+			Scene scene;
+			PaintLayer paint;
+			Framebuffer image;
+			SoftwareRenderer renderer;
+			View view;
+			// files are already drawn in parallel, a single file uses the threads for bands instead
+			renderer.SetThreads(threads > 1 ? 1 : options.threads);
+			image.Resize(options.w, options.h);
+			for (size_t i = next++; i < options.files.size(); i = next++)
+			{
+				chrono::steady_clock::time_point file_start = chrono::steady_clock::now();
+				const string& path = options.files[i];
+				string image_path = ImagePath(path, options.out_dir);
+				// svg files are imported, on one thread when files are already drawn in parallel
+				bool svg = path.size() > 4 && path.compare(path.size() - 4, 4, ".svg") == 0;
+				if (svg)
+					paint.Release();
+				bool ok = svg ? ImportSvg(path.c_str(), &scene, threads > 1 ? 1 : options.threads) : scene.Open(path.c_str(), &paint);
+				if (ok)
+				{
+					Rect empty = { 0, 0, 0, 0 };
+					Rect bounds = scene.Count() > 0 ? scene.Bounds() : empty;
+					view.Fit(options.has_view ? options.view : bounds, options.w, options.h);
+					renderer.Draw(scene, view, &image);
+					paint.Draw(view, &image);
+					ok = WritePng(image_path.c_str(), image);
+				}
+				double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - file_start).count();
+				lock_guard<mutex> lock(output);
+				if (ok)
+				{
+					printf("%s -> %s, %zu shapes, %.1f ms\n", path.c_str(), image_path.c_str(), scene.Count(), ms);
+				}
+				else
+				{
+					fprintf(stderr, "%s: can not render\n", path.c_str());
+					failed++;
+				}
+			}
+		}));
+	}
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	printf("%d of %zu scenes rendered in %.2f s\n", (int)options.files.size() - failed, options.files.size(), seconds);
+	return failed > 0 ? 1 : 0;
+}